@@ -0,0 +1,147 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../theseus/lcp.h"
+
+/**
+ * Microbenchmark of the LCP kernels. For several distributions of the match
+ * run lengths (the number of equal characters between two consecutive
+ * mismatches), it measures the time required by each kernel to walk through a
+ * pair of sequences, as done by the extend operation of the aligner.
+ *
+ */
+
+struct RunLengthDistribution {
+    std::string name;
+    std::function<int(std::mt19937 &)> sample;
+};
+
+
+// Build a pair of sequences with mismatches separated by the sampled run lengths
+void build_sequences(const RunLengthDistribution &dist,
+                     int seq_len,
+                     std::string &seq_1,
+                     std::string &seq_2) {
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<int> base_dist(0, 3);
+    const std::string bases = "ACGT";
+
+    seq_1.resize(seq_len);
+    for (auto &c : seq_1) c = bases[base_dist(rng)];
+    seq_2 = seq_1;
+
+    int pos = dist.sample(rng);
+    while (pos < seq_len) {
+        seq_2[pos] = (seq_2[pos] == 'A') ? 'C' : 'A';
+        pos += 1 + dist.sample(rng);
+    }
+}
+
+
+// Walk the sequences with a given kernel, restarting after each mismatch
+double time_kernel(theseus::lcp::kernel_t lcp,
+                   const std::string &seq_1,
+                   const std::string &seq_2,
+                   int repetitions,
+                   long long &checksum) {
+    const int len = seq_1.size();
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; ++r) {
+        int pos = 0;
+        while (pos < len) {
+            pos += lcp(seq_1.data() + pos, seq_2.data() + pos, len - pos);
+            checksum += pos;
+            pos += 1; // Skip the mismatch
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+int main() {
+    constexpr int seq_len = 1 << 20;
+    constexpr int repetitions = 20;
+
+    std::vector<RunLengthDistribution> distributions = {
+        {"geometric(mean=4)", [](std::mt19937 &rng) { return std::geometric_distribution<int>(1.0 / 5)(rng); }},
+        {"geometric(mean=16)", [](std::mt19937 &rng) { return std::geometric_distribution<int>(1.0 / 17)(rng); }},
+        {"geometric(mean=64)", [](std::mt19937 &rng) { return std::geometric_distribution<int>(1.0 / 65)(rng); }},
+        {"geometric(mean=256)", [](std::mt19937 &rng) { return std::geometric_distribution<int>(1.0 / 257)(rng); }},
+        {"uniform[0,1000]", [](std::mt19937 &rng) { return std::uniform_int_distribution<int>(0, 1000)(rng); }},
+        {"exact match", [](std::mt19937 &) { return seq_len; }}
+    };
+
+    std::vector<theseus::lcp::Kernel> kernels = {
+        theseus::lcp::Kernel::Scalar,
+        theseus::lcp::Kernel::SSE2,
+        theseus::lcp::Kernel::AVX2,
+        theseus::lcp::Kernel::AVX512
+    };
+
+    std::cout << "Selected kernel: " << theseus::lcp::kernel_name(theseus::lcp::best_kernel()) << "\n\n";
+    std::cout << std::left << std::setw(22) << "distribution";
+    for (auto kernel : kernels) {
+        std::cout << std::right << std::setw(12) << theseus::lcp::kernel_name(kernel);
+    }
+    std::cout << "   (ms, speedup vs scalar)\n";
+
+    long long checksum = 0;
+    for (const auto &dist : distributions) {
+        std::string seq_1, seq_2;
+        build_sequences(dist, seq_len, seq_1, seq_2);
+
+        std::cout << std::left << std::setw(22) << dist.name;
+        double scalar_time = 0;
+        for (auto kernel : kernels) {
+            if (!theseus::lcp::is_supported(kernel)) {
+                std::cout << std::right << std::setw(12) << "n/a";
+                continue;
+            }
+            double t = time_kernel(theseus::lcp::get_kernel(kernel), seq_1, seq_2, repetitions, checksum);
+            if (kernel == theseus::lcp::Kernel::Scalar) scalar_time = t;
+            std::ostringstream cell;
+            cell << std::fixed << std::setprecision(1) << t << "/" << std::setprecision(1) << scalar_time / t << "x";
+            std::cout << std::right << std::setw(12) << cell.str();
+        }
+        std::cout << "\n";
+    }
+    std::cout << "\nChecksum: " << checksum << std::endl;
+
+    return 0;
+}
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include "theseus/penalties.h"
 
@@ -39,6 +41,21 @@
 
 namespace theseus {
 
+/**
+ * @brief Outcome of an alignment.
+ *      - Aligned: the whole sequence was aligned.
+ *      - MaxScoreReached: the alignment was terminated because its score
+ *        exceeded the maximum score (see EarlyTermination).
+ *      - XDropped: the alignment was terminated by the X-drop criterion.
+ *   When terminated, the alignment is the best partial alignment found (a
+ *   prefix of the sequence, see query_end).
+ */
+enum class AlignmentStatus {
+    Aligned,
+    MaxScoreReached,
+    XDropped
+};
+
 class Alignment {
     public:
     /**
@@ -49,7 +66,19 @@ class Alignment {
       std::vector<char> edit_op; // Edit operations
       std::vector<int> path;     // Path of the alignment
       int start_offset;      // Start offset in the first vertex of the path
+      int start_index = 0;   // Winning starting position (multi-source alignment)
       int end_offset;        // End offset in the last vertex of the path
+      int score = 0;         // Score of the alignment (user defined penalties)
+      int64_t pruned_cells = 0;  // Cells dropped by the wavefront reduction
+      AlignmentStatus status = AlignmentStatus::Aligned;
+      int query_start = 0;   // First aligned query base (skipped leading bases, see EndsFree)
+      int query_end = 0;     // End of the aligned query bases (the query size unless
+                             // terminated early or with free trailing bases)
+      bool memory_fallback = false;  // Low memory mode: (part of) the alignment was computed
+                                     // storing its whole backtrace, as in the high memory mode.
+                                     // High memory mode: the backtrace did not fit in the cell
+                                     // positions and the alignment was computed in low memory
+                                     // mode (or with the banded DP if it can not be used)
 
 
       // Compute the affine gap score of the CIGAR,
@@ -62,41 +91,43 @@ class Alignment {
        * @return int Alignment score according to user penalties and computed CIGAR
        */
       int compute_affine_gap_score(Penalties &user_penalties) {
-          int score = 0;
-          bool insertion_open = false, deletion_open = false;
-          for (const auto &op : edit_op) {
-              if (op == 'X') {
-                  insertion_open = false;
-                  deletion_open = false;
-                  score += user_penalties.mism(); // Mismatch score
+          // Score of a gap (the cheapest piece with dual affine penalties)
+          auto gap_score = [&user_penalties](int len) {
+              int gap = user_penalties.gapo() + user_penalties.gape() * len;
+              if (user_penalties.type() == Penalties::Type::DualAffine) {
+                  gap = std::min(gap, user_penalties.gapo2() + user_penalties.gape2() * len);
               }
-              else if (op == 'I') {
-                  deletion_open = false;
-                  if (!insertion_open) {
-                      insertion_open = true;
-                      score += user_penalties.gapo() + user_penalties.gape(); // Gap open penalty for insertion
-                  }
-                  else {
-                      score += user_penalties.gape(); // Gap extend penalty for insertion
+              return gap;
+          };
+
+          int total = 0, gap_len = 0;
+          char gap_op = 0;
+          for (const auto &op : edit_op) {
+              if (op == 'I' || op == 'D') {
+                  if (op != gap_op && gap_len > 0) {
+                      total += gap_score(gap_len);   // Close the previous gap
+                      gap_len = 0;
                   }
+                  gap_op = op;
+                  gap_len += 1;
+                  continue;
               }
-              else if (op == 'D') {
-                  insertion_open = false;
-                  if (!deletion_open) {
-                      deletion_open = true;
-                      score += user_penalties.gapo() + user_penalties.gape(); // Gap open penalty for deletion
-                  }
-                  else {
-                      score += user_penalties.gape(); // Gap extend penalty for deletion
-                  }
+              if (gap_len > 0) {
+                  total += gap_score(gap_len);
+                  gap_len = 0;
+              }
+              gap_op = 0;
+              if (op == 'X') {
+                  total += user_penalties.mism(); // Mismatch score
               }
               else if (op == 'M') {
-                  insertion_open = false;
-                  deletion_open = false;
-                  score += user_penalties.match(); // Match score
+                  total += user_penalties.match(); // Match score
               }
           }
-          return score;
+          if (gap_len > 0) {
+              total += gap_score(gap_len);
+          }
+          return total;
       }
 
     private:
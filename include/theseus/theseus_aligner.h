@@ -28,11 +28,18 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <istream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "theseus/penalties.h"
 #include "theseus/alignment.h"
+#include "theseus/theseus_graph.h"
 
 /**
  * @file theseus_aligner.h
@@ -47,6 +54,154 @@ namespace theseus
 {
 
     class TheseusAlignerImpl; // Forward declaration of the implementation class.
+    class BatchAligner;       // Forward declaration of the batch aligner class.
+
+    /**
+     * @brief Memory mode of the aligner.
+     *      - High: the cells needed for the backtrace are kept for the whole
+     *        alignment (fastest). An alignment with more than 2^27 of them in
+     *        a matrix is computed again as in Low (see
+     *        Alignment::memory_fallback).
+     *      - Low: bidirectional alignment. Forward and reverse wavefronts are
+     *        computed without backtrace until they meet, and the alignment is
+     *        split there recursively. Memory grows with the score of the
+     *        alignment instead of its square, at the cost of recomputation.
+     *        The resulting alignment is also optimal, although it may be a
+     *        different co-optimal alignment. The parts where no split is
+     *        found are aligned as in High (see Alignment::memory_fallback).
+     */
+    enum class MemoryMode {
+        High,
+        Low
+    };
+
+    /**
+     * @brief What the aligner computes.
+     *      - Full: the whole alignment (CIGAR and path).
+     *      - ScoreOnly: only the optimal score and the end position. No
+     *        backtrace data is stored, only the wavefronts of the last scores.
+     *        The returned Alignment has no edit operations, its path only
+     *        contains the end vertex and end_offset is the offset within it.
+     *        Requires a zero match penalty.
+     */
+    enum class AlignmentScope {
+        Full,
+        ScoreOnly
+    };
+
+    /**
+     * @brief Parameters of the adaptive wavefront reduction heuristic. After
+     * each score, if the wavefront has at least "min_wavefront_length" cells,
+     * the cells whose query offset lags more than "max_distance_threshold"
+     * behind the furthest reaching cell are dropped, and the vertices left
+     * without cells stop being processed. This bounds the cost of noisy
+     * alignments, but the result is no longer guaranteed to be optimal.
+     *
+     */
+    struct WavefrontReduction {
+        bool enabled = false;
+        int min_wavefront_length = 10;
+        int max_distance_threshold = 50;
+    };
+
+    /**
+     * @brief Early termination criteria of an alignment (a negative value
+     * disables a criterion). The alignment is terminated when:
+     *      - max_score: the score exceeds max_score.
+     *      - xdrop: the best alignments of the last scores fall more than
+     *        xdrop behind the best alignment found so far. Alignments are
+     *        compared by their progress, rewarding each aligned query base
+     *        with a quarter of the mismatch penalty (so random sequences,
+     *        which cost about half of it per base, are dropped).
+     * Scores are those of the wavefront algorithm (equal to the alignment
+     * scores for a zero match penalty). Terminated alignments return the best
+     * partial alignment found (see AlignmentStatus).
+     *
+     */
+    struct EarlyTermination {
+        int max_score = -1;
+        int xdrop = -1;
+    };
+
+    /**
+     * @brief Ends-free alignment (as in the WFA2 ends-free model): number of
+     * bases at the ends of the query and the graph that can be left unaligned
+     * without penalty.
+     *      - query_begin/query_end: leading/trailing query bases.
+     *      - graph_begin: graph bases following the starting position (within
+     *        the starting vertex). The graph end is always free, the alignment
+     *        may end anywhere in the graph.
+     * All zero by default (the whole query is aligned from the starting
+     * position). A large graph_begin gives a semi-global alignment (free
+     * graph ends) over the starting vertex. The aligned part of the query is
+     * reported in Alignment::query_start and Alignment::query_end.
+     *
+     */
+    struct EndsFree {
+        int query_begin = 0;
+        int query_end = 0;
+        int graph_begin = 0;
+    };
+
+    /**
+     * @brief Fallback of the wavefronts for divergent sequences (a negative
+     * score_threshold disables it). When the score of the wavefronts exceeds
+     * score_threshold, the alignment is computed with a banded DP over the
+     * graph reachable from the start (see banded_dp.h), whose cost is
+     * proportional to the query length times the band instead of the square
+     * of the score. Only the query offsets within "band" of the best cell of
+     * each column are computed, so the alignment is no longer guaranteed to
+     * be optimal. The DP starts again from the starting position: the waves
+     * computed up to score_threshold are discarded, so a divergent sequence
+     * costs those waves (about score_threshold^2 cells) plus the whole DP.
+     * Used by full alignments with a single starting position in the default
+     * memory mode.
+     *
+     */
+    struct DPFallback {
+        int score_threshold = -1;
+        int band = 64;
+    };
+
+    /**
+     * @brief Lockstep alignment of the short queries of align_batch that
+     * share a starting position (e.g., targeted panels). Up to 16 queries of
+     * at most max_length bases are aligned together with a banded DP whose
+     * cells are interleaved in SIMD lanes (see lane_dp.h), so each column of
+     * the graph is computed once for all of them. Only the query offsets
+     * within "band" of the distance from the start to each column are
+     * computed: the queries whose alignment is not proven optimal within the
+     * band are aligned again with twice the band, until it covers them, and
+     * then with the wavefronts (as the perfect matches), so the alignments
+     * are the same as without lockstep. Used for full alignments without
+     * ends-free and early termination.
+     *
+     */
+    struct LockstepBatching {
+        bool enabled = false;
+        int max_length = 512;
+        int band = 32;
+    };
+
+    /**
+     * @brief A starting position in the graph.
+     *
+     */
+    struct StartPosition {
+        std::string node;   // Starting node
+        int offset = 0;     // Starting offset within the starting node
+    };
+
+    /**
+     * @brief A query of a batch alignment: the sequence to align and its
+     * starting position in the graph.
+     *
+     */
+    struct Query {
+        std::string_view seq;       // Sequence to be aligned
+        std::string start_node;     // Starting node in the graph
+        int start_offset = 0;       // Starting offset within the starting node
+    };
 
     class TheseusAligner
     {
@@ -56,8 +211,22 @@ namespace theseus
          *
          * @param penalties User defined alignment penalties
          * @param gfa_stream Input stream containing the graph in GFA format
+         * @param packed_sequences Store the graph and query sequences with 2
+         *        bits per base (about 4x less graph memory)
          */
-        TheseusAligner(const Penalties &penalties, std::istream &gfa_stream);
+        TheseusAligner(const Penalties &penalties,
+                       std::istream &gfa_stream,
+                       bool packed_sequences = false);
+
+        /**
+         * Constructor on a shared graph. The aligner only allocates its own
+         * alignment workspace, so any number of aligners (e.g., one per
+         * thread) can align concurrently against the same in-memory graph.
+         *
+         * @param penalties User defined alignment penalties
+         * @param graph Reference graph (shared, read-only)
+         */
+        TheseusAligner(const Penalties &penalties, const TheseusGraph &graph);
 
         /**
          * Class destructor
@@ -86,11 +255,208 @@ namespace theseus
          * @return Alignment
          */
         Alignment align(std::string_view seq,
-                std::string &start_node,
+                const std::string &start_node,
                 int start_offset = 0);
 
+        /**
+         * Multi-source alignment. Aligns the given sequence from the best of
+         * several candidate starting positions in a single run: all of them
+         * seed the same wavefronts, so the graph regions shared by close
+         * candidates are explored once. The index of the winning candidate
+         * is returned in Alignment::start_index (-1 in score-only scope,
+         * where it is not known). The low memory mode is not supported with
+         * several candidates (the default mode is used instead).
+         *
+         * @param seq Sequence to be aligned
+         * @param starts Candidate starting positions
+         * @return Alignment
+         */
+        Alignment align(std::string_view seq,
+                        std::span<const StartPosition> starts);
+
+        /**
+         * Bounded verification. Checks whether the given sequence aligns from
+         * the specified node and offset with a score of at most "max_score".
+         * Only the wavefronts up to "max_score" are computed and no backtrace
+         * data is stored. Requires a zero match penalty (throws
+         * std::invalid_argument otherwise).
+         *
+         * @param seq Sequence to be verified
+         * @param start_node Starting node in the graph
+         * @param start_offset Starting offset within the starting node
+         * @param max_score Maximum score
+         * @return std::optional<int> Optimal score if it is at most max_score,
+         *         std::nullopt otherwise
+         */
+        std::optional<int> verify(std::string_view seq,
+                                  const std::string &start_node,
+                                  int start_offset,
+                                  int max_score);
+
+        /**
+         * Seed extension. Aligns the given sequence around an anchor: the
+         * query position "query_pos" aligned to the graph position
+         * ("anchor_node", "anchor_offset"). The query is extended rightwards
+         * on the graph and leftwards on the reverse complement strand of the
+         * graph (the "-" vertices of the GFA), and both halves are joined in
+         * one alignment. The alignment may start and end anywhere in the
+         * graph. In score-only scope, the path contains the first and the last
+         * vertices of the alignment.
+         *
+         * @param seq Sequence to be aligned
+         * @param query_pos Query position of the anchor
+         * @param anchor_node Anchor node in the graph
+         * @param anchor_offset Anchor offset within the anchor node
+         * @return Alignment
+         */
+        Alignment extend(std::string_view seq,
+                         int query_pos,
+                         const std::string &anchor_node,
+                         int anchor_offset);
+
+        /**
+         * Set the memory mode (see MemoryMode). By default, MemoryMode::High.
+         *
+         * @param mode Memory mode
+         */
+        void set_memory_mode(MemoryMode mode);
+
+        /**
+         * Set the alignment scope (see AlignmentScope). By default,
+         * AlignmentScope::Full. Throws std::invalid_argument if the score-only
+         * scope is selected with a non-zero match penalty.
+         *
+         * @param scope Alignment scope
+         */
+        void set_alignment_scope(AlignmentScope scope);
+
+        /**
+         * Set the adaptive wavefront reduction heuristic (see
+         * WavefrontReduction). Disabled by default. The number of dropped
+         * cells is reported in Alignment::pruned_cells.
+         *
+         * @param reduction Reduction parameters
+         */
+        void set_wavefront_reduction(const WavefrontReduction &reduction);
+
+        /**
+         * Set the early termination criteria (see EarlyTermination). Disabled
+         * by default. Not applied to MSA.
+         *
+         * @param termination Termination criteria
+         */
+        void set_early_termination(const EarlyTermination &termination);
+
+        /**
+         * Set the ends-free alignment (see EndsFree). Not applied to MSA. In
+         * score-only scope only the end of the alignment is reported, and
+         * free leading bases are not supported in low memory mode (the
+         * default mode is used instead).
+         *
+         * @param ends_free Free bases at the ends of the query and the graph
+         */
+        void set_ends_free(const EndsFree &ends_free);
+
+        /**
+         * Set the banded DP fallback for divergent sequences (see
+         * DPFallback). Disabled by default. Not applied to MSA. The waves
+         * computed before the fallback are not reused, so a low
+         * score_threshold wastes less work on the sequences that fall back,
+         * and a high one sends fewer of them to the non-optimal DP.
+         *
+         * @param fallback Fallback parameters
+         */
+        void set_dp_fallback(const DPFallback &fallback);
+
+        /**
+         * Set the lockstep alignment of short queries in align_batch (see
+         * LockstepBatching). Disabled by default. Takes precedence over
+         * prefix sharing. Not applied to MSA.
+         *
+         * @param lockstep Lockstep parameters
+         */
+        void set_lockstep_batching(const LockstepBatching &lockstep);
+
+        /**
+         * Enable A* pruning with graph distance lower bounds. A cell needs a
+         * gap if the longest path ahead of it in the graph is shorter than
+         * the rest of the query, and the vertices whose cells can not reach
+         * the end within a known score bound are no longer processed (e.g.,
+         * dead-end branches). The bound is the maximum score of verify or of
+         * the early termination (see EarlyTermination), and the pruning is
+         * exact. The index with the longest remaining path of each vertex is
+         * built on the first use. Disabled by default. Not applied to MSA.
+         *
+         * @param enabled
+         */
+        void set_astar_pruning(bool enabled);
+
+        /**
+         * Set the number of worker threads used by align_batch. By default, all
+         * the hardware threads are used.
+         *
+         * @param num_threads Number of worker threads
+         */
+        void set_num_threads(int num_threads);
+
+        /**
+         * Share the computation of common prefixes in align_batch. The queries
+         * are grouped by starting position and sorted by sequence, and the
+         * wavefronts of a prefix shared by several queries (e.g., amplicon
+         * reads) are computed once: the following queries resume from a
+         * snapshot taken before the waves read the query beyond the prefix.
+         * The alignments are the same as without sharing. Not applied with A*
+         * pruning and in the low memory mode. Disabled by default.
+         *
+         * @param enabled
+         */
+        void set_prefix_sharing(bool enabled);
+
+        /**
+         * Batch alignment function. Aligns all the queries spreading them
+         * across the worker threads (see set_num_threads). Idle workers steal
+         * queries from busy ones.
+         *
+         * @param queries Queries to be aligned
+         * @return std::vector<Alignment> Alignments in the same order as the queries
+         */
+        std::vector<Alignment> align_batch(std::span<const Query> queries);
+
+        /**
+         * Batch alignment function. Same as above, but each alignment is passed
+         * to the callback (callback(query_index, alignment)) as soon as it is
+         * completed. Calls to the callback are serialized, but they may come
+         * from different threads and in any order.
+         *
+         * @param queries Queries to be aligned
+         * @param callback Completion callback
+         */
+        void align_batch(std::span<const Query> queries,
+                         const std::function<void(size_t, Alignment &)> &callback);
+
     private:
+        /**
+         * Apply the settings of the aligner to an alignment workspace.
+         *
+         * @param aligner_impl
+         */
+        void configure(TheseusAlignerImpl &aligner_impl) const;
+
+        TheseusGraph graph_;
+        Penalties penalties_;
+        int num_threads_;
+        MemoryMode memory_mode_ = MemoryMode::High;
+        AlignmentScope alignment_scope_ = AlignmentScope::Full;
+        WavefrontReduction reduction_;
+        EarlyTermination termination_;
+        EndsFree ends_free_;
+        DPFallback dp_fallback_;
+        LockstepBatching lockstep_;
+        bool astar_pruning_ = false;
+        bool prefix_sharing_ = false;
+
         std::unique_ptr<TheseusAlignerImpl> aligner_impl_;
+        std::unique_ptr<BatchAligner> batch_aligner_;   // Created on the first batch
     };
 
 } // namespace theseus
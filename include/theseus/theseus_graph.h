@@ -0,0 +1,90 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#pragma once
+
+#include <memory>
+#include <istream>
+#include <string>
+
+/**
+ * @file theseus_graph.h
+ * @brief Header file for the TheseusGraph class. A TheseusGraph is an immutable
+ * reference graph that can be shared by any number of aligners (e.g., one
+ * aligner per thread). Copies of a TheseusGraph are cheap and share the same
+ * in-memory graph.
+ *
+ */
+
+namespace theseus
+{
+
+    class CSRGraph; // Forward declaration of the internal graph class.
+
+    class TheseusGraph
+    {
+    public:
+        /**
+         * Constructor
+         *
+         * @param gfa_stream Input stream containing the graph in GFA format
+         * @param packed_sequences Store the graph sequences with 2 bits per
+         *        base (about 4x less graph memory)
+         */
+        TheseusGraph(std::istream &gfa_stream, bool packed_sequences = false);
+
+        /**
+         * Class destructor
+         *
+         */
+        ~TheseusGraph();
+
+        /**
+         * @brief Number of vertices of the graph. Each GFA segment yields two
+         * vertices, one for each orientation.
+         *
+         * @return int
+         */
+        int num_vertices() const;
+
+        /**
+         * @brief Check if a vertex (name + orientation, e.g. "s1+") exists.
+         *
+         * @param name
+         * @return bool
+         */
+        bool has_vertex(const std::string &name) const;
+
+    private:
+        friend class TheseusAligner;
+
+        std::shared_ptr<const CSRGraph> graph_;
+    };
+
+} // namespace theseus
@@ -0,0 +1,80 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include "../doctest.h"
+
+#include <string>
+#include <vector>
+#include "../../include/theseus/alignment.h"
+#include "../../include/theseus/penalties.h"
+#include "../../include/theseus/theseus_aligner.h"
+#include "test_graphs.h"
+
+
+TEST_CASE("Check banded DP fallback") {
+    SUBCASE("Hand-checked alignments through the cycle") {
+        // No alignment of score 0: everything is aligned by the DP
+        AlignerFixture fixture(cycle_gfa);
+        fixture.aligner.set_dp_fallback({0, 11});
+
+        // TAG|ACA|GGACT: mismatch G/T
+        theseus::Alignment mismatch = fixture.aligner.align("TAGACAGGACT", "1+", 3);
+        CHECK(mismatch.score == 2);
+        CHECK(mismatch.edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+        CHECK(mismatch.path == std::vector<int>{0, 2, 6});
+        CHECK(mismatch.start_offset == 3);
+        CHECK(mismatch.end_offset == 5);
+
+        // ACA|GTA[C]TT|ACT: a skipped graph base, back into 1+
+        theseus::Alignment gap = fixture.aligner.align("ACAGTATTACT", "2+", 0);
+        CHECK(gap.score == 4);
+        CHECK(gap.edit_op == std::vector<char>{'M','M','M','M','M','M','I','M','M','M','M','M'});
+        CHECK(gap.path == std::vector<int>{2, 6, 0});
+        CHECK(gap.end_offset == 3);
+    }
+
+    SUBCASE("Banded DP fallback for divergent sequences") {
+        BubbleFixture fixture(101, 30, 1000, 24);
+        const std::string &read = fixture.read;
+        theseus::TheseusAligner fallback_aligner = fixture.new_aligner();
+
+        // A band as wide as the query: the DP is exact
+        fallback_aligner.set_dp_fallback({0, (int)read.size()});
+        theseus::Alignment wavefront = fixture.aligner.align(read, "1+", 0);
+        theseus::Alignment fallback = fallback_aligner.align(read, "1+", 0);
+        CHECK(wavefront.score > 100);
+        CHECK(fallback.score == wavefront.score);
+        CHECK(fallback.query_end == read.size());
+        CHECK(query_length(fallback) == read.size());
+        CHECK(fallback.path.front() == wavefront.path.front());
+
+        // Default band, after the first scores of the wavefronts
+        fallback_aligner.set_dp_fallback({50, 64});
+        CHECK(fallback_aligner.align(read, "1+", 0).score >= wavefront.score);
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include "../doctest.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "../../include/theseus/alignment.h"
+#include "../../include/theseus/theseus_aligner.h"
+#include "test_graphs.h"
+
+
+TEST_CASE("Check batch alignment") {
+    AlignerFixture fixture(cycle_gfa);
+    auto &aligner = fixture.aligner;
+
+    std::vector<std::string> sequences = {"TAGACAGTACT", "TAGACAGGACT", "ACAGTACTTACT", "AACAGTACTTACT", "ACAGTATTACT"};
+    std::vector<int> start_offsets = {3, 3, 0, 0, 0};
+    std::vector<std::string> start_vertices = {"1+", "1+", "2+", "2+", "2+"};
+
+    // Many copies of the queries
+    std::vector<theseus::Query> queries;
+    for (int r = 0; r < 40; ++r) {
+        for (size_t i = 0; i < sequences.size(); ++i) {
+            queries.push_back({sequences[i], start_vertices[i], start_offsets[i]});
+        }
+    }
+
+    SUBCASE("Batch alignment returns the same alignments as serial alignment") {
+        std::vector<theseus::Alignment> expected;
+        for (const auto &query : queries) {
+            expected.push_back(aligner.align(query.seq, query.start_node, query.start_offset));
+        }
+
+        for (int num_threads : {1, 3}) {
+            aligner.set_num_threads(num_threads);
+
+            // Results in input order
+            std::vector<theseus::Alignment> alignments = aligner.align_batch(queries);
+            REQUIRE(alignments.size() == expected.size());
+            for (size_t i = 0; i < alignments.size(); ++i) {
+                CHECK(alignments[i].edit_op == expected[i].edit_op);
+                CHECK(alignments[i].path == expected[i].path);
+            }
+
+            // Results through the completion callback
+            std::vector<int> num_calls(queries.size(), 0);
+            aligner.align_batch(queries, [&](size_t idx, theseus::Alignment &alignment) {
+                num_calls[idx] += 1;
+                CHECK(alignment.edit_op == expected[idx].edit_op);
+            });
+            CHECK(std::count(num_calls.begin(), num_calls.end(), 1) == queries.size());
+        }
+    }
+
+    SUBCASE("Hand-checked alignments of a batch") {
+        aligner.set_num_threads(3);
+        std::vector<theseus::Alignment> alignments = aligner.align_batch(queries);
+
+        // "TAGACAGGACT" from 1+, offset 3: TAG|ACA|GGACT, mismatch G/T
+        for (size_t i = 1; i < alignments.size(); i += sequences.size()) {
+            CHECK(alignments[i].edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+            CHECK(alignments[i].path == std::vector<int>{0, 2, 6});
+            CHECK(alignments[i].start_offset == 3);
+            CHECK(alignments[i].end_offset == 5);
+            CHECK(alignments[i].score == 2);
+        }
+    }
+}
+
+
+TEST_CASE("Check prefix sharing") {
+    SUBCASE("Hand-checked alignments of reads with a common prefix") {
+        AlignerFixture fixture(cycle_gfa);
+        fixture.aligner.set_prefix_sharing(true);
+
+        // TAG|ACA|GGACT and TAG|ACA|GGACTT|ACT share the first 11 bases
+        std::vector<theseus::Query> queries = {
+            {"TAGACAGGACT", "1+", 3},
+            {"TAGACAGGACTTACT", "1+", 3},
+            {"TAGACAGGACT", "1+", 3}
+        };
+        std::vector<theseus::Alignment> alignments = fixture.aligner.align_batch(queries);
+        for (size_t q : {0, 2}) {
+            CHECK(alignments[q].edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+            CHECK(alignments[q].path == std::vector<int>{0, 2, 6});
+            CHECK(alignments[q].end_offset == 5);
+        }
+        CHECK(alignments[1].score == 2);
+        CHECK(alignments[1].edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M','M','M','M','M'});
+        CHECK(alignments[1].path == std::vector<int>{0, 2, 6, 0});
+        CHECK(alignments[1].end_offset == 3);
+    }
+
+    SUBCASE("Prefix sharing gives the same alignments as independent runs") {
+        BubbleFixture fixture(61, 30, 1000, 3);
+        auto &aligner = fixture.aligner;
+        aligner.set_num_threads(2);
+
+        // Reads with a common prefix and different suffixes
+        std::mt19937 rng(61);
+        std::vector<std::string> reads;
+        for (int r = 0; r < 12; ++r) {
+            std::string seq = fixture.read.substr(0, 700 + rng() % 300);
+            for (int e = 0; e < r % 4; ++e) {
+                seq[400 + rng() % (seq.size() - 400)] = "ACGT"[rng() % 4];
+            }
+            reads.push_back(seq);
+        }
+        std::vector<theseus::Query> queries;
+        for (const auto &seq : reads) {
+            queries.push_back({seq, "1+", 0});
+        }
+
+        std::vector<theseus::Alignment> independent = aligner.align_batch(queries);
+        aligner.set_prefix_sharing(true);
+        std::vector<theseus::Alignment> shared = aligner.align_batch(queries);
+        for (size_t q = 0; q < queries.size(); ++q) {
+            CHECK(shared[q].score == independent[q].score);
+            CHECK(shared[q].edit_op == independent[q].edit_op);
+            CHECK(shared[q].path == independent[q].path);
+            CHECK(shared[q].end_offset == independent[q].end_offset);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include "../doctest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+#include "../../theseus/lcp.h"
+
+
+TEST_CASE("Check LCP kernels") {
+    std::vector<theseus::lcp::Kernel> kernels = {
+        theseus::lcp::Kernel::Scalar,
+        theseus::lcp::Kernel::SSE2,
+        theseus::lcp::Kernel::AVX2,
+        theseus::lcp::Kernel::AVX512
+    };
+
+    SUBCASE("Correct LCP on small hand-written cases") {
+        for (auto kernel : kernels) {
+            if (!theseus::lcp::is_supported(kernel)) continue;
+            auto lcp = theseus::lcp::get_kernel(kernel);
+
+            CHECK(lcp("ACGT", "ACGT", 4) == 4);     // Full match
+            CHECK(lcp("ACGT", "ACTT", 4) == 2);     // Mismatch in the middle
+            CHECK(lcp("ACGT", "TCGT", 4) == 0);     // Mismatch at the start
+            CHECK(lcp("ACGT", "ACGA", 3) == 3);     // Bounded by max_len
+            CHECK(lcp("ACGT", "ACGT", 0) == 0);     // Empty range
+        }
+    }
+
+    SUBCASE("All kernels agree with the scalar kernel") {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> base_dist(0, 3);
+        const std::string bases = "ACGT";
+
+        // Mismatches at every position of buffers covering all block widths
+        for (int len = 1; len <= 200; ++len) {
+            std::string seq_1(len, 'A');
+            for (auto &c : seq_1) c = bases[base_dist(rng)];
+
+            for (int mism = 0; mism <= len; ++mism) {
+                std::string seq_2 = seq_1;
+                if (mism < len) seq_2[mism] = (seq_2[mism] == 'A') ? 'C' : 'A';
+
+                int expected = theseus::lcp::lcp_scalar(seq_1.data(), seq_2.data(), len);
+                CHECK(expected == mism);
+                for (auto kernel : kernels) {
+                    if (!theseus::lcp::is_supported(kernel)) continue;
+                    auto lcp = theseus::lcp::get_kernel(kernel);
+                    CHECK(lcp(seq_1.data(), seq_2.data(), len) == expected);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include "../doctest.h"
+
+#include <string>
+#include <vector>
+#include "../../include/theseus/alignment.h"
+#include "../../include/theseus/theseus_aligner.h"
+#include "test_graphs.h"
+
+
+TEST_CASE("Check lockstep batching") {
+    SUBCASE("Hand-checked alignments of a lockstep group") {
+        AlignerFixture fixture(cycle_gfa);
+        fixture.aligner.set_lockstep_batching({.enabled = true});
+
+        // Queries from 1+, offset 3 (the perfect match is aligned apart)
+        std::vector<theseus::Query> queries = {
+            {"TAGACAGGACT", "1+", 3},       // TAG|ACA|GGACT
+            {"TAGACAGGTCT", "1+", 3},       // TAG|ACA|GGTCT
+            {"TAGACAGTACT", "1+", 3},       // TAG|ACA|GTACT
+            {"TAGACAGGACTTACT", "1+", 3}    // TAG|ACA|GGACTT|ACT
+        };
+        std::vector<std::vector<char>> expected_cigars = {
+            {'M','M','M','M','M','M','M','X','M','M','M'},
+            {'M','M','M','M','M','M','M','X','X','M','M'},
+            {'M','M','M','M','M','M','M','M','M','M','M'},
+            {'M','M','M','M','M','M','M','X','M','M','M','M','M','M','M'}
+        };
+        std::vector<std::vector<int>> expected_paths = {{0, 2, 6}, {0, 2, 6}, {0, 2, 6}, {0, 2, 6, 0}};
+        std::vector<int> expected_scores = {2, 4, 0, 2};
+
+        std::vector<theseus::Alignment> alignments = fixture.aligner.align_batch(queries);
+        for (size_t q = 0; q < queries.size(); ++q) {
+            CHECK(alignments[q].score == expected_scores[q]);
+            CHECK(alignments[q].edit_op == expected_cigars[q]);
+            CHECK(alignments[q].path == expected_paths[q]);
+            CHECK(alignments[q].start_offset == 3);
+        }
+    }
+
+    BubbleFixture fixture(7, 30, 1000, 4);
+    theseus::TheseusAligner lockstep_aligner = fixture.new_aligner();
+    fixture.aligner.set_num_threads(2);
+    lockstep_aligner.set_num_threads(2);
+
+    // Prefixes of the read with a mismatch (the longest ones are aligned
+    // with the wavefronts), and some with a gap longer than the default
+    // band
+    std::vector<std::string> seqs;
+    for (int q = 0; q < 40; ++q) {
+        std::string seq = fixture.read.substr(0, 120 + 5 * q);
+        seq[(13 * q) % seq.size()] = (seq[(13 * q) % seq.size()] == 'A') ? 'C' : 'A';
+        if (q % 8 == 3) {
+            seq.erase(60, 40);
+        }
+        seqs.push_back(seq);
+    }
+    std::vector<theseus::Query> queries;
+    for (const auto &seq : seqs) {
+        queries.push_back({seq, "1+", 0});
+    }
+    std::vector<theseus::Alignment> wavefront = fixture.aligner.align_batch(queries);
+
+    SUBCASE("A band as wide as the queries gives the same alignments") {
+        lockstep_aligner.set_lockstep_batching({true, 250, 400});
+        std::vector<theseus::Alignment> lockstep = lockstep_aligner.align_batch(queries);
+        for (size_t q = 0; q < queries.size(); ++q) {
+            CHECK(lockstep[q].score == wavefront[q].score);
+            CHECK(lockstep[q].query_end == seqs[q].size());
+            CHECK(query_length(lockstep[q]) == seqs[q].size());
+            CHECK(lockstep[q].path.front() == 0);
+        }
+    }
+
+    SUBCASE("Default band: the alignments that leave it are computed again") {
+        lockstep_aligner.set_lockstep_batching({.enabled = true});
+        std::vector<theseus::Alignment> lockstep = lockstep_aligner.align_batch(queries);
+        for (size_t q = 0; q < queries.size(); ++q) {
+            CHECK(lockstep[q].score == wavefront[q].score);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include "../doctest.h"
+
+#include <random>
+#include <string>
+#include "../../theseus/lcp.h"
+#include "../../theseus/packed_sequence.h"
+
+
+TEST_CASE("Check packed sequences") {
+    SUBCASE("Packing and unpacking recovers the original sequence") {
+        std::string seq = "ACGTNACGTTTTGGGGCCCCAAAARYacgtACGTACGTACGTACGTACGTACGTAC";
+        theseus::PackedSequence packed(seq);
+
+        CHECK(packed.size() == seq.size());
+        CHECK(packed.num_exceptions() == 7);    // N, R, Y, a, c, g, t
+        CHECK(packed.substr(0, seq.size()) == seq);
+        CHECK(packed.next_exception(0) == 4);
+        CHECK(packed.next_exception(5) == 24);
+        CHECK(packed.next_exception(31) == seq.size());
+    }
+
+    SUBCASE("Packed LCP agrees with the scalar LCP") {
+        std::mt19937 rng(7);
+        const std::string alphabet = "ACGTACGTACGTACGTN";
+        std::uniform_int_distribution<int> char_dist(0, alphabet.size() - 1);
+        std::uniform_int_distribution<int> pos_dist(0, 149);
+
+        for (int test = 0; test < 500; ++test) {
+            std::string seq_1(150, 'A');
+            for (auto &c : seq_1) c = alphabet[char_dist(rng)];
+
+            // seq_2 shares a long stretch with seq_1 (unaligned in the words)
+            int pos_1 = pos_dist(rng) % 50, pos_2 = pos_dist(rng) % 50;
+            std::string seq_2(pos_2, 'C');
+            seq_2 += seq_1.substr(pos_1);
+            if (test % 2 == 0) seq_2[pos_2 + pos_dist(rng) % (150 - pos_1)] = 'G';
+
+            theseus::PackedSequence packed_1(seq_1), packed_2(seq_2);
+            int max_len = std::min(seq_1.size() - pos_1, seq_2.size() - pos_2);
+            int expected = theseus::lcp::lcp_scalar(seq_1.data() + pos_1, seq_2.data() + pos_2, max_len);
+            CHECK(theseus::packed_lcp(packed_1, pos_1, packed_2, pos_2, max_len) == expected);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include "../doctest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include "../../theseus/work_stealing_pool.h"
+
+
+TEST_CASE("Check work-stealing pool") {
+    constexpr int num_threads = 4;
+    theseus::WorkStealingPool pool(num_threads);
+    CHECK(pool.num_threads() == num_threads);
+
+    SUBCASE("Every item is processed once by a valid worker") {
+        // Items with very different costs, so that the workers steal
+        constexpr size_t num_items = 1000;
+        std::vector<std::atomic<int>> num_calls(num_items);
+        std::atomic<int> bad_workers = 0;
+        std::atomic<long> sink = 0;
+        auto task = [&](int worker_id, size_t item) {
+            bad_workers += (worker_id < 0 || worker_id >= num_threads);
+            num_calls[item] += 1;
+            long sum = 0;
+            for (size_t l = 0; l < (item % 50 == 0 ? 200000 : 100); ++l) sum += l ^ item;
+            sink += sum;
+        };
+
+        // The pool is reused between batches
+        for (int batch = 0; batch < 3; ++batch) {
+            pool.run(num_items, task);
+        }
+        CHECK(bad_workers == 0);
+        for (size_t i = 0; i < num_items; ++i) {
+            CHECK(num_calls[i] == 3);
+        }
+
+        // Empty batch
+        pool.run(0, task);
+        CHECK(num_calls[0] == 3);
+    }
+
+    SUBCASE("Exceptions of the tasks are rethrown after the batch") {
+        constexpr size_t num_items = 200;
+        std::vector<std::atomic<int>> num_calls(num_items);
+        auto task = [&](int, size_t item) {
+            num_calls[item] += 1;
+            if (item == 17) throw std::runtime_error("Failed item");
+        };
+        CHECK_THROWS_AS(pool.run(num_items, task), std::runtime_error);
+        for (size_t i = 0; i < num_items; ++i) {
+            CHECK(num_calls[i] == 1);
+        }
+
+        // The pool is still usable
+        std::atomic<int> total = 0;
+        pool.run(num_items, [&](int, size_t) { total += 1; });
+        CHECK(total == num_items);
+    }
+}
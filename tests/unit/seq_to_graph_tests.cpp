@@ -33,10 +33,19 @@
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <thread>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include "../../theseus/cell.h"
 #include "../../theseus/graph.h"
 #include "../../include/theseus/alignment.h"
 #include "../../include/theseus/penalties.h"
 #include "../../include/theseus/theseus_aligner.h"
+#include "../../include/theseus/theseus_graph.h"
+#include "../../include/theseus/theseus_msa_aligner.h"
+#include "../../theseus/theseus_aligner_impl.h"
+#include "test_graphs.h"
 
 
 TEST_CASE("Check sequence-to-graph aligner") {
@@ -65,7 +74,7 @@ TEST_CASE("Check sequence-to-graph aligner") {
 
         // Starting offsets and vertices
         std::vector<int> start_offsets = {3, 3, 0, 0, 0};
-        std::vector<std::string> start_vertices = {"1", "1", "2", "2", "2"};
+        std::vector<std::string> start_vertices = {"1+", "1+", "2+", "2+", "2+"};
 
         // Expected CIGARs
         std::vector<std::vector<char>> expected_cigars = {
@@ -78,11 +87,11 @@ TEST_CASE("Check sequence-to-graph aligner") {
 
         // Expected paths TODO: Should have names of vertices instead of internal indices
         std::vector<std::vector<int>> expected_paths = {
-            {0, 1, 3},
-            {0, 1, 3},
-            {1, 3, 0},
-            {1, 3, 0},
-            {1, 3, 0},
+            {0, 2, 6},
+            {0, 2, 6},
+            {2, 6, 0},
+            {2, 6, 0},
+            {2, 6, 0},
         };
 
         // Expected scores
@@ -104,4 +113,825 @@ TEST_CASE("Check sequence-to-graph aligner") {
             CHECK(alignment.path == expected_paths[i]); // Check path
         }
     }
-}
\ No newline at end of file
+
+    SUBCASE("Packed and plain graphs give the same alignments") {
+        // Reference graph (with non-ACGT characters)
+        std::string gfa =
+            "S\t1\tACTTAGNNACGT\n"
+            "S\t2\tACAGGATTACAGATTACAGATTACAGATTACAGATTACA\n"
+            "S\t3\tTR\n"
+            "S\t4\tGTACTTGTACGATCGATCGATCGATGCATGCATGCTAGCTAGCTAGTTTT\n"
+            "L\t1\t+\t2\t+\t0M\n"
+            "L\t1\t+\t3\t+\t0M\n"
+            "L\t2\t+\t4\t+\t0M\n"
+            "L\t3\t+\t4\t+\t0M\n"
+            "L\t4\t+\t1\t+\t0M\n";
+        std::istringstream gfa_stream(gfa), packed_gfa_stream(gfa);
+
+        std::vector<std::string> sequences = {
+            "NNACGTACAGGATTACAGATTACAGATTACAGATTACAGATTACAGTACTTGTACGATCGATCG",
+            "NNACGTACAGGATTACAGATTCAGATTACAGATTACCGATTACAGTACTTGTACGATCGATCG",
+            "NNACGTTRGTACTTGTACGATCGATCGATCGATGCATGCATGCTAGCTAGCTAGTTTTACTTAG",
+            "NNACGTTAGTACTTGTACGATCGATCGATCGATGCATGCATGCTAGCTAGCTAGTTTTACTTAG",
+        };
+
+        theseus::Penalties penalties(0, 2, 3, 1);
+        theseus::TheseusAligner aligner(penalties, gfa_stream);
+        theseus::TheseusAligner packed_aligner(penalties, packed_gfa_stream, true);
+
+        std::string start_vertex = "1+";
+        for (const auto &seq : sequences) {
+            theseus::Alignment alignment = aligner.align(seq, start_vertex, 6);
+            theseus::Alignment packed_alignment = packed_aligner.align(seq, start_vertex, 6);
+
+            CHECK(alignment.compute_affine_gap_score(penalties) == packed_alignment.compute_affine_gap_score(penalties));
+            CHECK(alignment.edit_op == packed_alignment.edit_op);
+            CHECK(alignment.path == packed_alignment.path);
+        }
+    }
+
+    SUBCASE("Several aligners share the same graph from different threads") {
+        std::istringstream gfa_stream(
+            "S\t1\tACTTAG\n"
+            "S\t2\tACA\n"
+            "S\t3\tT\n"
+            "S\t4\tGTACTT\n"
+            "L\t1\t+\t2\t+\t0M\n"
+            "L\t1\t+\t3\t+\t0M\n"
+            "L\t2\t+\t4\t+\t0M\n"
+            "L\t3\t+\t4\t+\t0M\n"
+            "L\t4\t+\t1\t+\t0M\n"
+        );
+
+        std::vector<std::string> sequences = {"TAGACAGTACT", "TAGACAGGACT", "ACAGTACTTACT", "AACAGTACTTACT", "ACAGTATTACT"};
+        std::vector<int> start_offsets = {3, 3, 0, 0, 0};
+        std::vector<std::string> start_vertices = {"1+", "1+", "2+", "2+", "2+"};
+
+        theseus::Penalties penalties(0, 2, 3, 1);
+        theseus::TheseusGraph graph(gfa_stream);   // Shared graph
+
+        // Serial reference
+        theseus::TheseusAligner serial_aligner(penalties, graph);
+        std::vector<theseus::Alignment> expected;
+        for (size_t i = 0; i < sequences.size(); ++i) {
+            expected.push_back(serial_aligner.align(sequences[i], start_vertices[i], start_offsets[i]));
+        }
+
+        // Each thread has its own aligner (workspace) on the shared graph
+        constexpr int num_threads = 4, num_rounds = 50;
+        std::vector<int> num_errors(num_threads, 0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t]() {
+                theseus::TheseusAligner aligner(penalties, graph);
+                std::vector<std::string> thread_vertices = start_vertices;
+                for (int r = 0; r < num_rounds; ++r) {
+                    for (size_t i = 0; i < sequences.size(); ++i) {
+                        theseus::Alignment alignment = aligner.align(sequences[i], thread_vertices[i], start_offsets[i]);
+                        num_errors[t] += (alignment.edit_op != expected[i].edit_op || alignment.path != expected[i].path);
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+
+        for (int t = 0; t < num_threads; ++t) {
+            CHECK(num_errors[t] == 0);
+        }
+    }
+
+}
+
+
+TEST_CASE("Check low memory alignment") {
+    SUBCASE("Hand-checked alignment split by the bidirectional search") {
+        // Linear graph and a read with a mismatch every 20 bases (score 80,
+        // above the scores aligned storing the whole backtrace)
+        std::string text = random_text(5, 800);
+        AlignerFixture fixture("S\t1\t" + text.substr(0, 400) + "\n" +
+                               "S\t2\t" + text.substr(400) + "\n" +
+                               "L\t1\t+\t2\t+\t0M\n");
+        fixture.aligner.set_memory_mode(theseus::MemoryMode::Low);
+        std::vector<char> expected_cigar;
+        std::string read = with_mismatches(text, 20, expected_cigar);
+
+        theseus::Alignment alignment = fixture.aligner.align(read, "1+", 0);
+        CHECK(alignment.score == 80);
+        CHECK(alignment.edit_op == expected_cigar);
+        CHECK(alignment.path == std::vector<int>{0, 2});
+        CHECK(alignment.start_offset == 0);
+        CHECK(alignment.end_offset == 400);
+        CHECK(!alignment.memory_fallback);
+
+        // Small alignments store the whole backtrace: TAG|ACA|GGACT
+        AlignerFixture cycle(cycle_gfa);
+        cycle.aligner.set_memory_mode(theseus::MemoryMode::Low);
+        theseus::Alignment small = cycle.aligner.align("TAGACAGGACT", "1+", 3);
+        CHECK(small.edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+        CHECK(small.path == std::vector<int>{0, 2, 6});
+        CHECK(small.end_offset == 5);
+    }
+
+    SUBCASE("Low memory mode gives optimal alignments") {
+        // Graph with a chain of bubbles and a long read with errors
+        BubbleFixture fixture(42, 80, 3000, 6);
+        theseus::TheseusAligner low_memory_aligner = fixture.new_aligner();
+        low_memory_aligner.set_memory_mode(theseus::MemoryMode::Low);
+
+        theseus::Alignment alignment = fixture.aligner.align(fixture.read, "1+", 0);
+        theseus::Alignment low_memory_alignment = low_memory_aligner.align(fixture.read, "1+", 0);
+
+        CHECK(alignment.compute_affine_gap_score(fixture.penalties) > 64);
+        CHECK(low_memory_alignment.compute_affine_gap_score(fixture.penalties) == alignment.compute_affine_gap_score(fixture.penalties));
+        CHECK(low_memory_alignment.end_offset == alignment.end_offset);
+        CHECK(low_memory_alignment.path.back() == alignment.path.back());
+        CHECK(query_length(low_memory_alignment) == fixture.read.size());
+        CHECK(!low_memory_alignment.memory_fallback);
+    }
+
+    SUBCASE("Low memory mode across a long gap") {
+        // The middle of the read is missing: the wavefronts can only meet
+        // inside the deletion
+        BubbleFixture fixture(11, 80, 3000, 0);
+        std::string read = fixture.read.substr(0, 1000) + fixture.read.substr(1600);
+        theseus::TheseusAligner low_memory_aligner = fixture.new_aligner();
+        low_memory_aligner.set_memory_mode(theseus::MemoryMode::Low);
+
+        theseus::Alignment alignment = fixture.aligner.align(read, "1+", 0);
+        theseus::Alignment low_memory_alignment = low_memory_aligner.align(read, "1+", 0);
+        CHECK(!alignment.memory_fallback);
+        CHECK(low_memory_alignment.memory_fallback);
+        CHECK(low_memory_alignment.score == alignment.score);
+        CHECK(low_memory_alignment.end_offset == alignment.end_offset);
+        CHECK(query_length(low_memory_alignment) == read.size());
+    }
+}
+
+
+TEST_CASE("Check score-only alignment") {
+    AlignerFixture fixture(cycle_gfa);
+    theseus::TheseusAligner score_aligner = fixture.new_aligner();
+    score_aligner.set_alignment_scope(theseus::AlignmentScope::ScoreOnly);
+
+    SUBCASE("Hand-checked score and end position") {
+        // TAG|ACA|GGACT: one mismatch, ending at offset 5 of 4+
+        theseus::Alignment alignment = score_aligner.align("TAGACAGGACT", "1+", 3);
+        CHECK(alignment.score == 2);
+        CHECK(alignment.edit_op.empty());
+        CHECK(alignment.path == std::vector<int>{6});
+        CHECK(alignment.end_offset == 5);
+    }
+
+    SUBCASE("Score-only alignment gives the optimal score and end position") {
+        std::vector<std::string> sequences = {"TAGACAGTACT", "TAGACAGGACT", "ACAGTACTTACT", "AACAGTACTTACT", "ACAGTATTACT"};
+        std::vector<int> start_offsets = {3, 3, 0, 0, 0};
+        std::vector<std::string> start_vertices = {"1+", "1+", "2+", "2+", "2+"};
+
+        for (size_t i = 0; i < sequences.size(); ++i) {
+            theseus::Alignment alignment = fixture.aligner.align(sequences[i], start_vertices[i], start_offsets[i]);
+            theseus::Alignment score_alignment = score_aligner.align(sequences[i], start_vertices[i], start_offsets[i]);
+
+            CHECK(score_alignment.edit_op.empty());
+            CHECK(score_alignment.score == alignment.score);
+            CHECK(score_alignment.score == alignment.compute_affine_gap_score(fixture.penalties));
+            CHECK(score_alignment.path.size() == 1);
+            CHECK(score_alignment.path.back() == alignment.path.back());
+            CHECK(score_alignment.end_offset == alignment.end_offset);
+        }
+    }
+
+    SUBCASE("Not available with a match penalty") {
+        AlignerFixture match_fixture("S\t1\tACTTAG\n", theseus::Penalties(1, 2, 3, 1));
+        CHECK_THROWS_AS(match_fixture.aligner.set_alignment_scope(theseus::AlignmentScope::ScoreOnly), std::invalid_argument);
+    }
+}
+
+
+TEST_CASE("Check wavefront reduction") {
+    SUBCASE("Hand-checked alignment with reduced wavefronts") {
+        // Isolated mismatches: the optimal alignment stays on the furthest
+        // reaching diagonal, so it survives the reduction
+        std::string text = random_text(9, 400);
+        AlignerFixture fixture("S\t1\t" + text + "\n");
+        fixture.aligner.set_wavefront_reduction({true, 10, 20});
+        std::vector<char> expected_cigar;
+        std::string read = with_mismatches(text, 20, expected_cigar);
+
+        theseus::Alignment alignment = fixture.aligner.align(read, "1+", 0);
+        CHECK(alignment.score == 40);
+        CHECK(alignment.edit_op == expected_cigar);
+        CHECK(alignment.path == std::vector<int>{0});
+        CHECK(alignment.end_offset == 400);
+        CHECK(alignment.pruned_cells > 0);
+    }
+
+    SUBCASE("Wavefront reduction bounds the work on noisy reads") {
+        BubbleFixture fixture(7, 40, 1500, 15);
+        theseus::TheseusAligner reduced_aligner = fixture.new_aligner();
+        reduced_aligner.set_wavefront_reduction({true, 10, 20});
+
+        theseus::Alignment alignment = fixture.aligner.align(fixture.read, "1+", 0);
+        theseus::Alignment reduced_alignment = reduced_aligner.align(fixture.read, "1+", 0);
+
+        CHECK(alignment.pruned_cells == 0);
+        CHECK(reduced_alignment.pruned_cells > 0);
+        CHECK(reduced_alignment.score >= alignment.score);
+        CHECK(reduced_alignment.score == reduced_alignment.compute_affine_gap_score(fixture.penalties));
+        CHECK(query_length(reduced_alignment) == fixture.read.size());
+    }
+}
+
+
+TEST_CASE("Check early termination") {
+    SUBCASE("Hand-checked partial alignment") {
+        // TAG|ACA|G matches, then the mismatch G/T exceeds the maximum score
+        AlignerFixture fixture(cycle_gfa);
+        fixture.aligner.set_early_termination({1, -1});
+        theseus::Alignment alignment = fixture.aligner.align("TAGACAGGACT", "1+", 3);
+        CHECK(alignment.status == theseus::AlignmentStatus::MaxScoreReached);
+        CHECK(alignment.score == 0);
+        CHECK(alignment.edit_op == std::vector<char>(7, 'M'));
+        CHECK(alignment.path == std::vector<int>{0, 2, 6});
+        CHECK(alignment.end_offset == 1);
+        CHECK(alignment.query_end == 7);
+    }
+
+    // The read follows the graph for 1000 bases and then is random
+    BubbleFixture fixture(11, 40, 1000, 3);
+    auto [other_gfa, garbage] = bubble_graph_and_read(12, 20, 600, 0);
+    std::string read = fixture.read + garbage;
+    auto &aligner = fixture.aligner;
+
+    SUBCASE("Early termination returns the best partial alignment") {
+        theseus::Alignment complete = aligner.align(read, "1+", 0);
+        CHECK(complete.status == theseus::AlignmentStatus::Aligned);
+        CHECK(complete.query_end == read.size());
+
+        aligner.set_early_termination({100, -1});
+        theseus::Alignment max_score = aligner.align(read, "1+", 0);
+        CHECK(max_score.status == theseus::AlignmentStatus::MaxScoreReached);
+        CHECK(max_score.score <= 100);
+        CHECK(max_score.query_end < read.size());
+        CHECK(query_length(max_score) == max_score.query_end);
+    }
+
+    SUBCASE("X-drop stops at the end of the related part") {
+        aligner.set_early_termination({-1, 30});
+        theseus::Alignment xdrop = aligner.align(read, "1+", 0);
+        CHECK(xdrop.status == theseus::AlignmentStatus::XDropped);
+        CHECK(xdrop.query_end > 900);
+        CHECK(xdrop.query_end < 1100);
+        CHECK(query_length(xdrop) == xdrop.query_end);
+
+        aligner.set_memory_mode(theseus::MemoryMode::Low);
+        theseus::Alignment low_memory_xdrop = aligner.align(read, "1+", 0);
+        CHECK(low_memory_xdrop.status == theseus::AlignmentStatus::XDropped);
+        CHECK(low_memory_xdrop.query_end == xdrop.query_end);
+        CHECK(low_memory_xdrop.score == xdrop.score);
+    }
+}
+
+
+TEST_CASE("Check ends-free alignment") {
+    SUBCASE("Hand-checked free ends") {
+        AlignerFixture fixture(cycle_gfa);
+        auto &aligner = fixture.aligner;
+
+        // Leading query bases: CC|TAG|ACA|GTACT
+        aligner.set_ends_free({2, 0, 0});
+        theseus::Alignment leading = aligner.align("CCTAGACAGTACT", "1+", 3);
+        CHECK(leading.score == 0);
+        CHECK(leading.edit_op == std::vector<char>(11, 'M'));
+        CHECK(leading.path == std::vector<int>{0, 2, 6});
+        CHECK(leading.query_start == 2);
+        CHECK(leading.query_end == 13);
+
+        // Trailing query bases: TAG|ACA|GTACT|GG
+        aligner.set_ends_free({0, 2, 0});
+        theseus::Alignment trailing = aligner.align("TAGACAGTACTGG", "1+", 3);
+        CHECK(trailing.score == 0);
+        CHECK(trailing.edit_op == std::vector<char>(11, 'M'));
+        CHECK(trailing.query_start == 0);
+        CHECK(trailing.query_end == 11);
+
+        // Leading graph bases: the alignment starts at AG|ACA|GGACT
+        aligner.set_ends_free({0, 0, 1});
+        theseus::Alignment graph_begin = aligner.align("AGACAGGACT", "1+", 3);
+        CHECK(graph_begin.score == 2);
+        CHECK(graph_begin.edit_op == std::vector<char>{'M','M','M','M','M','M','X','M','M','M'});
+        CHECK(graph_begin.path == std::vector<int>{0, 2, 6});
+        CHECK(graph_begin.start_offset == 4);
+    }
+
+    SUBCASE("Ends-free alignment skips the free ends without penalty") {
+        BubbleFixture fixture(21, 20, 600, 0);
+        auto [other_gfa, junk] = bubble_graph_and_read(22, 1, 40, 0);
+        const std::string &read = fixture.read;
+        auto &aligner = fixture.aligner;
+
+        // Junk at both ends of the query
+        std::string clipped_read = junk.substr(0, 20) + read + junk.substr(20, 20);
+        theseus::Alignment global = aligner.align(clipped_read, "1+", 0);
+        CHECK(global.score > 0);
+
+        aligner.set_ends_free({30, 30, 0});
+        theseus::Alignment ends_free = aligner.align(clipped_read, "1+", 0);
+        CHECK(ends_free.score == 0);
+        CHECK(ends_free.query_start <= 20);
+        CHECK(ends_free.query_end >= 20 + read.size());
+        CHECK(query_length(ends_free) == ends_free.query_end - ends_free.query_start);
+
+        // Read starting 15 bases after the starting position
+        aligner.set_ends_free({0, 0, 20});
+        theseus::Alignment graph_free = aligner.align(read.substr(15), "1+", 0);
+        CHECK(graph_free.score == 0);
+        CHECK(graph_free.start_offset == 15);
+        CHECK(graph_free.query_start == 0);
+
+        // Free trailing bases in low memory mode
+        aligner.set_ends_free({0, 30, 0});
+        theseus::Alignment trailing = aligner.align(read + junk.substr(0, 20), "1+", 0);
+        aligner.set_memory_mode(theseus::MemoryMode::Low);
+        theseus::Alignment low_memory_trailing = aligner.align(read + junk.substr(0, 20), "1+", 0);
+        CHECK(trailing.score == 0);
+        CHECK(low_memory_trailing.score == trailing.score);
+        CHECK(low_memory_trailing.query_end == trailing.query_end);
+    }
+}
+
+
+TEST_CASE("Check extension from an anchor") {
+    SUBCASE("Hand-checked extension") {
+        // Anchor at the last base of 2+: TAG|AC[A]|GGACT
+        AlignerFixture fixture(cycle_gfa);
+        theseus::Alignment extension = fixture.aligner.extend("TAGACAGGACT", 5, "2+", 2);
+        CHECK(extension.score == 2);
+        CHECK(extension.edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+        CHECK(extension.path == std::vector<int>{0, 2, 6});
+        CHECK(extension.start_offset == 3);
+        CHECK(extension.end_offset == 5);
+        CHECK(extension.query_start == 0);
+        CHECK(extension.query_end == 11);
+    }
+
+    SUBCASE("Extension from an interior anchor") {
+        BubbleFixture fixture(31, 20, 800, 0);
+        const std::string &read = fixture.read;
+
+        // Graph position of the 500th base of the read (see bubble_graph_and_read)
+        int query_pos = 500, pos = query_pos, bubble = 0;
+        std::string anchor_node;
+        while (anchor_node.empty()) {
+            int alt_length = (bubble % 2) ? 3 : 4;
+            if (pos < 40) anchor_node = std::to_string(3 * bubble + 1) + "+";
+            else if (pos < 40 + alt_length) {
+                anchor_node = std::to_string(3 * bubble + ((bubble % 2) ? 2 : 3)) + "+";
+                pos -= 40;
+            }
+            else {
+                pos -= 40 + alt_length;
+                bubble += 1;
+            }
+        }
+
+        theseus::Alignment forward = fixture.aligner.align(read, "1+", 0);
+        theseus::Alignment extension = fixture.aligner.extend(read, query_pos, anchor_node, pos);
+        CHECK(extension.score == 0);
+        CHECK(extension.path == forward.path);
+        CHECK(extension.edit_op == forward.edit_op);
+        CHECK(extension.start_offset == 0);
+        CHECK(extension.end_offset == forward.end_offset);
+        CHECK(extension.query_start == 0);
+        CHECK(extension.query_end == read.size());
+
+        // Anchors at the ends of the read
+        theseus::Alignment first_base = fixture.aligner.extend(read, 0, "1+", 0);
+        CHECK(first_base.path == forward.path);
+        CHECK(first_base.edit_op == forward.edit_op);
+    }
+}
+
+
+TEST_CASE("Check bounded verification") {
+    SUBCASE("Hand-checked scores") {
+        AlignerFixture fixture(cycle_gfa);
+        auto &aligner = fixture.aligner;
+
+        // One mismatch (score 2) and one extra query base (score 4)
+        CHECK(aligner.verify("TAGACAGGACT", "1+", 3, 2) == 2);
+        CHECK(aligner.verify("TAGACAGGACT", "1+", 3, 5) == 2);
+        CHECK(aligner.verify("TAGACAGGACT", "1+", 3, 1) == std::nullopt);
+        CHECK(aligner.verify("AACAGTACTTACT", "2+", 0, 4) == 4);
+        CHECK(aligner.verify("AACAGTACTTACT", "2+", 0, 3) == std::nullopt);
+    }
+
+    SUBCASE("Bounded verification") {
+        BubbleFixture fixture(41, 40, 1500, 3);
+        const std::string &read = fixture.read;
+        auto &aligner = fixture.aligner;
+
+        int score = aligner.align(read, "1+", 0).score;
+        CHECK(aligner.verify(read, "1+", 0, score) == score);
+        CHECK(aligner.verify(read, "1+", 0, score + 10) == score);
+        CHECK(aligner.verify(read, "1+", 0, score - 1) == std::nullopt);
+
+        AlignerFixture match_fixture(fixture.gfa, theseus::Penalties(1, 2, 3, 1));
+        CHECK_THROWS_AS(match_fixture.aligner.verify(read, "1+", 0, score), std::invalid_argument);
+    }
+}
+
+
+TEST_CASE("Check A* pruning") {
+    SUBCASE("Hand-checked alignment next to a dead-end branch") {
+        // ACGTAC -> GG (dead end)
+        //        -> TTGCA
+        AlignerFixture fixture("S\t1\tACGTAC\n"
+                               "S\t2\tGG\n"
+                               "S\t3\tTTGCA\n"
+                               "L\t1\t+\t2\t+\t0M\n"
+                               "L\t1\t+\t3\t+\t0M\n");
+        fixture.aligner.set_astar_pruning(true);
+
+        // ACGTAC|TAGCA: mismatch A/T
+        theseus::Alignment alignment = fixture.aligner.align("ACGTACTAGCA", "1+", 0);
+        CHECK(alignment.score == 2);
+        CHECK(alignment.edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+        CHECK(alignment.path == std::vector<int>{0, 4});
+        CHECK(alignment.end_offset == 5);
+        CHECK(fixture.aligner.verify("ACGTACTAGCA", "1+", 0, 1) == std::nullopt);
+    }
+
+    SUBCASE("A* pruning with graph distance lower bounds is exact") {
+        // Chain of segments, each one with a dead-end branch
+        std::mt19937 rng(3);
+        const std::string bases = "ACGT";
+        std::string gfa, read;
+        for (int b = 0; b < 100; ++b) {
+            std::string seg, tip;
+            for (int l = 0; l < 10; ++l) seg += bases[rng() % 4];
+            for (int l = 0; l < 5; ++l) tip += bases[rng() % 4];
+            int id = 2 * b + 1;
+            gfa += "S\t" + std::to_string(id) + "\t" + seg + "\n";
+            gfa += "S\t" + std::to_string(id + 1) + "\t" + tip + "\n";
+            gfa += "L\t" + std::to_string(id) + "\t+\t" + std::to_string(id + 1) + "\t+\t0M\n";
+            if (b + 1 < 100) {
+                gfa += "L\t" + std::to_string(id) + "\t+\t" + std::to_string(id + 2) + "\t+\t0M\n";
+            }
+            read += (b % 10 == 5) ? seg.substr(0, 8) + "A" : seg;  // Some edits
+        }
+
+        AlignerFixture fixture(gfa);
+        auto &aligner = fixture.aligner;
+        int score = aligner.align(read, "1+", 0).score;
+
+        aligner.set_astar_pruning(true);
+        CHECK(aligner.verify(read, "1+", 0, score) == score);
+        CHECK(aligner.verify(read, "1+", 0, score + 5) == score);
+        CHECK(aligner.verify(read, "1+", 0, score - 1) == std::nullopt);
+
+        aligner.set_early_termination({score, -1});
+        theseus::Alignment alignment = aligner.align(read, "1+", 0);
+        CHECK(alignment.status == theseus::AlignmentStatus::Aligned);
+        CHECK(alignment.score == score);
+    }
+}
+
+
+TEST_CASE("Check multi-source alignment") {
+    SUBCASE("Hand-checked best start") {
+        // Only 1+, offset 3 gives TAG|ACA|GGACT (one mismatch)
+        AlignerFixture fixture(cycle_gfa);
+        std::vector<theseus::StartPosition> starts = {{"2+", 0}, {"1+", 3}, {"4+", 2}};
+        theseus::Alignment alignment = fixture.aligner.align("TAGACAGGACT", starts);
+        CHECK(alignment.start_index == 1);
+        CHECK(alignment.score == 2);
+        CHECK(alignment.edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+        CHECK(alignment.path == std::vector<int>{0, 2, 6});
+        CHECK(alignment.start_offset == 3);
+    }
+
+    SUBCASE("Multi-source alignment picks the best starting position") {
+        BubbleFixture fixture(51, 40, 1000, 3);
+        const std::string &read = fixture.read;
+        auto &aligner = fixture.aligner;
+
+        theseus::Alignment single = aligner.align(read, "1+", 0);
+        std::vector<theseus::StartPosition> starts = {{"4+", 10}, {"1+", 6}, {"1+", 0}, {"7+", 0}};
+        theseus::Alignment multi = aligner.align(read, starts);
+        CHECK(multi.start_index == 2);
+        CHECK(multi.score == single.score);
+        CHECK(multi.start_offset == 0);
+        CHECK(multi.path.front() == single.path.front());
+        CHECK(multi.end_offset == single.end_offset);
+
+        aligner.set_alignment_scope(theseus::AlignmentScope::ScoreOnly);
+        theseus::Alignment score_only = aligner.align(read, starts);
+        CHECK(score_only.score == single.score);
+        CHECK(score_only.start_index == -1);
+    }
+}
+
+
+TEST_CASE("Check exact match search") {
+    SUBCASE("Hand-checked exact matches") {
+        AlignerFixture fixture(cycle_gfa);
+
+        // TAG|ACA|GTACT
+        theseus::Alignment alignment = fixture.aligner.align("TAGACAGTACT", "1+", 3);
+        CHECK(alignment.score == 0);
+        CHECK(alignment.edit_op == std::vector<char>(11, 'M'));
+        CHECK(alignment.path == std::vector<int>{0, 2, 6});
+        CHECK(alignment.start_offset == 3);
+        CHECK(alignment.end_offset == 5);
+
+        // ACA|GTACTT|ACT, through the cycle
+        theseus::Alignment cycle = fixture.aligner.align("ACAGTACTTACT", "2+", 0);
+        CHECK(cycle.edit_op == std::vector<char>(12, 'M'));
+        CHECK(cycle.path == std::vector<int>{2, 6, 0});
+        CHECK(cycle.end_offset == 3);
+    }
+
+    SUBCASE("Exact matches are found before the wavefronts") {
+        BubbleFixture fixture(71, 30, 800, 0);
+        const std::string &read = fixture.read;
+        auto &aligner = fixture.aligner;
+
+        theseus::Alignment alignment = aligner.align(read.substr(5), "1+", 5);
+        CHECK(alignment.score == 0);
+        CHECK(alignment.status == theseus::AlignmentStatus::Aligned);
+        CHECK(alignment.edit_op == std::vector<char>(read.size() - 5, 'M'));
+        CHECK(alignment.start_offset == 5);
+        CHECK(alignment.query_end == read.size() - 5);
+
+        // One mismatch at the end: aligned with the wavefronts
+        std::string mismatch = read;
+        mismatch.back() = (mismatch.back() == 'A') ? 'C' : 'A';
+        theseus::Alignment wavefront = aligner.align(mismatch, "1+", 0);
+        CHECK(wavefront.score == fixture.penalties.mism());
+        CHECK(wavefront.path == alignment.path);
+    }
+
+    SUBCASE("Dead branches do not exhaust the search on long reads") {
+        // A perfect read through 100 bubbles: the wrong allele of each one
+        // is a dead end, searched before or after the right one. With a
+        // reduction that prunes every cell behind the
+        // furthest one, the wavefronts would report pruned cells, so none
+        // means that the exact match search aligned the read.
+        BubbleFixture fixture(73, 100, 5000, 0);
+        fixture.aligner.set_wavefront_reduction({true, 1, 0});
+        theseus::Alignment alignment = fixture.aligner.align(fixture.read, "1+", 0);
+        CHECK(alignment.score == 0);
+        CHECK(alignment.edit_op == std::vector<char>(fixture.read.size(), 'M'));
+        CHECK(alignment.path.size() == 200);
+        CHECK(alignment.pruned_cells == 0);
+
+        // The same read through the wavefronts
+        std::string mismatch = fixture.read;
+        mismatch.back() = (mismatch.back() == 'A') ? 'C' : 'A';
+        CHECK(fixture.aligner.align(mismatch, "1+", 0).pruned_cells > 0);
+    }
+}
+
+
+TEST_CASE("Check single vertex alignment") {
+    SUBCASE("Hand-checked alignments") {
+        AlignerFixture fixture("S\t1\tACGTACGTTT\n");
+
+        // ACGT[A]CGTTT: the graph base A is skipped
+        theseus::Alignment gap = fixture.aligner.align("ACGTCGTTT", "1+", 0);
+        CHECK(gap.score == 4);
+        CHECK(gap.edit_op == std::vector<char>{'M','M','M','M','I','M','M','M','M','M'});
+        CHECK(gap.path == std::vector<int>{0});
+        CHECK(gap.end_offset == 10);
+
+        // GT|A/T|CGT from offset 2
+        theseus::Alignment mismatch = fixture.aligner.align("GTTCGT", "1+", 2);
+        CHECK(mismatch.score == 2);
+        CHECK(mismatch.edit_op == std::vector<char>{'M','M','X','M','M','M'});
+        CHECK(mismatch.start_offset == 2);
+        CHECK(mismatch.end_offset == 8);
+    }
+
+    SUBCASE("Single vertex alignments give the same score as on a linear graph") {
+        std::mt19937 rng(29);
+        std::string text;
+        for (int l = 0; l < 600; ++l) {
+            text += "ACGT"[rng() % 4];
+        }
+        std::string read = text.substr(20, 500);
+        for (int e = 0; e < 12; ++e) {
+            int pos = rng() % read.size();
+            if (e % 3 == 0) read[pos] = "ACGT"[rng() % 4];
+            else if (e % 3 == 1) read.erase(pos, 1 + e % 2);
+            else read.insert(pos, "GA");
+        }
+
+        AlignerFixture single("S\t1\t" + text + "\n");
+        AlignerFixture linear("S\t1\t" + text.substr(0, 300) + "\n" +
+                              "S\t2\t" + text.substr(300) + "\n" +
+                              "L\t1\t+\t2\t+\t0M\n");
+
+        theseus::Alignment pairwise = single.aligner.align(read, "1+", 20);
+        theseus::Alignment graph = linear.aligner.align(read, "1+", 20);
+        CHECK(pairwise.score == graph.score);
+        CHECK(pairwise.start_offset == 20);
+        CHECK(pairwise.query_end == read.size());
+
+        // The graph engine on the same vertex (low memory mode)
+        single.aligner.set_memory_mode(theseus::MemoryMode::Low);
+        CHECK(single.aligner.align(read, "1+", 20).score == pairwise.score);
+    }
+}
+
+
+TEST_CASE("Check linear gap penalties") {
+    SUBCASE("Hand-checked alignment") {
+        // ACA|GTA[C]TT|ACT: a skipped graph base costs 2, less than a
+        // mismatch
+        AlignerFixture fixture(cycle_gfa, theseus::Penalties(0, 3, 2));
+        theseus::Alignment alignment = fixture.aligner.align("ACAGTATTACT", "2+", 0);
+        CHECK(alignment.score == 2);
+        CHECK(alignment.edit_op == std::vector<char>{'M','M','M','M','M','M','I','M','M','M','M','M'});
+        CHECK(alignment.path == std::vector<int>{2, 6, 0});
+        CHECK(alignment.end_offset == 3);
+    }
+
+    SUBCASE("Linear gap penalties") {
+        BubbleFixture fixture(83, 20, 700, 6, theseus::Penalties(0, 3, 2));
+        const auto &penalties = fixture.penalties;
+        auto &aligner = fixture.aligner;
+
+        theseus::Alignment alignment = aligner.align(fixture.read, "1+", 0);
+        int score = 0;
+        for (char op : alignment.edit_op) {
+            score += (op == 'X') ? penalties.mism() : (op == 'I' || op == 'D') ? penalties.gape() : 0;
+        }
+        CHECK(alignment.score > 0);
+        CHECK(alignment.score == score);
+
+        aligner.set_memory_mode(theseus::MemoryMode::Low);
+        CHECK(aligner.align(fixture.read, "1+", 0).score == alignment.score);
+    }
+}
+
+
+TEST_CASE("Check dual affine gap penalties") {
+    SUBCASE("Hand-checked long gap across an edge") {
+        // The 20 bases in brackets are missing from the read
+        //      1+ ACGTTGCATC[TCTGCGTGCG -> 2+ AACGCAGCGT]CGATTC...
+        std::string prefix = "ACGTTGCATC", skipped = "TCTGCGTGCGAACGCAGCGT";
+        std::string suffix = "CGATTCAAATGACGGCAGCAGGCCGGGAGTCCCTGAGAGGCTTGTTCCGGAAATGTGCCA";
+        std::string gfa = "S\t1\t" + prefix + skipped.substr(0, 10) + "\n" +
+                          "S\t2\t" + skipped.substr(10) + suffix + "\n" +
+                          "L\t1\t+\t2\t+\t0M\n";
+        std::string read = prefix + suffix;
+        std::vector<char> expected_cigar(10, 'M');
+        expected_cigar.insert(expected_cigar.end(), 20, 'I');
+        expected_cigar.insert(expected_cigar.end(), 60, 'M');
+
+        // 24 + 20 * 1 with the second piece, instead of 6 + 20 * 2
+        AlignerFixture affine(gfa, theseus::Penalties(0, 4, 6, 2));
+        AlignerFixture dual(gfa, theseus::Penalties(0, 4, 6, 2, 24, 1));
+        theseus::Alignment affine_alignment = affine.aligner.align(read, "1+", 0);
+        theseus::Alignment dual_alignment = dual.aligner.align(read, "1+", 0);
+        CHECK(affine_alignment.score == 46);
+        CHECK(dual_alignment.score == 44);
+        CHECK(dual_alignment.edit_op == expected_cigar);
+        CHECK(affine_alignment.edit_op == expected_cigar);
+        CHECK(dual_alignment.path == std::vector<int>{0, 2});
+        CHECK(dual_alignment.end_offset == 70);
+    }
+
+    SUBCASE("Dual affine gap penalties") {
+        std::mt19937 rng(31);
+        std::string text;
+        for (int l = 0; l < 400; ++l) {
+            text += "ACGT"[rng() % 4];
+        }
+        std::string gfa = "S\t1\t" + text.substr(0, 200) + "\n" +
+                          "S\t2\t" + text.substr(200) + "\n" +
+                          "L\t1\t+\t2\t+\t0M\n";
+
+        // A long deletion across the edge and a long insertion
+        std::string read = text.substr(0, 180) + text.substr(220, 60) + std::string(30, 'T') + text.substr(280, 80);
+
+        AlignerFixture affine(gfa, theseus::Penalties(0, 4, 6, 2));
+        AlignerFixture dual(gfa, theseus::Penalties(0, 4, 6, 2, 24, 1));
+
+        theseus::Alignment affine_alignment = affine.aligner.align(read, "1+", 0);
+        theseus::Alignment dual_alignment = dual.aligner.align(read, "1+", 0);
+        CHECK(dual_alignment.score < affine_alignment.score);
+        CHECK(dual_alignment.score == dual_alignment.compute_affine_gap_score(dual.penalties));
+        CHECK(dual_alignment.score <= 2 * 24 + 40 + 30);
+
+        dual.aligner.set_memory_mode(theseus::MemoryMode::Low);
+        CHECK(dual.aligner.align(read, "1+", 0).score == dual_alignment.score);
+    }
+}
+
+
+/**
+ * @brief Lowers the number of cells that the backtrace can reference (in
+ * all the aligners) while in scope.
+ *
+ */
+struct BacktraceLimit {
+    explicit BacktraceLimit(int limit) {
+        theseus::TheseusAlignerImpl::backtrace_pos_limit = limit;
+    }
+    ~BacktraceLimit() {
+        theseus::TheseusAlignerImpl::backtrace_pos_limit = theseus::Cell::max_pos;
+    }
+};
+
+
+TEST_CASE("Check backtrace overflow") {
+    SUBCASE("Packed backtrace cells") {
+        using theseus::Cell;
+        static_assert(sizeof(Cell) == 16);
+
+        // Start cells (negative positions) and the largest positions keep
+        // their matrix
+        auto packed = [](const Cell &cell) {
+            return std::pair<int, Cell::Matrix>(cell.prev_pos, cell.from_matrix);
+        };
+        Cell cell{-1, Cell::Matrix::D2, 3, 4, 5};
+        CHECK(packed(cell) == std::pair<int, Cell::Matrix>(-1, Cell::Matrix::D2));
+        cell.prev_pos = Cell::max_pos;
+        CHECK(packed(cell) == std::pair<int, Cell::Matrix>(Cell::max_pos, Cell::Matrix::D2));
+        cell.prev_pos = -1 - Cell::max_pos;
+        cell.from_matrix = Cell::Matrix::I2Jumps;
+        CHECK(packed(cell) == std::pair<int, Cell::Matrix>(-1 - Cell::max_pos, Cell::Matrix::I2Jumps));
+        CHECK(cell.vertex_id == 3);
+        CHECK(cell.offset == 4);
+        CHECK(cell.diag == 5);
+    }
+
+    // A read whose backtrace does not fit in 30000 cells (but the parts
+    // aligned storing the backtrace in low memory mode do)
+    BubbleFixture fixture(42, 80, 3000, 6);
+    const std::string &read = fixture.read;
+    auto &aligner = fixture.aligner;
+    theseus::Alignment optimal = aligner.align(read, "1+", 0);
+
+    SUBCASE("Single start: computed again in low memory mode") {
+        BacktraceLimit limit(30000);
+        theseus::Alignment alignment = aligner.align(read, "1+", 0);
+        CHECK(alignment.memory_fallback);
+        CHECK(alignment.score == optimal.score);
+        CHECK(alignment.end_offset == optimal.end_offset);
+        CHECK(alignment.path.back() == optimal.path.back());
+        CHECK(query_length(alignment) == read.size());
+
+        // Small alignments still fit: TAG|ACA|GGACT
+        AlignerFixture cycle(cycle_gfa);
+        theseus::Alignment small = cycle.aligner.align("TAGACAGGACT", "1+", 3);
+        CHECK(!small.memory_fallback);
+        CHECK(small.edit_op == std::vector<char>{'M','M','M','M','M','M','M','X','M','M','M'});
+        CHECK(small.path == std::vector<int>{0, 2, 6});
+    }
+
+    SUBCASE("Multiple starts: each one is aligned on its own") {
+        std::vector<theseus::StartPosition> starts = {{"4+", 10}, {"1+", 0}, {"7+", 0}};
+        BacktraceLimit limit(30000);
+        theseus::Alignment alignment = aligner.align(read, starts);
+        CHECK(alignment.memory_fallback);
+        CHECK(alignment.start_index == 1);
+        CHECK(alignment.start_offset == 0);
+        CHECK(alignment.score == optimal.score);
+        CHECK(query_length(alignment) == read.size());
+    }
+
+    SUBCASE("Without low memory mode: banded DP, maybe not optimal") {
+        // Free leading graph bases are not supported by the low memory mode.
+        // A band narrower than the missing bases of the read can not follow
+        // the optimal alignment, so the alignment is worse, and only
+        // memory_fallback tells them apart.
+        std::string gapped = read.substr(0, 1500) + read.substr(1560);
+        aligner.set_ends_free({0, 0, 1});
+        aligner.set_dp_fallback({-1, 16});
+        theseus::Alignment ends_free = aligner.align(gapped, "1+", 0);
+        CHECK(!ends_free.memory_fallback);
+
+        BacktraceLimit limit(30000);
+        theseus::Alignment alignment = aligner.align(gapped, "1+", 0);
+        CHECK(alignment.memory_fallback);
+        CHECK(alignment.status == theseus::AlignmentStatus::Aligned);
+        CHECK(alignment.score > ends_free.score);
+        CHECK(alignment.score == alignment.compute_affine_gap_score(fixture.penalties));
+        CHECK(query_length(alignment) == gapped.size());
+    }
+
+    SUBCASE("MSA: the alignment throws") {
+        theseus::TheseusMSA msa(fixture.penalties, read.substr(0, 400));
+        std::string seq = read.substr(0, 400);
+        for (size_t pos = 10; pos < seq.size(); pos += 20) {
+            seq.erase(pos, 1);
+        }
+
+        BacktraceLimit limit(10);
+        CHECK_THROWS_WITH_AS(msa.align(seq),
+                             "The backtrace of the alignment does not fit in the cell positions.",
+                             std::length_error);
+    }
+}
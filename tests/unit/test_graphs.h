@@ -0,0 +1,183 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../../include/theseus/alignment.h"
+#include "../../include/theseus/penalties.h"
+#include "../../include/theseus/theseus_aligner.h"
+#include "../../include/theseus/theseus_graph.h"
+
+
+/**
+ * @brief Small graph with a cycle, used for the hand-checked alignments. The
+ * internal vertex ids (those of Alignment::path) are 0 (1+), 2 (2+), 4 (3+)
+ * and 6 (4+).
+ *
+ *      1+ ACTTAG -> 2+ ACA -> 4+ GTACTT -> 1+
+ *               \-> 3+ T  -/
+ *
+ */
+inline const std::string cycle_gfa =
+    "S\t1\tACTTAG\n"
+    "S\t2\tACA\n"
+    "S\t3\tT\n"
+    "S\t4\tGTACTT\n"
+    "L\t1\t+\t2\t+\t0M\n"
+    "L\t1\t+\t3\t+\t0M\n"
+    "L\t2\t+\t4\t+\t0M\n"
+    "L\t3\t+\t4\t+\t0M\n"
+    "L\t4\t+\t1\t+\t0M\n";
+
+/**
+ * @brief Random graph made of a chain of bubbles (in GFA format) and a read
+ * sampled from it (starting at vertex "1+", offset 0) with random errors.
+ *
+ */
+inline std::pair<std::string, std::string> bubble_graph_and_read(int seed,
+                                                                 int num_bubbles,
+                                                                 int read_length,
+                                                                 int error_percentage) {
+    std::mt19937 rng(seed);
+    const std::string bases = "ACGT";
+    auto random_seq = [&](int len) {
+        std::string seq;
+        for (int l = 0; l < len; ++l) seq += bases[rng() % 4];
+        return seq;
+    };
+
+    std::string gfa, text;
+    for (int b = 0; b < num_bubbles; ++b) {
+        std::string seg = random_seq(40), alt1 = random_seq(3), alt2 = random_seq(4);
+        int id = 3 * b + 1;
+        gfa += "S\t" + std::to_string(id) + "\t" + seg + "\n";
+        gfa += "S\t" + std::to_string(id + 1) + "\t" + alt1 + "\n";
+        gfa += "S\t" + std::to_string(id + 2) + "\t" + alt2 + "\n";
+        gfa += "L\t" + std::to_string(id) + "\t+\t" + std::to_string(id + 1) + "\t+\t0M\n";
+        gfa += "L\t" + std::to_string(id) + "\t+\t" + std::to_string(id + 2) + "\t+\t0M\n";
+        if (b + 1 < num_bubbles) {
+            gfa += "L\t" + std::to_string(id + 1) + "\t+\t" + std::to_string(id + 3) + "\t+\t0M\n";
+            gfa += "L\t" + std::to_string(id + 2) + "\t+\t" + std::to_string(id + 3) + "\t+\t0M\n";
+        }
+        text += seg + ((b % 2) ? alt1 : alt2);
+    }
+
+    // Errors: a third of mismatches, deletions and insertions
+    std::string read;
+    int error_third = error_percentage / 3;
+    for (char c : text.substr(0, read_length)) {
+        int x = rng() % 100;
+        if (x < error_third) read += bases[rng() % 4];                      // Mismatch (or match)
+        else if (x < 2 * error_third) continue;                             // Deletion
+        else if (x < 3 * error_third) read += std::string(1, c) + "A";      // Insertion
+        else read += c;
+    }
+    return {gfa, read};
+}
+
+/**
+ * @brief Random sequence of the given length.
+ *
+ */
+inline std::string random_text(int seed, int length) {
+    std::mt19937 rng(seed);
+    std::string text;
+    for (int l = 0; l < length; ++l) {
+        text += "ACGT"[rng() % 4];
+    }
+    return text;
+}
+
+/**
+ * @brief Copy of text with a mismatch every "spacing" bases (starting at
+ * spacing / 2). The expected CIGAR is returned in cigar.
+ *
+ */
+inline std::string with_mismatches(const std::string &text, int spacing, std::vector<char> &cigar) {
+    std::string read = text;
+    cigar.assign(text.size(), 'M');
+    for (size_t pos = spacing / 2; pos < read.size(); pos += spacing) {
+        read[pos] = (read[pos] == 'A') ? 'C' : 'A';
+        cigar[pos] = 'X';
+    }
+    return read;
+}
+
+/**
+ * @brief Number of query bases covered by an alignment.
+ *
+ */
+inline int query_length(const theseus::Alignment &alignment) {
+    return std::count_if(alignment.edit_op.begin(), alignment.edit_op.end(),
+                         [](char op) { return op != 'I'; });
+}
+
+/**
+ * @brief Graph and aligner shared by the checks of a test case.
+ *
+ */
+struct AlignerFixture {
+    explicit AlignerFixture(const std::string &gfa,
+                            const theseus::Penalties &penalties = theseus::Penalties(0, 2, 3, 1))
+        : penalties(penalties), gfa(gfa), gfa_stream(gfa), graph(gfa_stream), aligner(penalties, graph) {}
+
+    // Another aligner (with its own settings) on the same graph
+    theseus::TheseusAligner new_aligner() const {
+        return theseus::TheseusAligner(penalties, graph);
+    }
+
+    theseus::Penalties penalties;
+    std::string gfa;
+    std::istringstream gfa_stream;
+    theseus::TheseusGraph graph;
+    theseus::TheseusAligner aligner;
+};
+
+/**
+ * @brief Fixture on a chain of bubbles (see bubble_graph_and_read).
+ *
+ */
+struct BubbleFixture : AlignerFixture {
+    BubbleFixture(int seed,
+                  int num_bubbles,
+                  int read_length,
+                  int error_percentage,
+                  const theseus::Penalties &penalties = theseus::Penalties(0, 2, 3, 1))
+        : BubbleFixture(bubble_graph_and_read(seed, num_bubbles, read_length, error_percentage), penalties) {}
+
+    std::string read;
+
+private:
+    BubbleFixture(std::pair<std::string, std::string> graph_and_read, const theseus::Penalties &penalties)
+        : AlignerFixture(graph_and_read.first, penalties), read(std::move(graph_and_read.second)) {}
+};
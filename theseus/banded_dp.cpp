@@ -0,0 +1,450 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <algorithm>
+#include <queue>
+#include <string>
+
+#include "banded_dp.h"
+
+namespace theseus {
+
+void BandedDP::align(std::string_view seq,
+                     int start_vertex,
+                     int start_col,
+                     int band,
+                     const EndsFree &ends_free,
+                     Alignment &alignment) {
+
+  const int m = seq.size();
+  _seq = seq;
+  _band = std::max(band, 0);
+  _width = std::min(2 * _band + 1, m + 1);
+  _end_row = m - std::clamp(ends_free.query_end, 0, m);
+  _end_score = inf;
+
+  for (auto *column : {&_h, &_i, &_d, &_i2, &_d2, &_prev_h, &_prev_i, &_prev_i2}) {
+    column->assign(_width, inf);
+  }
+  _entries.clear();
+  _los.clear();
+  _trace.clear();
+  _prov.clear();
+  _region.build(*_graph, start_vertex, start_col, m + _band);
+  _units.assign(_region.size(), {0, -1, -1});
+
+  for (int u : _region.order()) {
+    if (compute_unit(u, ends_free)) {
+      for (int w : _region.successors(u)) {
+        merge_into(u, w);
+      }
+    }
+  }
+
+  traceback(alignment);
+}
+
+
+void DPRegion::build(const CSRGraph &graph, int start_vertex, int start_col, int max_depth) {
+  _units.clear();
+  _unit_ids.clear();
+  _successors.clear();
+  get_unit(start_vertex, start_col);
+  _units[0].depth = 0;
+
+  using item = std::pair<int, int>;   // Depth and unit
+  std::priority_queue<item, std::vector<item>, std::greater<item>> queue;
+  std::vector<bool> expanded;
+  std::vector<int> indegree;
+  queue.push({0, 0});
+  while (!queue.empty()) {
+    auto [depth, u] = queue.top();
+    queue.pop();
+    expanded.resize(_units.size(), false);
+    indegree.resize(_units.size(), 0);
+    if (expanded[u] || depth > _units[u].depth) {
+      continue;
+    }
+    expanded[u] = true;
+
+    // Columns within reach (the units beyond max_depth are not computed)
+    const int vertex = _units[u].vertex, first = _units[u].first;
+    const int len = graph.length(vertex);
+    _units[u].last = std::min(len, first + (max_depth - depth));
+    if (_units[u].last < len) {
+      continue;
+    }
+    const int exit_depth = depth + len - first;
+    for (const auto &edge : graph.out_edges(vertex)) {
+      int w = get_unit(edge.vertex, std::min((int)edge.overlap, graph.length(edge.vertex)));
+      if (exit_depth < _units[w].depth) {
+        _units[w].depth = exit_depth;
+        queue.push({exit_depth, w});
+      }
+      _successors[u].push_back(w);
+      indegree.resize(_units.size(), 0);
+      indegree[w] += 1;
+    }
+  }
+
+  // Topological order (Kahn). When only cycles are left, the first unit
+  // found is computed next.
+  std::vector<bool> computed(_units.size(), false);
+  _order.clear();
+  size_t head = 0;
+  int next_unit = 0;
+  std::vector<int> ready{0};
+  while (_order.size() < _units.size()) {
+    int u;
+    if (head < ready.size()) {
+      u = ready[head++];
+    }
+    else {
+      while (computed[next_unit]) ++next_unit;
+      u = next_unit;
+    }
+    if (computed[u]) {
+      continue;
+    }
+    computed[u] = true;
+    _order.push_back(u);
+    for (int w : _successors[u]) {
+      if (--indegree[w] == 0) {
+        ready.push_back(w);
+      }
+    }
+  }
+
+  // Only the edges to the units computed later
+  std::vector<int> rank(_units.size());
+  for (size_t r = 0; r < _order.size(); ++r) {
+    rank[_order[r]] = r;
+  }
+  _truncated.assign(_units.size(), false);
+  for (int u = 0; u < (int)_units.size(); ++u) {
+    const size_t edges = _successors[u].size();
+    std::erase_if(_successors[u], [&rank, u](int w) { return rank[w] <= rank[u]; });
+    _truncated[u] = (_successors[u].size() < edges || _units[u].last < graph.length(_units[u].vertex));
+  }
+}
+
+
+int DPRegion::get_unit(int vertex, int first) {
+  int64_t key = ((int64_t)vertex << 32) | (uint32_t)first;
+  auto [it, inserted] = _unit_ids.try_emplace(key, (int)_units.size());
+  if (inserted) {
+    _units.push_back({vertex, first, first - 1, std::numeric_limits<int>::max()});
+    _successors.emplace_back();
+  }
+  return it->second;
+}
+
+
+bool BandedDP::compute_unit(int u, const EndsFree &ends_free) {
+  const DPRegion::Unit &unit = _region.unit(u);
+  UnitData &data = _units[u];
+  const bool start = (u == 0);
+  auto entry = _entries.find(u);
+  if (!start && entry == _entries.end()) {
+    return false;   // Not reached (cycles)
+  }
+
+  const int m = _seq.size();
+  const int max_lo = std::max(0, m + 1 - _width);
+  const score_t mism = _penalties.mism();
+  const int query_begin = std::clamp(ends_free.query_begin, 0, m);
+  const int graph_begin = std::max(ends_free.graph_begin, 0);
+  const std::string text = _graph->sequence(unit.vertex);
+
+  data.column = _los.size();
+  const int num_columns = unit.last - unit.first + 1;
+  _los.resize(_los.size() + num_columns);
+  _trace.resize(_trace.size() + (size_t)num_columns * _width);
+
+  // Gaps of the query within a column and best cell (M)
+  auto vertical = [&](int col, int k, score_t h, score_t trace) {
+    const score_t up_h = (k > 0) ? _h[k - 1] : inf;
+    const score_t up_d = (k > 0) ? _d[k - 1] : inf, up_d2 = (k > 0) ? _d2[k - 1] : inf;
+    _recurrence.vertical(up_h, up_d, up_d2, h, _d[k], _d2[k], trace);
+    _h[k] = h;
+    _trace[(size_t)(data.column + col - unit.first) * _width + k] = trace;
+  };
+
+  // Entry column: start of the alignment (with the free leading query
+  // bases) or last columns of the predecessors
+  int lo;
+  if (start) {
+    lo = std::clamp(query_begin - _band, 0, max_lo);
+    for (int k = 0; k < _width; ++k) {
+      _i[k] = _i2[k] = inf;
+      vertical(unit.first, k, (lo + k <= query_begin) ? 0 : inf, FromEntry);
+    }
+  }
+  else {
+    lo = entry->second.lo;
+    for (int k = 0; k < _width; ++k) {
+      _i[k] = entry->second.i[k];
+      _i2[k] = entry->second.i2[k];
+      vertical(unit.first, k, entry->second.h[k], FromEntry);
+    }
+    _entries.erase(entry);
+  }
+  _los[data.column] = lo;
+  check_end(u, unit.first, lo);
+
+  for (int col = unit.first + 1; col <= unit.last; ++col) {
+    std::swap(_h, _prev_h);
+    std::swap(_i, _prev_i);
+    std::swap(_i2, _prev_i2);
+
+    // The band is centered on the diagonal of the best cell (moving at most
+    // two query offsets per column, gaps of the query included)
+    int best_k = std::min_element(_prev_h.begin(), _prev_h.end()) - _prev_h.begin();
+    int shift = std::clamp(best_k + 1 - _band, 0, std::min(2, max_lo - lo));
+    lo += shift;
+    _los[data.column + col - unit.first] = lo;
+
+    const char base = text[col - 1];
+    const bool free_start = start && col - unit.first <= graph_begin;   // Free leading graph bases
+    for (int k = 0; k < _width; ++k) {
+      const int r = lo + k, pk = k + shift;   // Query offset and its index in the previous column
+      const bool left = (pk < _width), diag = (pk > 0 && pk <= _width && r > 0);
+      score_t h, trace;
+      _recurrence.horizontal(diag ? _prev_h[pk - 1] + ((_seq[r - 1] == base) ? 0 : mism) : inf,
+                             left ? _prev_h[pk] : inf, left ? _prev_i[pk] : inf,
+                             left ? _prev_i2[pk] : inf, h, _i[k], _i2[k], trace);
+      if (free_start && r == 0 && 0 < h) {
+        h = 0;
+        trace = (trace & ~SourceMask) | FromEntry;
+      }
+      vertical(col, k, h, trace);
+    }
+    check_end(u, col, lo);
+  }
+  return true;
+}
+
+
+void BandedDP::merge_into(int u, int w) {
+  const DPRegion::Unit &pred = _region.unit(u);
+  UnitData &unit = _units[w];
+  const int lo = _los[_units[u].column + pred.last - pred.first];
+  const score_t best = *std::min_element(_h.begin(), _h.end());
+  Entry &entry = _entries[w];
+  if (entry.lo < 0) {
+    entry.lo = lo;
+    entry.best = best;
+    entry.h = _h;
+    entry.i = _i;
+    entry.i2 = _i2;
+    unit.single_pred = u;
+    return;
+  }
+
+  // The entry window is the one of the best predecessor
+  if (best < entry.best && lo != entry.lo) {
+    const int shift = lo - entry.lo;
+    auto shift_values = [this, shift]<class T>(T *values, T fill) {
+      std::vector<T> old(values, values + _width);
+      for (int k = 0; k < _width; ++k) {
+        int old_k = k + shift;
+        values[k] = (old_k >= 0 && old_k < _width) ? old[old_k] : fill;
+      }
+    };
+    shift_values(entry.h.data(), inf);
+    shift_values(entry.i.data(), inf);
+    shift_values(entry.i2.data(), inf);
+    if (unit.single_pred < 0) {
+      for (int s = 0; s < 3; ++s) {
+        shift_values(_prov.data() + unit.prov + s * _width, u);
+      }
+    }
+    entry.lo = lo;
+  }
+  entry.best = std::min(entry.best, best);
+
+  // Best cells (and their predecessor)
+  auto set_prov = [&](int s, int k) {
+    if (unit.single_pred == u) {
+      return;
+    }
+    if (unit.single_pred >= 0) {
+      unit.prov = _prov.size();
+      _prov.resize(_prov.size() + 3 * _width, unit.single_pred);
+      unit.single_pred = -1;
+    }
+    _prov[unit.prov + s * _width + k] = u;
+  };
+  for (int k = 0; k < _width; ++k) {
+    int pk = entry.lo + k - lo;
+    if (pk < 0 || pk >= _width) {
+      continue;
+    }
+    if (_h[pk] < entry.h[k]) {
+      entry.h[k] = _h[pk];
+      set_prov(0, k);
+    }
+    if (_i[pk] < entry.i[k]) {
+      entry.i[k] = _i[pk];
+      set_prov(1, k);
+    }
+    if (_i2[pk] < entry.i2[k]) {
+      entry.i2[k] = _i2[pk];
+      set_prov(2, k);
+    }
+  }
+}
+
+
+void BandedDP::check_end(int u, int col, int lo) {
+  const int hi = lo + _width - 1;
+  if (hi >= _end_row) {
+    for (int r = std::max(lo, _end_row); r <= hi; ++r) {
+      if (_h[r - lo] < _end_score) {
+        _end_score = _h[r - lo];
+        _end_unit = u;
+        _end_col = col;
+        _end_query = r;
+        _end_gap = 0;
+        _end_state = State::M;
+      }
+    }
+    return;
+  }
+
+  // The rest of the query (below the band) is a gap
+  const int k = _width - 1, len = _end_row - hi;
+  score_t score = _h[k] + gap_score(len);
+  State state = State::M;
+  if (_d[k] + len * _penalties.gape() < score) {
+    score = _d[k] + len * _penalties.gape();
+    state = State::D;
+  }
+  if (_penalties.type() == Penalties::Type::DualAffine && _d2[k] + len * _penalties.gape2() < score) {
+    score = _d2[k] + len * _penalties.gape2();
+    state = State::D2;
+  }
+  if (score < _end_score) {
+    _end_score = score;
+    _end_unit = u;
+    _end_col = col;
+    _end_query = hi;
+    _end_gap = len;
+    _end_state = state;
+  }
+}
+
+
+void BandedDP::traceback(Alignment &alignment) {
+  alignment.edit_op.assign(_end_gap, 'D');
+  alignment.path.clear();
+  alignment.end_offset = _end_col;
+  alignment.query_end = _end_query + _end_gap;
+
+  int u = _end_unit, col = _end_col, r = _end_query;
+  State state = _end_state;
+  std::string text = _graph->sequence(_region.unit(u).vertex);
+  alignment.path.push_back(_region.unit(u).vertex);
+  while (true) {
+    const DPRegion::Unit &unit = _region.unit(u);
+    const int64_t column = _units[u].column + col - unit.first;
+    const int k = r - _los[column];
+    const uint8_t trace = _trace[column * _width + k];
+    const bool from_entry = (state == State::M && (trace & SourceMask) == FromEntry);
+
+    // Start of the alignment
+    if (u == 0 && from_entry) {
+      break;
+    }
+
+    // Jump to the predecessor (the entry cells of M, I and I2 are those of
+    // its last column)
+    if (col == unit.first && (from_entry || state == State::I || state == State::I2)) {
+      int pred = _units[u].single_pred;
+      if (pred < 0) {
+        int s = (state == State::M) ? 0 : (state == State::I) ? 1 : 2;
+        pred = _prov[_units[u].prov + s * _width + k];
+      }
+      u = pred;
+      col = _region.unit(u).last;
+      text = _graph->sequence(_region.unit(u).vertex);
+      alignment.path.push_back(_region.unit(u).vertex);
+      continue;
+    }
+
+    switch (state) {
+      case State::M:
+        switch (trace & SourceMask) {
+          case FromDiag:
+            alignment.edit_op.push_back((_seq[r - 1] == text[col - 1]) ? 'M' : 'X');
+            r -= 1;
+            col -= 1;
+            break;
+          case FromI: state = State::I; break;
+          case FromD: state = State::D; break;
+          case FromI2: state = State::I2; break;
+          default: state = State::D2; break;
+        }
+        break;
+      case State::I:
+        alignment.edit_op.push_back('I');
+        state = (trace & ExtendI) ? State::I : State::M;
+        col -= 1;
+        break;
+      case State::I2:
+        alignment.edit_op.push_back('I');
+        state = (trace & ExtendI2) ? State::I2 : State::M;
+        col -= 1;
+        break;
+      case State::D:
+        alignment.edit_op.push_back('D');
+        state = (trace & ExtendD) ? State::D : State::M;
+        r -= 1;
+        break;
+      case State::D2:
+        alignment.edit_op.push_back('D');
+        state = (trace & ExtendD2) ? State::D2 : State::M;
+        r -= 1;
+        break;
+    }
+  }
+
+  alignment.start_offset = col;
+  alignment.query_start = r;
+  std::reverse(alignment.edit_op.begin(), alignment.edit_op.end());
+  std::reverse(alignment.path.begin(), alignment.path.end());
+}
+
+
+BandedDP::score_t BandedDP::gap_score(int len) const {
+  score_t score = _penalties.gapo() + len * _penalties.gape();
+  if (_penalties.type() == Penalties::Type::DualAffine) {
+    score = std::min(score, _penalties.gapo2() + len * _penalties.gape2());
+  }
+  return score;
+}
+
+} // namespace theseus
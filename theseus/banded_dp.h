@@ -0,0 +1,412 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "theseus/alignment.h"
+#include "theseus/theseus_aligner.h"
+
+#include "csr_graph.h"
+#include "internal_penalties.h"
+
+/**
+ * Banded dynamic programming over the graph, used as the fallback of the
+ * wavefront engine for divergent sequences (see DPFallback). The cost of the
+ * wavefronts grows with the square of the score, while the cost of the
+ * banded DP is proportional to the number of graph bases visited times the
+ * width of the band.
+ *
+ * The DP is computed column by column (one column per position of the graph)
+ * with the M, I and D matrices (and I2, D2 with dual affine gaps) of the
+ * internal penalties. Each column only keeps a window of "2*band + 1" query
+ * offsets, which moves down one offset per column when the best cell of the
+ * previous column is below its center (adaptive band). Only the graph within
+ * "query length + band" bases of the start is computed (see DPRegion).
+ *
+ */
+
+namespace theseus {
+
+/**
+ * @brief Part of the graph computed by a DP from a starting position, as a
+ * set of units: the columns of a vertex starting at a given offset (the
+ * starting position or the overlap of an in-edge). The units within
+ * max_depth graph bases of the start are computed in topological order (the
+ * start first). The cycles are followed once: the edges to an already
+ * computed unit are ignored, and when only cycles are left, the first unit
+ * found is computed without the rest of its predecessors.
+ *
+ */
+class DPRegion {
+public:
+    struct Unit {
+        int vertex;
+        int first;          // First column (entry)
+        int last;           // Last column within reach
+        int depth;          // Graph bases from the start to the first column
+    };
+
+    /**
+     * @brief Find the units within reach of the start (Dijkstra on the graph
+     * bases), their edges and their order.
+     *
+     * @param graph
+     * @param start_vertex
+     * @param start_col
+     * @param max_depth
+     */
+    void build(const CSRGraph &graph, int start_vertex, int start_col, int max_depth);
+
+    int size() const {
+        return _units.size();
+    }
+
+    const Unit &unit(int u) const {
+        return _units[u];
+    }
+
+    /**
+     * @brief Units computed after u that follow it in the graph (the entry
+     * of each one is merged from the last column of u).
+     *
+     * @param u
+     * @return const std::vector<int>&
+     */
+    const std::vector<int> &successors(int u) const {
+        return _successors[u];
+    }
+
+    /**
+     * @brief Whether the alignments may continue from the last column of u
+     * out of the region: its columns beyond max_depth or the edges ignored
+     * in the cycles.
+     *
+     * @param u
+     * @return bool
+     */
+    bool truncated(int u) const {
+        return _truncated[u];
+    }
+
+    /**
+     * @brief Units in the order in which they are computed.
+     *
+     * @return const std::vector<int>&
+     */
+    const std::vector<int> &order() const {
+        return _order;
+    }
+
+private:
+    int get_unit(int vertex, int first);
+
+    std::vector<Unit> _units;
+    std::unordered_map<int64_t, int> _unit_ids;      // Vertex and first column
+    std::vector<std::vector<int>> _successors;
+    std::vector<bool> _truncated;
+    std::vector<int> _order;
+};
+
+/**
+ * @brief Traceback of a cell of the banded DPs (BandedDP and LaneDP): source
+ * of the cell of M (3 lowest bits) and the gap extensions of the other
+ * matrices.
+ *
+ */
+enum DPTrace : uint8_t {
+    FromDiag = 0,
+    FromI = 1,
+    FromD = 2,
+    FromI2 = 3,
+    FromD2 = 4,
+    FromEntry = 5,      // Start of the alignment (start unit) or predecessor unit
+    SourceMask = 7,
+    ExtendI = 8,
+    ExtendD = 16,
+    ExtendI2 = 32,
+    ExtendD2 = 64
+};
+
+/**
+ * @brief Recurrence of a cell of the banded DPs, shared by BandedDP and the
+ * column kernels of LaneDP. The values (T) are either scores or vectors of
+ * the scores of several lanes (GCC vector extensions), so the minimums and
+ * the traceback are selected with comparisons. The ties are broken in the
+ * order M (diagonal), I, I2, D, D2, and the scores are capped at "inf".
+ *
+ */
+template <class T>
+struct DPRecurrence {
+    T mism, gapoe, gape, gapoe2, gape2;     // The opening penalties include the first extension
+    T inf;                                  // Unreachable cell
+    bool dual;                              // I2 and D2 matrices
+
+    DPRecurrence() = default;
+
+    /**
+     * @brief Recurrence of the internal penalties.
+     *
+     * @param penalties     Internal penalties (zero match penalty)
+     * @param unreachable   Unreachable score
+     */
+    DPRecurrence(const InternalPenalties &penalties, T unreachable)
+        : mism(penalties.mism()),
+          gapoe(penalties.gapo() + penalties.gape()), gape(penalties.gape()),
+          gapoe2(penalties.gapo2() + penalties.gape2()), gape2(penalties.gape2()),
+          inf(unreachable), dual(penalties.type() == Penalties::Type::DualAffine) {}
+
+    /**
+     * @brief The same recurrence on vectors of scores (the penalties in all
+     * the lanes).
+     *
+     * @tparam V
+     * @return DPRecurrence<V>
+     */
+    template <class V>
+    [[gnu::always_inline]] DPRecurrence<V> broadcast() const {
+        DPRecurrence<V> lanes;
+        lanes.mism = V{} + mism;
+        lanes.gapoe = V{} + gapoe;
+        lanes.gape = V{} + gape;
+        lanes.gapoe2 = V{} + gapoe2;
+        lanes.gape2 = V{} + gape2;
+        lanes.inf = V{} + inf;
+        lanes.dual = dual;
+        return lanes;
+    }
+
+    /**
+     * @brief Cells of I and I2 (a graph base from the cell on the left) and
+     * best cell of M without the gaps of the query.
+     *
+     * @param diag      Diagonal cell of M plus the mismatch penalty
+     * @param left_h    Cells on the left
+     * @param left_i
+     * @param left_i2
+     * @param h         Best cell
+     * @param i
+     * @param i2
+     * @param trace     Traceback (DPTrace)
+     */
+    [[gnu::always_inline]] void horizontal(const T &diag, const T &left_h, const T &left_i, const T &left_i2,
+                                           T &h, T &i, T &i2, T &trace) const {
+        const T zero = {};
+        const T i_open = left_h + gapoe, i_ext = left_i + gape;
+        i = min(min(i_open, i_ext), inf);
+        trace = (i_ext < i_open) ? flag<ExtendI>() : zero;
+        trace |= (i < diag) ? flag<FromI>() : zero;      // FromDiag is 0
+        h = min(diag, i);
+        i2 = inf;
+        if (dual) {
+            const T i2_open = left_h + gapoe2, i2_ext = left_i2 + gape2;
+            i2 = min(min(i2_open, i2_ext), inf);
+            trace |= (i2_ext < i2_open) ? flag<ExtendI2>() : zero;
+            trace = (i2 < h) ? source<FromI2>(trace) : trace;
+            h = min(h, i2);
+        }
+    }
+
+    /**
+     * @brief Cells of D and D2 (a query base from the cell above) and best
+     * cell of M.
+     *
+     * @param up_h      Cells above
+     * @param up_d
+     * @param up_d2
+     * @param h         Best cell so far (the diagonal and I, or the entry)
+     * @param d
+     * @param d2
+     * @param trace     Traceback (DPTrace)
+     */
+    [[gnu::always_inline]] void vertical(const T &up_h, const T &up_d, const T &up_d2,
+                                         T &h, T &d, T &d2, T &trace) const {
+        const T zero = {};
+        const T d_open = up_h + gapoe, d_ext = up_d + gape;
+        d = min(min(d_open, d_ext), inf);
+        trace |= (d_ext < d_open) ? flag<ExtendD>() : zero;
+        trace = (d < h) ? source<FromD>(trace) : trace;
+        h = min(h, d);
+        d2 = inf;
+        if (dual) {
+            const T d2_open = up_h + gapoe2, d2_ext = up_d2 + gape2;
+            d2 = min(min(d2_open, d2_ext), inf);
+            trace |= (d2_ext < d2_open) ? flag<ExtendD2>() : zero;
+            trace = (d2 < h) ? source<FromD2>(trace) : trace;
+            h = min(h, d2);
+        }
+        h = min(h, inf);
+    }
+
+private:
+    [[gnu::always_inline]] static T min(const T &a, const T &b) {
+        return (b < a) ? b : a;
+    }
+
+    template <int bits>
+    [[gnu::always_inline]] static T flag() {
+        return T{} + bits;
+    }
+
+    template <DPTrace from>
+    [[gnu::always_inline]] static T source(const T &trace) {
+        return (trace & flag<~SourceMask>()) | flag<from>();
+    }
+};
+
+class BandedDP {
+public:
+    /**
+     * @brief Construct a new Banded DP object.
+     *
+     * @param graph
+     * @param penalties     Internal penalties (zero match penalty)
+     */
+    BandedDP(const CSRGraph &graph, const InternalPenalties &penalties)
+        : _graph(&graph), _penalties(penalties), _recurrence(penalties, inf) {}
+
+    /**
+     * @brief Align the sequence from the starting position. The whole
+     * sequence (but the free ends) is aligned and the alignment may end
+     * anywhere in the graph. The alignment is optimal if it stays within the
+     * band and does not need to follow a cycle twice.
+     *
+     * @param seq
+     * @param start_vertex
+     * @param start_col
+     * @param band          Half width of the band (query offsets)
+     * @param ends_free     Free leading and trailing bases (see EndsFree)
+     * @param alignment     Alignment (edit operations, path, offsets and
+     *                      query range; the score is not set)
+     */
+    void align(std::string_view seq,
+               int start_vertex,
+               int start_col,
+               int band,
+               const EndsFree &ends_free,
+               Alignment &alignment);
+
+private:
+    using score_t = int32_t;
+    static constexpr score_t inf = std::numeric_limits<score_t>::max() / 4;
+
+    enum class State { M, I, D, I2, D2 };
+
+    /**
+     * @brief Columns of a unit (see DPRegion).
+     *
+     */
+    struct UnitData {
+        int64_t column;     // Index of the first column in _los (and of its window in _trace)
+        int single_pred;    // Predecessor of all the entry cells (-1 if several, see _prov)
+        int prov;           // Index of the entry predecessors in _prov (H, I and I2 per row)
+    };
+
+    /**
+     * @brief Values of the entry column of a unit (merged from the last
+     * column of its predecessors).
+     *
+     */
+    struct Entry {
+        int lo = -1;
+        score_t best = inf;
+        std::vector<score_t> h, i, i2;
+    };
+
+    /**
+     * @brief Compute the columns of a unit.
+     *
+     * @param u
+     * @param ends_free
+     * @return bool     Whether the unit was reached (it has an entry)
+     */
+    bool compute_unit(int u, const EndsFree &ends_free);
+
+    /**
+     * @brief Merge the last column of unit u into the entry of unit w.
+     *
+     * @param u
+     * @param w
+     */
+    void merge_into(int u, int w);
+
+    /**
+     * @brief Keep the best end cell found so far (the query offsets from
+     * _end_row are aligned, or the rest of the query is a gap).
+     *
+     * @param u
+     * @param col
+     * @param lo
+     */
+    void check_end(int u, int col, int lo);
+
+    /**
+     * @brief Traceback from the best end cell.
+     *
+     * @param alignment
+     */
+    void traceback(Alignment &alignment);
+
+    /**
+     * @brief Penalty of a gap of length len.
+     *
+     * @param len
+     * @return score_t
+     */
+    score_t gap_score(int len) const;
+
+    const CSRGraph *_graph;
+    InternalPenalties _penalties;
+    DPRecurrence<score_t> _recurrence;
+    std::string_view _seq;
+    int _width = 0;         // Query offsets of a column (2*band + 1, at most the query size + 1)
+    int _band = 0;
+    int _end_row = 0;       // First query offset of the end (free trailing bases)
+
+    DPRegion _region;
+    std::vector<UnitData> _units;
+    std::unordered_map<int, Entry> _entries;         // Entries of the units not yet computed
+    std::vector<int> _los;                           // First query offset of each column
+    std::vector<uint8_t> _trace;                     // Traceback of each cell (_width per column)
+    std::vector<int> _prov;                          // Entry predecessors (units with several)
+
+    // Current and previous columns
+    std::vector<score_t> _h, _i, _d, _i2, _d2;
+    std::vector<score_t> _prev_h, _prev_i, _prev_i2;
+
+    // Best end cell
+    score_t _end_score;
+    int _end_unit, _end_col, _end_query, _end_gap;
+    State _end_state;
+};
+
+} // namespace theseus
@@ -0,0 +1,132 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <tuple>
+
+#include "batch_aligner.h"
+
+namespace theseus {
+
+BatchAligner::BatchAligner(const Penalties &penalties,
+                           std::shared_ptr<const CSRGraph> graph,
+                           int num_threads) : _pool(num_threads) {
+    for (int w = 0; w < _pool.num_threads(); ++w) {
+        _workspaces.push_back(std::make_unique<TheseusAlignerImpl>(penalties, graph));
+    }
+}
+
+
+void BatchAligner::align(std::span<const Query> queries, const callback_t &callback) {
+    _pool.run(queries.size(), [&](int worker_id, size_t idx) {
+        const Query &query = queries[idx];
+        Alignment alignment = _workspaces[worker_id]->align(query.seq, query.start_node, query.start_offset);
+
+        std::lock_guard<std::mutex> lock(_callback_mutex);
+        callback(idx, alignment);
+    });
+}
+
+
+void BatchAligner::align_shared_prefixes(std::span<const Query> queries, const callback_t &callback) {
+    std::vector<size_t> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        const Query &qa = queries[a], &qb = queries[b];
+        return std::tie(qa.start_node, qa.start_offset, qa.seq) <
+               std::tie(qb.start_node, qb.start_offset, qb.seq);
+    });
+
+    // Large groups are split so that all the workers get some runs
+    const size_t max_run = std::max<size_t>(1, queries.size() / (4 * _pool.num_threads()));
+    align_runs(queries, order, [max_run](size_t) { return max_run; },
+               &TheseusAlignerImpl::align_shared_prefixes, callback);
+}
+
+
+void BatchAligner::align_lockstep(std::span<const Query> queries, int max_length, const callback_t &callback) {
+    std::vector<size_t> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        const Query &qa = queries[a], &qb = queries[b];
+        return std::make_tuple(std::string_view(qa.start_node), qa.start_offset, qa.seq.size()) <
+               std::make_tuple(std::string_view(qb.start_node), qb.start_offset, qb.seq.size());
+    });
+
+    // Runs of whole groups of lanes for the short queries (of similar
+    // lengths, as they are sorted) and single queries for the long ones
+    const size_t max_run = std::max<size_t>(1, queries.size() / (4 * _pool.num_threads()));
+    const size_t lanes_run = std::max<size_t>(1, max_run / LaneDP::lanes) * LaneDP::lanes;
+    align_runs(queries, order, [&](size_t k) -> size_t {
+                   return ((int)queries[order[k]].seq.size() <= max_length) ? lanes_run : 1;
+               },
+               &TheseusAlignerImpl::align_lockstep, callback);
+}
+
+
+void BatchAligner::align_runs(std::span<const Query> queries,
+                              const std::vector<size_t> &order,
+                              const std::function<size_t(size_t)> &run_length,
+                              void (TheseusAlignerImpl::*align_run)(std::span<const std::string_view>,
+                                                                    const std::string &, int,
+                                                                    const callback_t &),
+                              const callback_t &callback) {
+    // Runs of queries with the same starting position
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t first = 0, last = 0; first < order.size(); first = last) {
+        const Query &query = queries[order[first]];
+        const size_t max_run = run_length(first);
+        last = first + 1;
+        while (last < order.size() && last - first < max_run &&
+               queries[order[last]].start_node == query.start_node &&
+               queries[order[last]].start_offset == query.start_offset) {
+            last += 1;
+        }
+        runs.emplace_back(first, last);
+    }
+
+    _pool.run(runs.size(), [&](int worker_id, size_t run_idx) {
+        auto [first, last] = runs[run_idx];
+        std::vector<std::string_view> seqs;
+        for (size_t k = first; k < last; ++k) {
+            seqs.push_back(queries[order[k]].seq);
+        }
+        const Query &query = queries[order[first]];
+        ((*_workspaces[worker_id]).*align_run)(
+            seqs, query.start_node, query.start_offset,
+            [&](size_t k, Alignment &alignment) {
+                std::lock_guard<std::mutex> lock(_callback_mutex);
+                callback(order[first + k], alignment);
+            });
+    });
+}
+
+} // namespace theseus
@@ -0,0 +1,149 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "theseus/alignment.h"
+#include "theseus/penalties.h"
+#include "theseus/theseus_aligner.h"
+
+#include "csr_graph.h"
+#include "theseus_aligner_impl.h"
+#include "work_stealing_pool.h"
+
+/**
+ * Aligns batches of queries against a shared graph using a work stealing pool
+ * of threads. Each worker thread has its own alignment workspace
+ * (TheseusAlignerImpl), which is reused across all the batches.
+ *
+ */
+
+namespace theseus {
+
+class BatchAligner {
+public:
+    using callback_t = std::function<void(size_t, Alignment &)>;
+
+    /**
+     * @brief Construct a new Batch Aligner object
+     *
+     * @param penalties
+     * @param graph         Shared read-only graph
+     * @param num_threads   Number of worker threads
+     */
+    BatchAligner(const Penalties &penalties,
+                 std::shared_ptr<const CSRGraph> graph,
+                 int num_threads);
+
+    /**
+     * @brief Get the number of worker threads.
+     *
+     * @return int
+     */
+    int num_threads() const {
+        return _pool.num_threads();
+    }
+
+    /**
+     * @brief Apply a function to the workspace of each worker (e.g., to set
+     * the alignment options).
+     *
+     * @param fn
+     */
+    void configure(const std::function<void(TheseusAlignerImpl &)> &fn) {
+        for (auto &workspace : _workspaces) {
+            fn(*workspace);
+        }
+    }
+
+    /**
+     * @brief Align all the queries. The callback is called once per query
+     * (callback(query_idx, alignment)) in completion order. Calls to the
+     * callback are serialized.
+     *
+     * @param queries
+     * @param callback
+     */
+    void align(std::span<const Query> queries, const callback_t &callback);
+
+    /**
+     * @brief Align all the queries sharing the computation of common
+     * prefixes. The queries are grouped by starting position and sorted by
+     * sequence, and each task aligns a run of consecutive queries of a group
+     * (see TheseusAlignerImpl::align_shared_prefixes).
+     *
+     * @param queries
+     * @param callback
+     */
+    void align_shared_prefixes(std::span<const Query> queries, const callback_t &callback);
+
+    /**
+     * @brief Align all the queries in lockstep. The queries are grouped by
+     * starting position and sorted by length, and each task aligns a run of
+     * consecutive queries of a group (see TheseusAlignerImpl::align_lockstep).
+     * The runs of the queries of at most max_length bases hold a multiple of
+     * LaneDP::lanes queries.
+     *
+     * @param queries
+     * @param max_length
+     * @param callback
+     */
+    void align_lockstep(std::span<const Query> queries, int max_length, const callback_t &callback);
+
+private:
+    /**
+     * @brief Split the sorted queries into runs with the same starting
+     * position and align each run as a task of the pool.
+     *
+     * @param queries
+     * @param order         Sorted indices of the queries
+     * @param run_length    Maximum run length for the query of each index of order
+     * @param align_run     Alignment function of the workspaces
+     * @param callback
+     */
+    void align_runs(std::span<const Query> queries,
+                    const std::vector<size_t> &order,
+                    const std::function<size_t(size_t)> &run_length,
+                    void (TheseusAlignerImpl::*align_run)(std::span<const std::string_view>,
+                                                          const std::string &, int,
+                                                          const callback_t &),
+                    const callback_t &callback);
+
+    std::vector<std::unique_ptr<TheseusAlignerImpl>> _workspaces;   // One per worker
+    WorkStealingPool _pool;
+    std::mutex _callback_mutex;
+};
+
+} // namespace theseus
@@ -61,6 +61,40 @@ public:
         _i2_jumps_wf.set_realloc_policy(dense_wf_realloc_policy);
     }
 
+    /**
+     * @brief Sizes of the backtrace wavefronts at a given point of an
+     * alignment. The wavefronts only grow during an alignment, so they can be
+     * rewound to a mark.
+     *
+     */
+    struct Mark {
+        Cell::pos_t m_wf;
+        Cell::pos_t m_jumps_wf;
+        Cell::pos_t i_jumps_wf;
+        Cell::pos_t i2_jumps_wf;
+    };
+
+    /**
+     * @brief Get the current sizes of the backtrace wavefronts.
+     *
+     * @return Mark
+     */
+    Mark mark() const {
+        return {_m_wf.size(), _m_jumps_wf.size(), _i_jumps_wf.size(), _i2_jumps_wf.size()};
+    }
+
+    /**
+     * @brief Drop the cells stored after a mark.
+     *
+     * @param mark
+     */
+    void rewind(const Mark &mark) {
+        _m_wf.resize(mark.m_wf);
+        _m_jumps_wf.resize(mark.m_jumps_wf);
+        _i_jumps_wf.resize(mark.i_jumps_wf);
+        _i2_jumps_wf.resize(mark.i2_jumps_wf);
+    }
+
     /**
      * @brief Reinitialize the beyond the scope object each time that a new
      * alignment is called.
@@ -82,6 +116,15 @@ public:
         return _i_jumps_wf;
     }
 
+    /**
+     * @brief Access the i2_jumps wavefront
+     *
+     * @return Cell::Wavefront&
+     */
+    Cell::CellVector &i2_jumps_wf() {
+        return _i2_jumps_wf;
+    }
+
     /**
      * @brief Access the m_jumps wavefront
      *
@@ -39,12 +39,12 @@
  *
  * Fields:
  * - prev_pos: Position of the cell where the optimal path to the current cell
- * comes from.
+ * comes from (28 bits, see max_pos).
  * - vertex_id: ID of the vertex in the graph where this cell is located.
  * - offset: Offset in the query.
  * - diag: Diagonal in the dynamic programming matrix of the current vertex.
  * - from_matrix: Matrix from which the current cell was derived (M, I, D, MJumps,
- *  IJumps).
+ *  IJumps). Packed with prev_pos in 32 bits, so that a cell takes 16 bytes.
  *
  *
  */
@@ -73,7 +73,7 @@ struct Cell {
         Ins,
         Del};
 
-    enum class Matrix : int8_t {
+    enum class Matrix : uint8_t {
         None,
         M,
         MJumps,
@@ -85,11 +85,18 @@ struct Cell {
         D2
     };
 
-    pos_t prev_pos;
+    // Bits of prev_pos (signed) and largest position of a stored cell that
+    // it can reference
+    static constexpr int pos_bits = 28;
+    static constexpr pos_t max_pos = (pos_t(1) << (pos_bits - 1)) - 1;
+
+    int32_t prev_pos : pos_bits;
+    Matrix from_matrix : 32 - pos_bits;
     vertex_t vertex_id;
     idx2d_t offset;
     idx2d_t diag;
-    Matrix from_matrix;
 };
 
+static_assert(sizeof(Cell) == 16);
+
 }   // namespace theseus
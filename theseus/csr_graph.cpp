@@ -0,0 +1,243 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "csr_graph.h"
+#include "gfa_graph.h"
+
+namespace theseus {
+
+CSRGraph::CSRGraph(const Graph &graph, bool packed) : _packed(packed) {
+    build(graph);
+}
+
+
+CSRGraph::CSRGraph(std::istream &gfa_stream, bool packed) : _packed(packed) {
+    GfaGraph gfa_graph(gfa_stream);
+
+    struct EdgeData {
+        int from_vertex;
+        int to_vertex;
+        size_t overlap;
+    };
+    std::vector<EdgeData> edges;
+    edges.reserve(gfa_graph.gfa_edges.size());
+    for (const auto &e : gfa_graph.gfa_edges) {
+        edges.push_back({e.from_node, e.to_node, e.overlap});
+    }
+
+    build(gfa_graph.gfa_nodes.size(),
+          [&](int v) -> std::string_view { return gfa_graph.gfa_nodes[v].seq; },
+          [&](int v) -> std::string_view { return gfa_graph.gfa_nodes[v].name; },
+          edges);
+}
+
+
+void CSRGraph::build(const Graph &graph) {
+    std::vector<Graph::edge> edges;
+    for (const auto &vtx : graph._vertices) {
+        edges.insert(edges.end(), vtx.out_edges.begin(), vtx.out_edges.end());
+    }
+
+    build(graph._vertices.size(),
+          [&](int v) -> std::string_view { return graph._vertices[v].value; },
+          [&](int v) -> std::string_view { return graph._vertices[v].name; },
+          edges);
+}
+
+
+CSRGraph CSRGraph::reversed() const {
+    struct EdgeData {
+        int from_vertex;
+        int to_vertex;
+        int32_t overlap;
+    };
+    std::vector<EdgeData> edges;
+    edges.reserve(_out_edges.size());
+    for (int v = 0; v < num_vertices(); ++v) {
+        for (const auto &e : out_edges(v)) {
+            edges.push_back({e.vertex, v, e.overlap});
+        }
+    }
+
+    CSRGraph reverse_graph;
+    reverse_graph._packed = _packed;
+    std::string seq;    // Reversed sequence of the vertex being built
+    reverse_graph.build(num_vertices(),
+                        [&](int v) -> std::string_view {
+                            seq = sequence(v);
+                            std::reverse(seq.begin(), seq.end());
+                            return seq;
+                        },
+                        [&](int v) -> std::string_view { return name(v); },
+                        edges);
+    return reverse_graph;
+}
+
+
+std::shared_ptr<const CSRGraph> CSRGraph::reverse_graph() const {
+    std::call_once(_derived->reverse_once, [this]() {
+        _derived->reverse_graph = std::make_shared<const CSRGraph>(reversed());
+    });
+    return _derived->reverse_graph;
+}
+
+
+CSRGraph::vertex_t CSRGraph::reverse_vertex(vertex_t v) const {
+    std::string reverse_name(name(v));
+    if (reverse_name.empty() || (reverse_name.back() != '+' && reverse_name.back() != '-')) {
+        throw std::out_of_range("Vertex " + reverse_name + " has no orientation");
+    }
+    reverse_name.back() = (reverse_name.back() == '+') ? '-' : '+';
+    return get_id(reverse_name);
+}
+
+
+const std::vector<int32_t> &CSRGraph::max_remaining_lengths() const {
+    std::call_once(_derived->max_remaining_once, [this]() {
+        _derived->max_remaining = compute_max_remaining_lengths();
+    });
+    return _derived->max_remaining;
+}
+
+
+std::vector<int32_t> CSRGraph::compute_max_remaining_lengths() const {
+    constexpr int32_t unbounded = std::numeric_limits<int32_t>::max();
+    const int nvertices = num_vertices();
+    std::vector<int32_t> remaining(nvertices, unbounded);
+
+    // Reverse topological order (from the sinks). The vertices that are never
+    // reached are in a cycle or reach one, so they stay unbounded.
+    std::vector<int> pending(nvertices);
+    std::vector<vertex_t> queue;
+    for (int v = 0; v < nvertices; ++v) {
+        pending[v] = out_degree(v);
+        if (pending[v] == 0) queue.push_back(v);
+    }
+    for (size_t l = 0; l < queue.size(); ++l) {
+        vertex_t v = queue[l];
+        int64_t longest = 0;
+        for (const auto &e : out_edges(v)) {
+            longest = std::max(longest, (int64_t)remaining[e.vertex] - e.overlap);
+        }
+        remaining[v] = (int32_t)std::min<int64_t>(length(v) + longest, unbounded - 1);
+        for (const auto &e : in_edges(v)) {
+            if (--pending[e.vertex] == 0) queue.push_back(e.vertex);
+        }
+    }
+    return remaining;
+}
+
+
+template <typename SeqFn, typename NameFn, typename EdgeList>
+void CSRGraph::build(int nvertices, SeqFn seq_of, NameFn name_of, const EdgeList &edges) {
+    // Sequences and names
+    _seq_offsets.assign(1, 0);
+    _seq_arena.clear();
+    _packed_arena.clear();
+    _name_offsets.assign(1, 0);
+    _name_arena.clear();
+    _max_length = 0;
+    _derived = std::make_shared<Derived>();
+    for (int v = 0; v < nvertices; ++v) {
+        std::string_view seq = seq_of(v);
+        _max_length = std::max(_max_length, (int)seq.size());
+        if (_packed) {
+            _packed_arena.append(seq);
+        }
+        else {
+            _seq_arena.append(seq);
+        }
+        _seq_offsets.push_back(_seq_offsets.back() + seq.size());
+
+        _name_arena.append(name_of(v));
+        _name_offsets.push_back(_name_arena.size());
+    }
+
+    // Edges (counting sort by source for out-edges and by destination for
+    // in-edges, preserving the original order of the edges)
+    _out_offsets.assign(nvertices + 1, 0);
+    _in_offsets.assign(nvertices + 1, 0);
+    _has_overlaps = false;
+    for (const auto &e : edges) {
+        _out_offsets[e.from_vertex + 1] += 1;
+        _in_offsets[e.to_vertex + 1] += 1;
+        _has_overlaps = _has_overlaps || e.overlap != 0;
+    }
+    for (int v = 0; v < nvertices; ++v) {
+        _out_offsets[v + 1] += _out_offsets[v];
+        _in_offsets[v + 1] += _in_offsets[v];
+    }
+
+    _out_edges.resize(edges.size());
+    _in_edges.resize(edges.size());
+    std::vector<offset_t> out_pos(_out_offsets.begin(), _out_offsets.end() - 1);
+    std::vector<offset_t> in_pos(_in_offsets.begin(), _in_offsets.end() - 1);
+    for (const auto &e : edges) {
+        _out_edges[out_pos[e.from_vertex]++] = {(vertex_t)e.to_vertex, (int32_t)e.overlap};
+        _in_edges[in_pos[e.to_vertex]++] = {(vertex_t)e.from_vertex, (int32_t)e.overlap};
+    }
+
+    // Name index
+    _ids_by_name.resize(nvertices);
+    for (int v = 0; v < nvertices; ++v) {
+        _ids_by_name[v] = v;
+    }
+    std::stable_sort(_ids_by_name.begin(), _ids_by_name.end(),
+                     [this](vertex_t a, vertex_t b) { return name(a) < name(b); });
+}
+
+
+CSRGraph::vertex_t CSRGraph::get_id(std::string_view vertex_name) const {
+    auto it = std::lower_bound(_ids_by_name.begin(), _ids_by_name.end(), vertex_name,
+                               [this](vertex_t v, std::string_view n) { return name(v) < n; });
+    if (it == _ids_by_name.end() || name(*it) != vertex_name) {
+        throw std::out_of_range("Vertex " + std::string(vertex_name) + " not found in the graph");
+    }
+    return *it;
+}
+
+
+size_t CSRGraph::memory_usage() const {
+    return _out_offsets.capacity() * sizeof(offset_t) +
+           _out_edges.capacity() * sizeof(Edge) +
+           _in_offsets.capacity() * sizeof(offset_t) +
+           _in_edges.capacity() * sizeof(Edge) +
+           _seq_offsets.capacity() * sizeof(offset_t) +
+           _seq_arena.capacity() +
+           _packed_arena.memory_usage() +
+           _name_offsets.capacity() * sizeof(offset_t) +
+           _name_arena.capacity() +
+           _ids_by_name.capacity() * sizeof(vertex_t);
+}
+
+} // namespace theseus
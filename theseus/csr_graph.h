@@ -0,0 +1,337 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "graph.h"
+#include "packed_sequence.h"
+
+/**
+ * Read-only graph in Compressed Sparse Row (CSR) format. This is the graph
+ * representation used by the alignment hot path:
+ *      - Out-edges (and in-edges) of all the vertices are stored contiguously,
+ *        and the edges of vertex v are in [offsets[v], offsets[v+1]).
+ *      - The sequences of all the vertices are concatenated in one arena
+ *        (plain or 2-bit packed) and the sequence of vertex v is in
+ *        [seq_offsets[v], seq_offsets[v+1]).
+ *      - Vertex names are only needed to translate user input/output, so they
+ *        are kept apart in a cold name table.
+ *
+ * The mutable Graph class is still used where the graph is modified (MSA).
+ *
+ */
+
+namespace theseus {
+
+class CSRGraph {
+public:
+    using vertex_t = int32_t;
+    using offset_t = int64_t;
+
+    /**
+     * @brief An edge of the graph. Out-edges store their destination vertex
+     * and in-edges store their source vertex.
+     *
+     */
+    struct Edge {
+        vertex_t vertex;    // Adjacent vertex
+        int32_t overlap;    // Overlap length
+    };
+
+    CSRGraph() = default;
+
+    /**
+     * @brief Construct a new CSR Graph object from a Graph object.
+     *
+     * @param graph
+     * @param packed    Store the sequences with 2 bits per base
+     */
+    CSRGraph(const Graph &graph, bool packed = false);
+
+    /**
+     * @brief Construct a new CSR Graph object from a stream in GFA format.
+     *
+     * @param gfa_stream
+     * @param packed    Store the sequences with 2 bits per base
+     */
+    CSRGraph(std::istream &gfa_stream, bool packed = false);
+
+    /**
+     * @brief Rebuild the CSR graph from a Graph object (used every time that the
+     * MSA graph changes). The already allocated memory is reused.
+     *
+     * @param graph
+     */
+    void build(const Graph &graph);
+
+    /**
+     * @brief Build the reverse graph: the same vertices (and ids) with their
+     * sequences reversed and all the edges pointing backwards. Aligning the
+     * reversed query on the reverse graph is equivalent to aligning the query
+     * backwards on this graph.
+     *
+     * @return CSRGraph
+     */
+    CSRGraph reversed() const;
+
+    /**
+     * @brief Reverse graph (see reversed()), built on the first call and
+     * shared by all the callers, e.g. the workspaces of the aligners that use
+     * this graph. It can be called from several threads.
+     *
+     * @return std::shared_ptr<const CSRGraph>
+     */
+    std::shared_ptr<const CSRGraph> reverse_graph() const;
+
+    /**
+     * @brief Check if any edge of the graph has a non-zero overlap (computed
+     * when the graph is built).
+     *
+     * @return bool
+     */
+    bool has_overlaps() const {
+        return _has_overlaps;
+    }
+
+    /**
+     * @brief Vertex of the opposite orientation. The GFA loader stores each
+     * segment in both orientations (vertices "<segment>+" and "<segment>-",
+     * the latter with the reverse complement sequence). Throws
+     * std::out_of_range if there is no such vertex.
+     *
+     * @param v
+     * @return vertex_t
+     */
+    vertex_t reverse_vertex(vertex_t v) const;
+
+    /**
+     * @brief Length of the longest path from the start of each vertex to the
+     * end of a sink (std::numeric_limits<int32_t>::max() if a cycle can be
+     * reached from the vertex). Computed on the first call and shared by all
+     * the callers; it can be called from several threads.
+     *
+     * @return const std::vector<int32_t>&
+     */
+    const std::vector<int32_t> &max_remaining_lengths() const;
+
+    /**
+     * @brief Number of vertices of the graph.
+     *
+     * @return int
+     */
+    int num_vertices() const {
+        return (int)_seq_offsets.size() - 1;
+    }
+
+    /**
+     * @brief Length of the sequence of vertex v.
+     *
+     * @param v
+     * @return int
+     */
+    int length(vertex_t v) const {
+        return _seq_offsets[v + 1] - _seq_offsets[v];
+    }
+
+    /**
+     * @brief Length of the longest vertex sequence (computed when the graph is
+     * built).
+     *
+     * @return int
+     */
+    int max_length() const {
+        return _max_length;
+    }
+
+    /**
+     * @brief Position of the sequence of vertex v in the sequence arena.
+     *
+     * @param v
+     * @return offset_t
+     */
+    offset_t seq_offset(vertex_t v) const {
+        return _seq_offsets[v];
+    }
+
+    /**
+     * @brief Sequence of vertex v (only if the graph is not packed).
+     *
+     * @param v
+     * @return const char*
+     */
+    const char *seq_data(vertex_t v) const {
+        return _seq_arena.data() + _seq_offsets[v];
+    }
+
+    /**
+     * @brief Sequence of vertex v as a string (unpacked if needed).
+     *
+     * @param v
+     * @return std::string
+     */
+    std::string sequence(vertex_t v) const {
+        if (_packed) {
+            return _packed_arena.substr(_seq_offsets[v], length(v));
+        }
+        return std::string(seq_data(v), length(v));
+    }
+
+    /**
+     * @brief Packed sequence arena (only if the graph is packed).
+     *
+     * @return const PackedSequence&
+     */
+    const PackedSequence &packed_arena() const {
+        return _packed_arena;
+    }
+
+    /**
+     * @brief Check if the sequences are stored with 2 bits per base.
+     *
+     * @return bool
+     */
+    bool is_packed() const {
+        return _packed;
+    }
+
+    /**
+     * @brief Out-edges of vertex v.
+     *
+     * @param v
+     * @return std::span<const Edge>
+     */
+    std::span<const Edge> out_edges(vertex_t v) const {
+        return std::span<const Edge>(_out_edges.data() + _out_offsets[v],
+                                     _out_edges.data() + _out_offsets[v + 1]);
+    }
+
+    /**
+     * @brief In-edges of vertex v.
+     *
+     * @param v
+     * @return std::span<const Edge>
+     */
+    std::span<const Edge> in_edges(vertex_t v) const {
+        return std::span<const Edge>(_in_edges.data() + _in_offsets[v],
+                                     _in_edges.data() + _in_offsets[v + 1]);
+    }
+
+    /**
+     * @brief Number of out-edges of vertex v.
+     *
+     * @param v
+     * @return int
+     */
+    int out_degree(vertex_t v) const {
+        return _out_offsets[v + 1] - _out_offsets[v];
+    }
+
+    /**
+     * @brief Name of vertex v.
+     *
+     * @param v
+     * @return std::string_view
+     */
+    std::string_view name(vertex_t v) const {
+        return std::string_view(_name_arena.data() + _name_offsets[v],
+                                _name_offsets[v + 1] - _name_offsets[v]);
+    }
+
+    /**
+     * @brief Get the id of a vertex given its name. Throws std::out_of_range if
+     * there is no vertex with such name.
+     *
+     * @param name
+     * @return vertex_t
+     */
+    vertex_t get_id(std::string_view name) const;
+
+    /**
+     * @brief Memory used by the graph (in bytes).
+     *
+     * @return size_t
+     */
+    size_t memory_usage() const;
+
+private:
+    /**
+     * @brief Build the CSR graph from a generic graph. The sequence and name of
+     * each vertex are given by the accessors and the edges by the list of
+     * (from, to, overlap) edges.
+     *
+     */
+    template <typename SeqFn, typename NameFn, typename EdgeList>
+    void build(int nvertices, SeqFn seq_of, NameFn name_of, const EdgeList &edges);
+
+    /**
+     * @brief Compute the lengths returned by max_remaining_lengths().
+     *
+     * @return std::vector<int32_t>
+     */
+    std::vector<int32_t> compute_max_remaining_lengths() const;
+
+    // Hot data
+    std::vector<offset_t> _out_offsets;
+    std::vector<Edge> _out_edges;
+    std::vector<offset_t> _in_offsets;
+    std::vector<Edge> _in_edges;
+
+    std::vector<offset_t> _seq_offsets = {0};
+    std::string _seq_arena;             // Plain sequences
+    PackedSequence _packed_arena;       // 2-bit sequences
+    bool _packed = false;
+    int _max_length = 0;                // Length of the longest vertex
+    bool _has_overlaps = false;         // Some edge has a non-zero overlap
+
+    // Cold data
+    std::vector<offset_t> _name_offsets = {0};
+    std::string _name_arena;
+    std::vector<vertex_t> _ids_by_name; // Vertex ids sorted by name
+
+    // Data derived on demand from the graph and shared by its users (a new
+    // one is started every time the graph is built)
+    struct Derived {
+        std::once_flag reverse_once;
+        std::shared_ptr<const CSRGraph> reverse_graph;
+        std::once_flag max_remaining_once;
+        std::vector<int32_t> max_remaining;
+    };
+    std::shared_ptr<Derived> _derived = std::make_shared<Derived>();
+};
+
+} // namespace theseus
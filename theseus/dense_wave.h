@@ -0,0 +1,129 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "cell.h"
+
+namespace theseus {
+
+/**
+ * @brief Dense wave of one matrix of a pairwise alignment (the graph is a
+ * single vertex): one entry per diagonal in [lo, hi]. Diagonals without a
+ * cell have offset -1. Each entry keeps the reference to the cell that the
+ * backtrace has to visit next (from_matrix and prev_pos, as in Cell).
+ *
+ */
+class DenseWave {
+public:
+    struct Entry {
+        Cell::idx2d_t offset;
+        int32_t prev_pos : Cell::pos_bits;
+        Cell::Matrix from_matrix : 32 - Cell::pos_bits;
+    };
+
+    /**
+     * @brief Clear the wave and set its range of diagonals.
+     *
+     * @param lo    Lowest diagonal
+     * @param hi    Highest diagonal
+     */
+    void reset(int lo, int hi) {
+        _lo = lo;
+        _hi = std::max(hi, lo - 1);
+        _entries.assign(_hi - _lo + 1, Entry{-1, 0, Cell::Matrix::None});
+    }
+
+    /**
+     * @brief Clear the wave (no diagonals).
+     *
+     */
+    void clear() {
+        reset(0, -1);
+    }
+
+    int lo() const {
+        return _lo;
+    }
+
+    int hi() const {
+        return _hi;
+    }
+
+    bool empty() const {
+        return _lo > _hi;
+    }
+
+    /**
+     * @brief Entry of a diagonal (offset -1 if out of the range).
+     *
+     * @param diag
+     * @return Entry
+     */
+    Entry get(int diag) const {
+        return (diag >= _lo && diag <= _hi) ? _entries[diag - _lo] : Entry{-1, 0, Cell::Matrix::None};
+    }
+
+    /**
+     * @brief Entry of a diagonal in the range.
+     *
+     * @param diag
+     * @return Entry&
+     */
+    Entry &operator[](int diag) {
+        return _entries[diag - _lo];
+    }
+
+    /**
+     * @brief Drop the diagonals without cells at both ends of the range.
+     *
+     */
+    void trim() {
+        int first = 0, last = (int)_entries.size() - 1;
+        while (first <= last && _entries[first].offset < 0) ++first;
+        while (last >= first && _entries[last].offset < 0) --last;
+        if (first > last) {
+            clear();
+            return;
+        }
+        _entries.erase(_entries.begin() + last + 1, _entries.end());
+        _entries.erase(_entries.begin(), _entries.begin() + first);
+        _lo += first;
+        _hi = _lo + last - first;
+    }
+
+private:
+    int _lo = 0;
+    int _hi = -1;
+    std::vector<Entry> _entries;
+};
+
+} // namespace theseus
@@ -114,4 +114,12 @@ namespace theseus
         std::unordered_map<std::string, size_t> name_to_id_;
     };
 
+    /**
+     * @brief Return the reverse complement of a DNA string.
+     *
+     * @param dna_string The DNA string to reverse complement.
+     * @return std::string The reverse complement of the input DNA string.
+     */
+    std::string reverse_complement(const std::string &dna_string);
+
 } // namespace theseus
\ No newline at end of file
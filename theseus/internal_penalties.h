@@ -42,37 +42,55 @@ class InternalPenalties {
 public:
     using penalty_t = Penalties::penalty_t;
 
-    InternalPenalties(Penalties penalties) {
+    InternalPenalties(Penalties penalties) : _type(penalties.type()) {
         // Transform penalties in an Eizenga fashion
         if (penalties.match() != 0) {
             _match = 0;
             _mismatch = 2*penalties.mism() - 2*penalties.match();
             _gapo = 2*penalties.gapo();
             _gape = 2*penalties.gape() - penalties.match();
+            _gapo2 = 2*penalties.gapo2();
+            _gape2 = (_type == Penalties::Type::DualAffine) ? 2*penalties.gape2() - penalties.match() : 0;
         }
         else {
             _match = penalties.match();
             _mismatch = penalties.mism();
             _gapo = penalties.gapo();
             _gape = penalties.gape();
+            _gapo2 = penalties.gapo2();
+            _gape2 = penalties.gape2();
         }
 
         if (penalties.match() > penalties.mism()) {
             throw std::invalid_argument("The match penalty must be less than the mismatch penalty");
         }
-        else if (penalties.match() > penalties.gapo()) {
+        else if (_type != Penalties::Type::Linear && penalties.match() > penalties.gapo()) {
             throw std::invalid_argument("The match penalty must be less than or equal to the gap open penalty.");
         }
         else if (penalties.match() > penalties.gape()) {
             throw std::invalid_argument("The match penalty must be less than or equal to the gap extend penalty.");
         }
-        else if (penalties.gapo() < penalties.gape()) {
+        else if (_type != Penalties::Type::Linear && penalties.gapo() < penalties.gape()) {
             throw std::invalid_argument("The gap open penalty must be greater than or equal to the gap extension penalty.");
         }
-
-        // TODO: Control for dual affine penalties
+        else if (_type == Penalties::Type::DualAffine && penalties.match() > penalties.gapo2()) {
+            throw std::invalid_argument("The match penalty must be less than or equal to the second gap open penalty.");
+        }
+        else if (_type == Penalties::Type::DualAffine && penalties.match() > penalties.gape2()) {
+            throw std::invalid_argument("The match penalty must be less than or equal to the second gap extend penalty.");
+        }
+        else if (_type == Penalties::Type::DualAffine && penalties.gapo2() < penalties.gape2()) {
+            throw std::invalid_argument("The second gap open penalty must be greater than or equal to the second gap extension penalty.");
+        }
     }
 
+    /**
+     * Get the gap type.
+     *
+     * @return The gap type.
+     */
+    Penalties::Type type() const { return _type; }
+
     /**
      * Get the match score.
      *
@@ -116,6 +134,8 @@ public:
     penalty_t gape2() const { return _gape2; }
 
 private:
+    Penalties::Type _type;
+
     // Diagonal penalties
     penalty_t _match;
     penalty_t _mismatch;
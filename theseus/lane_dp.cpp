@@ -0,0 +1,511 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <algorithm>
+#include <limits>
+#include <string>
+
+// The vectors of the kernels are only passed to inlined functions (the
+// recurrence of banded_dp.h), so the ABI of their arguments does not matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#include "lane_dp.h"
+
+namespace theseus {
+
+namespace {
+
+using score_t = LaneDP::score_t;
+constexpr int L = LaneDP::lanes;
+
+// Column of the DP for all the lanes (portable version). Row k of the
+// window is row k + 1 of the arrays (rows 0 and width + 1 are unreachable).
+// The sums never exceed the unreachable score plus a penalty, so they fit
+// in 16 bits.
+template <bool dual>
+void column_generic(const LaneDP::Column &c, const LaneDP::Scores &scores) {
+  LaneDP::Scores s = scores;    // Not aliased by the columns
+  s.dual = dual;
+  for (int k = 0; k < c.width; ++k) {
+    const score_t *diag_h = c.prev_h + (k + c.shift) * L;          // Row r - 1 of the previous column
+    const score_t *left_h = c.prev_h + (k + c.shift + 1) * L;      // Row r of the previous column
+    const score_t *left_i = c.prev_i + (k + c.shift + 1) * L;
+    const score_t *left_i2 = c.prev_i2 + (k + c.shift + 1) * L;
+    const score_t *up_h = c.h + k * L, *up_d = c.d + k * L, *up_d2 = c.d2 + k * L;   // Row r - 1
+    score_t *h = c.h + (k + 1) * L, *i = c.i + (k + 1) * L, *d = c.d + (k + 1) * L;
+    score_t *i2 = c.i2 + (k + 1) * L, *d2 = c.d2 + (k + 1) * L;
+    const score_t *query = c.query + k * L;
+    uint8_t *trace = c.trace + k * L;
+    for (int l = 0; l < L; ++l) {
+      score_t m, t;
+      s.horizontal(diag_h[l] + ((query[l] == c.base) ? 0 : s.mism),
+                   left_h[l], left_i[l], left_i2[l], m, i[l], i2[l], t);
+      s.vertical(up_h[l], up_d[l], up_d2[l], m, d[l], d2[l], t);
+      h[l] = m;
+      trace[l] = t;
+    }
+  }
+}
+
+// Vectors of 8 and 16 lanes (GCC vector extensions) and their unaligned
+// versions to load and store the rows
+template <int width>
+struct Vector;
+
+template <>
+struct Vector<8> {
+  using scores = score_t __attribute__((vector_size(16)));
+  using scores_u = score_t __attribute__((vector_size(16), aligned(1), may_alias));
+  using trace = uint8_t __attribute__((vector_size(8)));
+  using trace_u = uint8_t __attribute__((vector_size(8), aligned(1), may_alias));
+};
+
+template <>
+struct Vector<16> {
+  using scores = score_t __attribute__((vector_size(32)));
+  using scores_u = score_t __attribute__((vector_size(32), aligned(1), may_alias));
+  using trace = uint8_t __attribute__((vector_size(16)));
+  using trace_u = uint8_t __attribute__((vector_size(16), aligned(1), may_alias));
+};
+
+// Vector version of column_generic (the same recurrence on vectors of
+// lanes), with the native number of lanes per vector of the target: 8
+// (SSE2, the x86-64 baseline) or 16 (AVX2). The comparisons of wider
+// vectors are not vectorized.
+template <int width, bool dual>
+[[gnu::always_inline]] inline void column_vector(const LaneDP::Column &c, const LaneDP::Scores &scores) {
+  using vec = typename Vector<width>::scores;
+  using vec_u = typename Vector<width>::scores_u;
+  auto row = [](const score_t *p) { return reinterpret_cast<const vec_u *>(p); };
+  auto out = [](score_t *p) { return reinterpret_cast<vec_u *>(p); };
+  DPRecurrence<vec> s = scores.broadcast<vec>();    // Not aliased by the columns
+  s.dual = dual;
+  const vec base = vec{} + (score_t)c.base;
+  for (int k = 0; k < c.width; ++k) {
+    for (int l = 0; l < L; l += width) {
+      const int prev = (k + c.shift) * L + l, up = k * L + l, cur = (k + 1) * L + l;
+      const vec diff = *row(c.query + up) - base;
+      const vec mismatches = (diff | -diff) >> 15;    // All ones if the bases differ
+      // Unaligned loads (the recurrence takes aligned vectors)
+      const vec diag = *row(c.prev_h + prev) + (mismatches & s.mism);
+      const vec left_h = *row(c.prev_h + prev + L), left_i = *row(c.prev_i + prev + L);
+      const vec left_i2 = *row(c.prev_i2 + prev + L);
+      const vec up_h = *row(c.h + up), up_d = *row(c.d + up), up_d2 = *row(c.d2 + up);
+      vec h, i, d, i2, d2, trace;
+      s.horizontal(diag, left_h, left_i, left_i2, h, i, i2, trace);
+      s.vertical(up_h, up_d, up_d2, h, d, d2, trace);
+      *out(c.i + cur) = i;
+      *out(c.d + cur) = d;
+      *out(c.i2 + cur) = i2;
+      *out(c.d2 + cur) = d2;
+      *out(c.h + cur) = h;
+      *reinterpret_cast<typename Vector<width>::trace_u *>(c.trace + up) =
+          __builtin_convertvector(trace, typename Vector<width>::trace);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+template <bool dual>
+void column_baseline(const LaneDP::Column &column, const LaneDP::Scores &scores) {
+  column_vector<8, dual>(column, scores);
+}
+
+template <bool dual>
+__attribute__((target("avx2")))
+void column_avx2(const LaneDP::Column &column, const LaneDP::Scores &scores) {
+  column_vector<16, dual>(column, scores);
+}
+
+LaneDP::kernel_t select_kernel(bool dual) {
+  if (__builtin_cpu_supports("avx2")) {
+    return dual ? column_avx2<true> : column_avx2<false>;
+  }
+  return dual ? column_baseline<true> : column_baseline<false>;
+}
+
+#else
+
+LaneDP::kernel_t select_kernel(bool dual) {
+  return dual ? column_generic<true> : column_generic<false>;
+}
+
+#endif
+
+} // namespace
+
+
+LaneDP::LaneDP(const CSRGraph &graph, const InternalPenalties &penalties)
+    : _graph(&graph) {
+  const int max_penalty = std::max({penalties.mism(),
+                                    penalties.gapo() + penalties.gape(),
+                                    penalties.gapo2() + penalties.gape2()});
+  _scores = Scores(penalties, std::max(0, std::numeric_limits<score_t>::max() - max_penalty));
+  _kernel = select_kernel(_scores.dual);
+  _gapo = penalties.gapo();
+  _gapo2 = penalties.gapo2();
+}
+
+
+uint32_t LaneDP::align(std::span<const std::string_view> seqs,
+                       int start_vertex,
+                       int start_col,
+                       int band,
+                       std::span<Alignment> alignments) {
+
+  _seqs = seqs;
+  _num_seqs = std::min((int)seqs.size(), lanes);
+  int max_length = 0;
+  for (int l = 0; l < _num_seqs; ++l) {
+    max_length = std::max(max_length, (int)seqs[l].size());
+  }
+  _band = std::max(band, 0);
+  _width = std::min(2 * _band + 1, max_length + 1);
+  _max_lo = std::max(0, max_length + 1 - _width);
+
+  // Query bases: row r holds base r - 1 of each lane (0 outside the sequence,
+  // it never matches a graph base)
+  _query.assign((size_t)(max_length + 1) * L, 0);
+  for (int l = 0; l < _num_seqs; ++l) {
+    for (int r = 1; r <= (int)seqs[l].size(); ++r) {
+      _query[(size_t)r * L + l] = seqs[l][r - 1];
+    }
+  }
+  const size_t column_size = (size_t)(_width + 2) * L;
+  for (auto *column : {&_h, &_i, &_d, &_i2, &_d2, &_prev_h, &_prev_i, &_prev_i2}) {
+    column->assign(column_size, _scores.inf);
+  }
+  _end_score.assign(L, _scores.inf);
+  _end_unit.assign(L, 0);
+  _end_col.assign(L, 0);
+  _end_query.assign(L, 0);
+  _end_gap.assign(L, 0);
+  _end_state.assign(L, State::M);
+  _edge_score.assign(L, _scores.inf);
+  _entries.clear();
+  _los.clear();
+  _trace.clear();
+  _prov.clear();
+
+  _region.build(*_graph, start_vertex, start_col, max_length + _band);
+  _units.assign(_region.size(), {0, -1, -1});
+  for (int u : _region.order()) {
+    if (compute_unit(u)) {
+      for (int w : _region.successors(u)) {
+        merge_into(u, w);
+      }
+    }
+  }
+
+  uint32_t aligned = 0;
+  for (int l = 0; l < _num_seqs; ++l) {
+    if (_end_score[l] < _edge_score[l]) {
+      traceback(l, alignments[l]);
+      aligned |= 1u << l;
+    }
+  }
+  return aligned;
+}
+
+
+bool LaneDP::compute_unit(int u) {
+  const DPRegion::Unit &unit = _region.unit(u);
+  UnitData &data = _units[u];
+  const bool start = (u == 0);
+  auto entry = _entries.find(u);
+  if (!start && entry == _entries.end()) {
+    return false;   // Not reached (cycles)
+  }
+
+  const std::string text = _graph->sequence(unit.vertex);
+  const score_t inf = _scores.inf;
+  data.column = _los.size();
+  const int num_columns = unit.last - unit.first + 1;
+  _los.resize(_los.size() + num_columns);
+  _trace.resize(_trace.size() + (size_t)num_columns * _width * L);
+
+  // Entry column: start of the alignment or last columns of the
+  // predecessors, and the gaps of the query within it
+  int lo = window(unit.depth);
+  _los[data.column] = lo;
+  for (int k = 0; k < _width; ++k) {
+    score_t *h = _h.data() + (k + 1) * L, *d = _d.data() + (k + 1) * L, *d2 = _d2.data() + (k + 1) * L;
+    const score_t *up_h = _h.data() + k * L, *up_d = _d.data() + k * L, *up_d2 = _d2.data() + k * L;
+    uint8_t *trace = _trace.data() + ((size_t)data.column * _width + k) * L;
+    for (int l = 0; l < L; ++l) {
+      score_t m, t = FromEntry;
+      if (start) {
+        m = (lo + k == 0) ? 0 : inf;
+        _i[(k + 1) * L + l] = _i2[(k + 1) * L + l] = inf;
+      }
+      else {
+        m = entry->second.h[k * L + l];
+        _i[(k + 1) * L + l] = entry->second.i[k * L + l];
+        _i2[(k + 1) * L + l] = entry->second.i2[k * L + l];
+      }
+      _scores.vertical(up_h[l], up_d[l], up_d2[l], m, d[l], d2[l], t);
+      h[l] = m;
+      trace[l] = t;
+    }
+  }
+  if (!start) {
+    _entries.erase(entry);
+  }
+  check_ends(u, unit.first, lo);
+  check_edges(u, unit.first, lo);
+
+  for (int col = unit.first + 1; col <= unit.last; ++col) {
+    std::swap(_h, _prev_h);
+    std::swap(_i, _prev_i);
+    std::swap(_i2, _prev_i2);
+    const int64_t column = data.column + col - unit.first;
+    const int new_lo = window(unit.depth + col - unit.first);
+    _los[column] = new_lo;
+    _kernel({_prev_h.data(), _prev_i.data(), _prev_i2.data(),
+             _h.data(), _i.data(), _d.data(), _i2.data(), _d2.data(),
+             _trace.data() + (size_t)column * _width * L,
+             _query.data() + (size_t)new_lo * L,
+             _width, new_lo - lo, text[col - 1]}, _scores);
+    lo = new_lo;
+    check_ends(u, col, lo);
+    check_edges(u, col, lo);
+  }
+  return true;
+}
+
+
+void LaneDP::merge_into(int u, int w) {
+  const DPRegion::Unit &pred = _region.unit(u);
+  UnitData &unit = _units[w];
+  const int lo = _los[_units[u].column + pred.last - pred.first];
+  const int entry_lo = window(_region.unit(w).depth);
+  Entry &entry = _entries[w];
+  if (entry.h.empty()) {
+    for (auto *values : {&entry.h, &entry.i, &entry.i2}) {
+      values->assign((size_t)_width * L, _scores.inf);
+    }
+    unit.single_pred = u;
+  }
+
+  // The rows below the entry window are not merged
+  edge_rows(std::max(entry_lo + _width, lo), lo + _width - 1, lo, {_h.data(), _i.data(), _i2.data()});
+
+  auto set_prov = [&](int s, int k, int l) {
+    if (unit.single_pred == u) {
+      return;
+    }
+    if (unit.single_pred >= 0) {
+      unit.prov = _prov.size();
+      _prov.resize(_prov.size() + (size_t)3 * _width * L, unit.single_pred);
+      unit.single_pred = -1;
+    }
+    _prov[unit.prov + ((size_t)s * _width + k) * L + l] = u;
+  };
+  for (int k = 0; k < _width; ++k) {
+    const int pk = entry_lo + k - lo;   // Row of the last column of u
+    if (pk < 0 || pk >= _width) {
+      continue;
+    }
+    for (int l = 0; l < _num_seqs; ++l) {
+      const size_t cell = (size_t)k * L + l, pred_cell = (size_t)(pk + 1) * L + l;
+      if (_h[pred_cell] < entry.h[cell]) {
+        entry.h[cell] = _h[pred_cell];
+        set_prov(0, k, l);
+      }
+      if (_i[pred_cell] < entry.i[cell]) {
+        entry.i[cell] = _i[pred_cell];
+        set_prov(1, k, l);
+      }
+      if (_i2[pred_cell] < entry.i2[cell]) {
+        entry.i2[cell] = _i2[pred_cell];
+        set_prov(2, k, l);
+      }
+    }
+  }
+}
+
+
+void LaneDP::check_ends(int u, int col, int lo) {
+  const int hi = lo + _width - 1;
+  for (int l = 0; l < _num_seqs; ++l) {
+    const int m = _seqs[l].size();
+    if (m < lo) {
+      continue;
+    }
+    if (m <= hi) {
+      const int score = _h[(size_t)(m - lo + 1) * L + l];
+      if (score < _end_score[l]) {
+        _end_score[l] = score;
+        _end_unit[l] = u;
+        _end_col[l] = col;
+        _end_query[l] = m;
+        _end_gap[l] = 0;
+        _end_state[l] = State::M;
+      }
+      continue;
+    }
+
+    // The rest of the query (below the band) is a gap
+    const size_t cell = (size_t)_width * L + l;
+    const int len = m - hi;
+    int score = _h[cell] + _gapo + len * _scores.gape;
+    State state = State::M;
+    if (_scores.dual && _h[cell] + _gapo2 + len * _scores.gape2 < score) {
+      score = _h[cell] + _gapo2 + len * _scores.gape2;
+    }
+    if (_d[cell] + len * _scores.gape < score) {
+      score = _d[cell] + len * _scores.gape;
+      state = State::D;
+    }
+    if (_scores.dual && _d2[cell] + len * _scores.gape2 < score) {
+      score = _d2[cell] + len * _scores.gape2;
+      state = State::D2;
+    }
+    if (score < _end_score[l]) {
+      _end_score[l] = score;
+      _end_unit[l] = u;
+      _end_col[l] = col;
+      _end_query[l] = hi;
+      _end_gap[l] = len;
+      _end_state[l] = state;
+    }
+  }
+}
+
+
+void LaneDP::check_edges(int u, int col, int lo) {
+  const DPRegion::Unit &unit = _region.unit(u);
+  const int hi = lo + _width - 1;
+
+  // Moves to the next column: the rows above its window, or all of them
+  // when it is out of the region
+  if (col < unit.last) {
+    edge_rows(lo, window(unit.depth + col - unit.first + 1) - 1, lo, {_h.data(), _i.data(), _i2.data()});
+  }
+  else if (_region.truncated(u)) {
+    edge_rows(lo, hi, lo, {_h.data(), _i.data(), _i2.data()});
+  }
+
+  // Gaps of the query below the window
+  edge_rows(hi, hi, lo, {_h.data(), _d.data(), _d2.data()});
+}
+
+
+void LaneDP::edge_rows(int first, int last, int lo, std::initializer_list<const score_t *> values) {
+  for (int l = 0; l < _num_seqs; ++l) {
+    const int end = std::min(last, (int)_seqs[l].size() - 1);
+    for (int r = first; r <= end; ++r) {
+      for (const score_t *matrix : values) {
+        _edge_score[l] = std::min<int>(_edge_score[l], matrix[(size_t)(r - lo + 1) * L + l]);
+      }
+    }
+  }
+}
+
+
+void LaneDP::traceback(int lane, Alignment &alignment) {
+  alignment.edit_op.assign(_end_gap[lane], 'D');
+  alignment.path.clear();
+  alignment.end_offset = _end_col[lane];
+  alignment.query_end = _end_query[lane] + _end_gap[lane];
+
+  const std::string_view seq = _seqs[lane];
+  int u = _end_unit[lane], col = _end_col[lane], r = _end_query[lane];
+  State state = _end_state[lane];
+  std::string text = _graph->sequence(_region.unit(u).vertex);
+  alignment.path.push_back(_region.unit(u).vertex);
+  while (true) {
+    const DPRegion::Unit &unit = _region.unit(u);
+    const int64_t column = _units[u].column + col - unit.first;
+    const int k = r - _los[column];
+    const uint8_t trace = _trace[((size_t)column * _width + k) * L + lane];
+    const bool from_entry = (state == State::M && (trace & SourceMask) == FromEntry);
+
+    // Start of the alignment
+    if (u == 0 && from_entry) {
+      break;
+    }
+
+    // Jump to the predecessor (the entry cells of M, I and I2 are those of
+    // its last column)
+    if (col == unit.first && (from_entry || state == State::I || state == State::I2)) {
+      int pred = _units[u].single_pred;
+      if (pred < 0) {
+        int s = (state == State::M) ? 0 : (state == State::I) ? 1 : 2;
+        pred = _prov[_units[u].prov + ((size_t)s * _width + k) * L + lane];
+      }
+      u = pred;
+      col = _region.unit(u).last;
+      text = _graph->sequence(_region.unit(u).vertex);
+      alignment.path.push_back(_region.unit(u).vertex);
+      continue;
+    }
+
+    switch (state) {
+      case State::M:
+        switch (trace & SourceMask) {
+          case FromDiag:
+            alignment.edit_op.push_back((seq[r - 1] == text[col - 1]) ? 'M' : 'X');
+            r -= 1;
+            col -= 1;
+            break;
+          case FromI: state = State::I; break;
+          case FromD: state = State::D; break;
+          case FromI2: state = State::I2; break;
+          default: state = State::D2; break;
+        }
+        break;
+      case State::I:
+        alignment.edit_op.push_back('I');
+        state = (trace & ExtendI) ? State::I : State::M;
+        col -= 1;
+        break;
+      case State::I2:
+        alignment.edit_op.push_back('I');
+        state = (trace & ExtendI2) ? State::I2 : State::M;
+        col -= 1;
+        break;
+      case State::D:
+        alignment.edit_op.push_back('D');
+        state = (trace & ExtendD) ? State::D : State::M;
+        r -= 1;
+        break;
+      case State::D2:
+        alignment.edit_op.push_back('D');
+        state = (trace & ExtendD2) ? State::D2 : State::M;
+        r -= 1;
+        break;
+    }
+  }
+
+  alignment.start_offset = col;
+  alignment.query_start = r;
+  std::reverse(alignment.edit_op.begin(), alignment.edit_op.end());
+  std::reverse(alignment.path.begin(), alignment.path.end());
+}
+
+} // namespace theseus
@@ -0,0 +1,196 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "theseus/alignment.h"
+
+#include "banded_dp.h"
+#include "csr_graph.h"
+#include "internal_penalties.h"
+
+/**
+ * Banded DP of several sequences with the same starting position, computed
+ * in lockstep: the cells of the sequences are interleaved in SIMD lanes and
+ * each column of the graph is computed once for all of them (inter-sequence
+ * vectorization). Used for the short queries of align_batch (see
+ * LockstepBatching).
+ *
+ * The DP is the one of BandedDP (the same DPRecurrence, with M, I and D
+ * matrices, and I2, D2 with dual affine gaps), but all the lanes share the
+ * window of each column: the "2*band + 1" query offsets around the diagonal
+ * of the column (its distance to the start, see DPRegion). The scores are
+ * 16-bit integers. A lane is only aligned if its alignment is optimal: it
+ * scores less than every cell with a move out of the band, which any
+ * alignment leaving the band goes through (and it fits in 16 bits).
+ *
+ */
+
+namespace theseus {
+
+class LaneDP {
+public:
+    static constexpr int lanes = 16;
+
+    /**
+     * @brief Construct a new Lane DP object. The column kernel is selected
+     * for the running CPU (AVX2 or the x86-64 baseline).
+     *
+     * @param graph
+     * @param penalties     Internal penalties (zero match penalty)
+     */
+    LaneDP(const CSRGraph &graph, const InternalPenalties &penalties);
+
+    /**
+     * @brief Align (at most "lanes") sequences from the same starting
+     * position. The whole sequences are aligned and the alignments may end
+     * anywhere in the graph.
+     *
+     * @param seqs
+     * @param start_vertex
+     * @param start_col
+     * @param band          Half width of the band (query offsets)
+     * @param alignments    Alignment of each sequence (edit operations, path
+     *                      and offsets; the score is not set)
+     * @return uint32_t     Mask of the aligned sequences (those whose
+     *                      alignment is optimal, see check_edges)
+     */
+    uint32_t align(std::span<const std::string_view> seqs,
+                   int start_vertex,
+                   int start_col,
+                   int band,
+                   std::span<Alignment> alignments);
+
+    using score_t = int16_t;
+
+    /**
+     * @brief Arguments of the column kernel. The arrays have one row of
+     * "lanes" cells per query offset of the window, plus an unreachable row
+     * before and after it.
+     *
+     */
+    struct Column {
+        const score_t *prev_h, *prev_i, *prev_i2;   // Previous column
+        score_t *h, *i, *d, *i2, *d2;
+        uint8_t *trace;
+        const score_t *query;   // Query bases of the rows (lanes interleaved)
+        int width;
+        int shift;              // First row of the column minus the one of the previous column
+        char base;              // Graph base of the column
+    };
+
+    // Recurrence of the cells (that of BandedDP, with the unreachable score)
+    using Scores = DPRecurrence<score_t>;
+
+    using kernel_t = void (*)(const Column &column, const Scores &scores);
+
+private:
+    enum class State : uint8_t { M, I, D, I2, D2 };
+
+    struct UnitData {
+        int64_t column;     // Index of the first column in _los (and of its cells in _trace)
+        int single_pred;    // Predecessor of all the entry cells (-1 if several, see _prov)
+        int prov;           // Index of the entry predecessors in _prov (H, I and I2 per cell)
+    };
+
+    struct Entry {
+        std::vector<score_t> h, i, i2;
+    };
+
+    /**
+     * @brief First query offset of the window of a column.
+     *
+     * @param depth     Graph bases from the start to the column
+     * @return int
+     */
+    int window(int depth) const {
+        return std::clamp(depth - _band, 0, _max_lo);
+    }
+
+    bool compute_unit(int u);
+    void merge_into(int u, int w);
+    void check_ends(int u, int col, int lo);
+
+    /**
+     * @brief Keep the best score of the cells of a column with a move out of
+     * the band (or out of the region): the alignments that leave the band
+     * score at least as much, so the alignment of a lane is optimal if it
+     * scores less.
+     *
+     * @param u
+     * @param col
+     * @param lo
+     */
+    void check_edges(int u, int col, int lo);
+
+    /**
+     * @brief Keep the best score of the rows of a column within [first, last]
+     * of each lane (the rows from its query size on are the ends).
+     *
+     * @param first
+     * @param last
+     * @param lo        First query offset of the column
+     * @param values    Matrices of the column
+     */
+    void edge_rows(int first, int last, int lo, std::initializer_list<const score_t *> values);
+    void traceback(int lane, Alignment &alignment);
+
+    const CSRGraph *_graph;
+    kernel_t _kernel;
+    Scores _scores;
+    score_t _gapo, _gapo2;
+    int _band = 0, _width = 0, _max_lo = 0;
+    int _num_seqs = 0;
+    std::span<const std::string_view> _seqs;
+
+    DPRegion _region;
+    std::vector<UnitData> _units;
+    std::unordered_map<int, Entry> _entries;         // Entries of the units not yet computed
+    std::vector<score_t> _query;                     // Query bases (one row per offset, lanes interleaved)
+    std::vector<int> _los;                           // First query offset of each column
+    std::vector<uint8_t> _trace;                     // Traceback of each cell
+    std::vector<int> _prov;                          // Entry predecessors (units with several)
+
+    // Current and previous columns (with the unreachable rows)
+    std::vector<score_t> _h, _i, _d, _i2, _d2;
+    std::vector<score_t> _prev_h, _prev_i, _prev_i2;
+
+    // Best end cell of each lane and best cell with a move out of the band
+    std::vector<int> _end_score, _end_unit, _end_col, _end_query, _end_gap;
+    std::vector<int> _edge_score;
+    std::vector<State> _end_state;
+};
+
+} // namespace theseus
@@ -0,0 +1,199 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <initializer_list>
+
+#include "lcp.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define THESEUS_LCP_X86 1
+#include <immintrin.h>
+#else
+#define THESEUS_LCP_X86 0
+#endif
+
+namespace theseus {
+
+namespace lcp {
+
+int lcp_scalar(const char *seq_1, const char *seq_2, int max_len) {
+    int len = 0;
+    while (len < max_len && seq_1[len] == seq_2[len]) {
+        ++len;
+    }
+    return len;
+}
+
+#if THESEUS_LCP_X86
+
+int lcp_sse2(const char *seq_1, const char *seq_2, int max_len) {
+    int len = 0;
+
+    // Compare blocks of 16 characters
+    while (len + 16 <= max_len) {
+        __m128i block_1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(seq_1 + len));
+        __m128i block_2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(seq_2 + len));
+        uint32_t neq_mask = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block_1, block_2))) & 0xFFFFu;
+        if (neq_mask != 0) {
+            return len + __builtin_ctz(neq_mask);
+        }
+        len += 16;
+    }
+
+    // Remaining characters
+    return len + lcp_scalar(seq_1 + len, seq_2 + len, max_len - len);
+}
+
+__attribute__((target("avx2")))
+int lcp_avx2(const char *seq_1, const char *seq_2, int max_len) {
+    int len = 0;
+
+    // Compare blocks of 32 characters
+    while (len + 32 <= max_len) {
+        __m256i block_1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(seq_1 + len));
+        __m256i block_2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(seq_2 + len));
+        uint32_t neq_mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block_1, block_2)));
+        if (neq_mask != 0) {
+            return len + __builtin_ctz(neq_mask);
+        }
+        len += 32;
+    }
+
+    // Remaining characters (less than 32)
+    return len + lcp_sse2(seq_1 + len, seq_2 + len, max_len - len);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int lcp_avx512(const char *seq_1, const char *seq_2, int max_len) {
+    int len = 0;
+
+    // Compare blocks of 64 characters
+    while (len + 64 <= max_len) {
+        __m512i block_1 = _mm512_loadu_si512(seq_1 + len);
+        __m512i block_2 = _mm512_loadu_si512(seq_2 + len);
+        __mmask64 neq_mask = _mm512_cmpneq_epi8_mask(block_1, block_2);
+        if (neq_mask != 0) {
+            return len + __builtin_ctzll(neq_mask);
+        }
+        len += 64;
+    }
+
+    // Remaining characters with masked loads (never reads past max_len)
+    int rem = max_len - len;
+    if (rem > 0) {
+        __mmask64 load_mask = (~0ULL) >> (64 - rem);
+        __m512i block_1 = _mm512_maskz_loadu_epi8(load_mask, seq_1 + len);
+        __m512i block_2 = _mm512_maskz_loadu_epi8(load_mask, seq_2 + len);
+        __mmask64 neq_mask = _mm512_mask_cmpneq_epi8_mask(load_mask, block_1, block_2);
+        len += (neq_mask != 0) ? __builtin_ctzll(neq_mask) : rem;
+    }
+
+    return len;
+}
+
+bool is_supported(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Scalar:
+        case Kernel::SSE2:
+            return true;    // Part of the x86-64 baseline
+        case Kernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case Kernel::AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    }
+    return false;
+}
+
+#else
+
+// Non x86 architectures only provide the scalar kernel.
+int lcp_sse2(const char *seq_1, const char *seq_2, int max_len) {
+    return lcp_scalar(seq_1, seq_2, max_len);
+}
+
+int lcp_avx2(const char *seq_1, const char *seq_2, int max_len) {
+    return lcp_scalar(seq_1, seq_2, max_len);
+}
+
+int lcp_avx512(const char *seq_1, const char *seq_2, int max_len) {
+    return lcp_scalar(seq_1, seq_2, max_len);
+}
+
+bool is_supported(Kernel kernel) {
+    return kernel == Kernel::Scalar;
+}
+
+#endif
+
+kernel_t get_kernel(Kernel kernel) {
+    if (!is_supported(kernel)) {
+        return lcp_scalar;
+    }
+
+    switch (kernel) {
+        case Kernel::SSE2:
+            return lcp_sse2;
+        case Kernel::AVX2:
+            return lcp_avx2;
+        case Kernel::AVX512:
+            return lcp_avx512;
+        default:
+            return lcp_scalar;
+    }
+}
+
+Kernel best_kernel() {
+    static const Kernel best = []() {
+        for (Kernel kernel : {Kernel::AVX512, Kernel::AVX2, Kernel::SSE2}) {
+            if (is_supported(kernel)) {
+                return kernel;
+            }
+        }
+        return Kernel::Scalar;
+    }();
+    return best;
+}
+
+const char *kernel_name(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Scalar:
+            return "scalar";
+        case Kernel::SSE2:
+            return "sse2";
+        case Kernel::AVX2:
+            return "avx2";
+        case Kernel::AVX512:
+            return "avx512";
+    }
+    return "unknown";
+}
+
+} // namespace lcp
+
+} // namespace theseus
@@ -0,0 +1,131 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Longest Common Prefix (LCP) kernels used to extend the wavefront diagonals.
+ * Several implementations are provided: a portable scalar loop and vectorized
+ * versions (SSE2, AVX2 and AVX-512BW) that compare 16, 32 or 64 characters per
+ * step and locate the first mismatch with a movemask and a count trailing zeros.
+ *
+ * The best kernel supported by the running CPU is selected at runtime. The
+ * scalar kernel is always available and is used as the fallback.
+ *
+ */
+
+namespace theseus {
+
+namespace lcp {
+
+/**
+ * @brief Signature of an LCP kernel. Returns the number of leading characters
+ * that are equal in both sequences, never reading more than max_len characters
+ * from any of them.
+ *
+ */
+using kernel_t = int (*)(const char *seq_1, const char *seq_2, int max_len);
+
+/**
+ * @brief Available LCP implementations.
+ *
+ */
+enum class Kernel : int8_t {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+/**
+ * @brief Character-by-character LCP.
+ *
+ * @param seq_1
+ * @param seq_2
+ * @param max_len   Maximum number of characters to compare
+ * @return int      Length of the longest common prefix
+ */
+int lcp_scalar(const char *seq_1, const char *seq_2, int max_len);
+
+/**
+ * @brief 16 characters per step LCP (requires SSE2).
+ *
+ */
+int lcp_sse2(const char *seq_1, const char *seq_2, int max_len);
+
+/**
+ * @brief 32 characters per step LCP (requires AVX2).
+ *
+ */
+int lcp_avx2(const char *seq_1, const char *seq_2, int max_len);
+
+/**
+ * @brief 64 characters per step LCP (requires AVX-512BW).
+ *
+ */
+int lcp_avx512(const char *seq_1, const char *seq_2, int max_len);
+
+/**
+ * @brief Check whether a given kernel can run on the current CPU.
+ *
+ * @param kernel
+ * @return bool
+ */
+bool is_supported(Kernel kernel);
+
+/**
+ * @brief Get the function implementing a given kernel. If the kernel is not
+ * supported by the current CPU, the scalar kernel is returned instead.
+ *
+ * @param kernel
+ * @return kernel_t
+ */
+kernel_t get_kernel(Kernel kernel);
+
+/**
+ * @brief Get the fastest kernel supported by the current CPU. The detection
+ * is only performed once.
+ *
+ * @return Kernel
+ */
+Kernel best_kernel();
+
+/**
+ * @brief Get the name of a kernel (for reporting purposes).
+ *
+ * @param kernel
+ * @return const char*
+ */
+const char *kernel_name(Kernel kernel);
+
+} // namespace lcp
+
+} // namespace theseus
@@ -0,0 +1,125 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <algorithm>
+
+#include "packed_sequence.h"
+
+namespace theseus {
+
+void PackedSequence::assign(std::string_view seq) {
+    clear();
+    append(seq);
+}
+
+
+void PackedSequence::append(std::string_view seq) {
+    const int64_t new_size = _size + seq.size();
+    _words.resize((new_size + bases_per_word - 1) / bases_per_word, 0);
+
+    for (int64_t l = 0; l < (int64_t)seq.size(); ++l) {
+        const int64_t pos = _size + l;
+        uint8_t code = encode(seq[l]);
+        if (code > 3) {
+            _exceptions.push_back({pos, seq[l]});
+            code = 0;
+        }
+        _words[pos / bases_per_word] |= (word_t)code << (2 * (pos % bases_per_word));
+    }
+    _size = new_size;
+}
+
+
+char PackedSequence::at(int64_t pos) const {
+    static constexpr char bases[4] = {'A', 'C', 'G', 'T'};
+
+    // Check if the position is an exception
+    auto it = std::lower_bound(_exceptions.begin(), _exceptions.end(), pos,
+                               [](const Exception &e, int64_t p) { return e.pos < p; });
+    if (it != _exceptions.end() && it->pos == pos) {
+        return it->value;
+    }
+    return bases[(_words[pos / bases_per_word] >> (2 * (pos % bases_per_word))) & 3];
+}
+
+
+std::string PackedSequence::substr(int64_t pos, int64_t len) const {
+    std::string seq(len, 'A');
+    for (int64_t l = 0; l < len; ++l) {
+        seq[l] = at(pos + l);
+    }
+    return seq;
+}
+
+
+int64_t PackedSequence::next_exception(int64_t pos) const {
+    auto it = std::lower_bound(_exceptions.begin(), _exceptions.end(), pos,
+                               [](const Exception &e, int64_t p) { return e.pos < p; });
+    return (it == _exceptions.end()) ? _size : it->pos;
+}
+
+
+int packed_lcp(const PackedSequence &seq_1,
+               int64_t pos_1,
+               const PackedSequence &seq_2,
+               int64_t pos_2,
+               int max_len) {
+
+    int len = 0;
+    while (len < max_len) {
+        // Compare word by word until the next exception of any of the sequences
+        const int64_t exc_1 = seq_1.next_exception(pos_1 + len) - pos_1;
+        const int64_t exc_2 = seq_2.next_exception(pos_2 + len) - pos_2;
+        const int clean_end = std::min<int64_t>({max_len, exc_1, exc_2});
+
+        while (len < clean_end) {
+            PackedSequence::word_t diff = seq_1.word_at(pos_1 + len) ^ seq_2.word_at(pos_2 + len);
+            const int rem = clean_end - len;
+            if (rem < PackedSequence::bases_per_word) {
+                diff &= (PackedSequence::word_t(1) << (2 * rem)) - 1; // Ignore bases out of range
+            }
+            if (diff != 0) {
+                return len + __builtin_ctzll(diff) / 2;
+            }
+            len += std::min(rem, PackedSequence::bases_per_word);
+        }
+
+        // Compare the exception (if any) character by character
+        if (len < max_len) {
+            if (seq_1.at(pos_1 + len) != seq_2.at(pos_2 + len)) {
+                return len;
+            }
+            len += 1;
+        }
+    }
+
+    return len;
+}
+
+} // namespace theseus
@@ -0,0 +1,211 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * DNA sequence stored with 2 bits per base (A=0, C=1, G=2, T=3), 32 bases per
+ * 64-bit word. Characters other than uppercase A, C, G and T (N, IUPAC codes,
+ * lowercase bases...) are stored in a sorted exception list together with their
+ * original value, so that the sequence can always be recovered exactly.
+ *
+ * The packed representation reduces the memory used by the sequences about
+ * 4x and allows to compute LCPs 32 bases at a time (see packed_lcp).
+ *
+ */
+
+namespace theseus {
+
+class PackedSequence {
+public:
+    using word_t = uint64_t;
+
+    static constexpr int bases_per_word = 32;
+
+    /**
+     * @brief A non-ACGT character of the sequence.
+     *
+     */
+    struct Exception {
+        int64_t pos;    // Position in the sequence
+        char value;     // Original character
+    };
+
+    PackedSequence() = default;
+
+    /**
+     * @brief Construct a new Packed Sequence object from a plain sequence.
+     *
+     * @param seq
+     */
+    PackedSequence(std::string_view seq) {
+        assign(seq);
+    }
+
+    /**
+     * @brief Replace the contents of the packed sequence by "seq". The already
+     * allocated memory is reused.
+     *
+     * @param seq
+     */
+    void assign(std::string_view seq);
+
+    /**
+     * @brief Append a plain sequence at the end of the packed sequence.
+     *
+     * @param seq
+     */
+    void append(std::string_view seq);
+
+    /**
+     * @brief Remove all the bases of the sequence.
+     *
+     */
+    void clear() {
+        _words.clear();
+        _exceptions.clear();
+        _size = 0;
+    }
+
+    /**
+     * @brief Number of bases of the sequence.
+     *
+     * @return int64_t
+     */
+    int64_t size() const {
+        return _size;
+    }
+
+    /**
+     * @brief Get the character at position "pos".
+     *
+     * @param pos
+     * @return char
+     */
+    char at(int64_t pos) const;
+
+    /**
+     * @brief Unpack the characters in the range [pos, pos + len).
+     *
+     * @param pos
+     * @param len
+     * @return std::string
+     */
+    std::string substr(int64_t pos, int64_t len) const;
+
+    /**
+     * @brief Get the 32 bases starting at position "pos" (which does not need
+     * to be word aligned). Bases beyond the end of the sequence are set to 0.
+     *
+     * @param pos
+     * @return word_t
+     */
+    word_t word_at(int64_t pos) const {
+        const int64_t w = pos / bases_per_word;
+        const int shift = 2 * (pos % bases_per_word);
+        word_t word = _words[w] >> shift;
+        if (shift != 0 && w + 1 < (int64_t)_words.size()) {
+            word |= _words[w + 1] << (64 - shift);
+        }
+        return word;
+    }
+
+    /**
+     * @brief Position of the first exception at or after "pos". If there is
+     * none, the size of the sequence is returned.
+     *
+     * @param pos
+     * @return int64_t
+     */
+    int64_t next_exception(int64_t pos) const;
+
+    /**
+     * @brief Number of exceptions (non-ACGT characters) of the sequence.
+     *
+     * @return int64_t
+     */
+    int64_t num_exceptions() const {
+        return _exceptions.size();
+    }
+
+    /**
+     * @brief Memory used by the packed sequence (in bytes).
+     *
+     * @return size_t
+     */
+    size_t memory_usage() const {
+        return _words.capacity() * sizeof(word_t) + _exceptions.capacity() * sizeof(Exception);
+    }
+
+    /**
+     * @brief Get the 2-bit code of a character. Non-ACGT characters get code 4.
+     *
+     * @param c
+     * @return uint8_t
+     */
+    static uint8_t encode(char c) {
+        switch (c) {
+            case 'A': return 0;
+            case 'C': return 1;
+            case 'G': return 2;
+            case 'T': return 3;
+            default: return 4;
+        }
+    }
+
+private:
+    std::vector<word_t> _words;
+    std::vector<Exception> _exceptions;
+    int64_t _size = 0;
+};
+
+/**
+ * @brief Longest Common Prefix between seq_1[pos_1...] and seq_2[pos_2...],
+ * comparing (up to) 32 bases per step with a XOR and a count trailing zeros.
+ * Stretches containing exceptions are compared character by character.
+ *
+ * @param seq_1
+ * @param pos_1
+ * @param seq_2
+ * @param pos_2
+ * @param max_len   Maximum number of bases to compare
+ * @return int      Length of the longest common prefix
+ */
+int packed_lcp(const PackedSequence &seq_1,
+               int64_t pos_1,
+               const PackedSequence &seq_2,
+               int64_t pos_2,
+               int max_len);
+
+} // namespace theseus
@@ -29,6 +29,7 @@
 #pragma once
 
 #include "cell.h"
+#include <algorithm>
 #include <vector>
 
 /**
@@ -61,17 +62,29 @@ public:
      * @brief Construct a new Scope object
      *
      * @param nscores Number of scores in the scope
+     * @param init_capacity Initial capacity of the waves
      */
-    Scope(int nscores) {
+    Scope(int nscores, int init_capacity = 1024) {
         _squeue.realloc(nscores);
 
         for (int i = 0; i < nscores; i++) {
-            constexpr int init_capacity = 1024;
             ScoreData sd(init_capacity);
             _squeue.push_back(std::move(sd));
         }
     }
 
+    /**
+     * @brief Copy the waves of another scope with the same number of scores
+     * (e.g., to save or restore a snapshot). The allocated memory is reused.
+     *
+     * @param other
+     */
+    void assign(const Scope &other) {
+        for (int i = 0; i < _squeue.size(); ++i) {
+            _squeue[i].assign(other._squeue[i]);
+        }
+    }
+
     /**
      * @brief Restore data for a new alignment.
      *
@@ -142,6 +155,50 @@ public:
         return _squeue[score%_squeue.size()]._d2_wf;
     }
 
+    /**
+     * @brief Get the data from the wavefront M of score "score". Only used when
+     * the backtrace is not stored (otherwise, M cells live beyond the scope).
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &m_wf(int score) {
+        return _squeue[score%_squeue.size()]._m_wf;
+    }
+
+    /**
+     * @brief Get the data from the M jumps of score "score". Only used when
+     * the backtrace is not stored.
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &m_jumps_wf(int score) {
+        return _squeue[score%_squeue.size()]._m_jumps_wf;
+    }
+
+    /**
+     * @brief Get the data from the I jumps of score "score". Only used when
+     * the backtrace is not stored.
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &i_jumps_wf(int score) {
+        return _squeue[score%_squeue.size()]._i_jumps_wf;
+    }
+
+    /**
+     * @brief Get the data from the I2 jumps of score "score". Only used when
+     * the backtrace is not stored.
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &i2_jumps_wf(int score) {
+        return _squeue[score%_squeue.size()]._i2_jumps_wf;
+    }
+
     /**
      * @brief Get the data from the vector of M positions at score "score".
      *
@@ -205,6 +262,12 @@ private:
         Cell::CellVector _i2_wf;
         Cell::CellVector _d2_wf;
 
+        // Cells kept in the scope when the backtrace is not stored
+        Cell::CellVector _m_wf;
+        Cell::CellVector _m_jumps_wf;
+        Cell::CellVector _i_jumps_wf;
+        Cell::CellVector _i2_jumps_wf;
+
         RangeVector _m_pos;
 
         RangeVector _i_pos;
@@ -218,6 +281,10 @@ private:
             _d_wf.realloc(capacity);
             _i2_wf.realloc(capacity);
             _d2_wf.realloc(capacity);
+            _m_wf.realloc(capacity);
+            _m_jumps_wf.realloc(capacity);
+            _i_jumps_wf.realloc(capacity);
+            _i2_jumps_wf.realloc(capacity);
 
             _m_pos.realloc(capacity);
             _i_pos.realloc(capacity);
@@ -229,6 +296,10 @@ private:
             _d_wf.set_realloc_policy(realloc_policy);
             _i2_wf.set_realloc_policy(realloc_policy);
             _d2_wf.set_realloc_policy(realloc_policy);
+            _m_wf.set_realloc_policy(realloc_policy);
+            _m_jumps_wf.set_realloc_policy(realloc_policy);
+            _i_jumps_wf.set_realloc_policy(realloc_policy);
+            _i2_jumps_wf.set_realloc_policy(realloc_policy);
 
             _m_pos.set_realloc_policy(realloc_policy);
             _i_pos.set_realloc_policy(realloc_policy);
@@ -237,11 +308,36 @@ private:
             _d2_pos.set_realloc_policy(realloc_policy);
         }
 
+        void assign(const ScoreData &other) {
+            auto copy = [](auto &dst, const auto &src) {
+                dst.resize(src.size());
+                std::copy(src.begin(), src.end(), dst.begin());
+            };
+            copy(_i_wf, other._i_wf);
+            copy(_d_wf, other._d_wf);
+            copy(_i2_wf, other._i2_wf);
+            copy(_d2_wf, other._d2_wf);
+            copy(_m_wf, other._m_wf);
+            copy(_m_jumps_wf, other._m_jumps_wf);
+            copy(_i_jumps_wf, other._i_jumps_wf);
+            copy(_i2_jumps_wf, other._i2_jumps_wf);
+
+            copy(_m_pos, other._m_pos);
+            copy(_i_pos, other._i_pos);
+            copy(_i2_pos, other._i2_pos);
+            copy(_d_pos, other._d_pos);
+            copy(_d2_pos, other._d2_pos);
+        }
+
         void resize(int new_size) {
             _i_wf.resize(new_size);
             _d_wf.resize(new_size);
             _i2_wf.resize(new_size);
             _d2_wf.resize(new_size);
+            _m_wf.resize(new_size);
+            _m_jumps_wf.resize(new_size);
+            _i_jumps_wf.resize(new_size);
+            _i2_jumps_wf.resize(new_size);
 
             _m_pos.resize(new_size);
             _i_pos.resize(new_size);
@@ -26,17 +26,29 @@
  */
 
 
+#include <stdexcept>
+#include <thread>
+
 #include "theseus/theseus_aligner.h"
 
+#include "batch_aligner.h"
 #include "theseus_aligner_impl.h"
 
 namespace theseus {
 
 TheseusAligner::TheseusAligner(const Penalties &penalties,
-                               std::istream &gfa_stream)
+                               std::istream &gfa_stream,
+                               bool packed_sequences)
+    : TheseusAligner(penalties, TheseusGraph(gfa_stream, packed_sequences)) {}
+
+
+TheseusAligner::TheseusAligner(const Penalties &penalties,
+                               const TheseusGraph &graph)
+    : graph_(graph),
+      penalties_(penalties),
+      num_threads_(std::max(1u, std::thread::hardware_concurrency()))
 {
-    Graph graph(gfa_stream);
-    aligner_impl_ = std::make_unique<TheseusAlignerImpl>(penalties, std::move(graph), false);
+    aligner_impl_ = std::make_unique<TheseusAlignerImpl>(penalties, graph.graph_);
 }
 
 
@@ -60,10 +72,169 @@ void TheseusAligner::print_alignment_as_gaf(
  */
 Alignment TheseusAligner::align(
     std::string_view seq,
-    std::string &start_node,
+    const std::string &start_node,
     int start_offset) {
 
     return aligner_impl_->align(seq, start_node, start_offset);
 }
 
+
+Alignment TheseusAligner::align(
+    std::string_view seq,
+    std::span<const StartPosition> starts) {
+
+    return aligner_impl_->align(seq, starts);
+}
+
+
+std::optional<int> TheseusAligner::verify(
+    std::string_view seq,
+    const std::string &start_node,
+    int start_offset,
+    int max_score) {
+
+    if (penalties_.match() != 0) {
+        throw std::invalid_argument("Verification requires a zero match penalty.");
+    }
+    return aligner_impl_->verify(seq, start_node, start_offset, max_score);
+}
+
+
+Alignment TheseusAligner::extend(
+    std::string_view seq,
+    int query_pos,
+    const std::string &anchor_node,
+    int anchor_offset) {
+
+    return aligner_impl_->extend(seq, query_pos, anchor_node, anchor_offset);
+}
+
+
+void TheseusAligner::set_memory_mode(MemoryMode mode) {
+    memory_mode_ = mode;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::set_alignment_scope(AlignmentScope scope) {
+    if (scope == AlignmentScope::ScoreOnly && penalties_.match() != 0) {
+        throw std::invalid_argument("The score-only alignment scope requires a zero match penalty.");
+    }
+    alignment_scope_ = scope;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::set_wavefront_reduction(const WavefrontReduction &reduction) {
+    reduction_ = reduction;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::set_early_termination(const EarlyTermination &termination) {
+    termination_ = termination;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::set_ends_free(const EndsFree &ends_free) {
+    ends_free_ = ends_free;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::set_dp_fallback(const DPFallback &fallback) {
+    dp_fallback_ = fallback;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::set_lockstep_batching(const LockstepBatching &lockstep) {
+    lockstep_ = lockstep;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::set_astar_pruning(bool enabled) {
+    astar_pruning_ = enabled;
+    configure(*aligner_impl_);
+    if (batch_aligner_) {
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+}
+
+
+void TheseusAligner::configure(TheseusAlignerImpl &aligner_impl) const {
+    aligner_impl.set_memory_mode(memory_mode_);
+    aligner_impl.set_alignment_scope(alignment_scope_);
+    aligner_impl.set_wavefront_reduction(reduction_);
+    aligner_impl.set_early_termination(termination_);
+    aligner_impl.set_ends_free(ends_free_);
+    aligner_impl.set_dp_fallback(dp_fallback_);
+    aligner_impl.set_lockstep_batching(lockstep_);
+    aligner_impl.set_astar_pruning(astar_pruning_);
+}
+
+
+void TheseusAligner::set_num_threads(int num_threads) {
+    num_threads_ = std::max(num_threads, 1);
+}
+
+
+void TheseusAligner::set_prefix_sharing(bool enabled) {
+    prefix_sharing_ = enabled;
+}
+
+
+std::vector<Alignment> TheseusAligner::align_batch(std::span<const Query> queries) {
+    std::vector<Alignment> alignments(queries.size());
+    align_batch(queries, [&alignments](size_t idx, Alignment &alignment) {
+        alignments[idx] = std::move(alignment);
+    });
+    return alignments;
+}
+
+
+void TheseusAligner::align_batch(
+    std::span<const Query> queries,
+    const std::function<void(size_t, Alignment &)> &callback) {
+
+    // The workers (and their workspaces) are kept between batches
+    if (!batch_aligner_ || batch_aligner_->num_threads() != num_threads_) {
+        batch_aligner_.reset();
+        batch_aligner_ = std::make_unique<BatchAligner>(penalties_, graph_.graph_, num_threads_);
+        batch_aligner_->configure([this](TheseusAlignerImpl &impl) { configure(impl); });
+    }
+    if (lockstep_.enabled) {
+        batch_aligner_->align_lockstep(queries, lockstep_.max_length, callback);
+    }
+    else if (prefix_sharing_) {
+        batch_aligner_->align_shared_prefixes(queries, callback);
+    }
+    else {
+        batch_aligner_->align(queries, callback);
+    }
+}
+
 } // namespace theseus
\ No newline at end of file
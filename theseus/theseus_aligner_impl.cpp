@@ -26,41 +26,74 @@
  */
 
 
+#include <limits>
+#include <stdexcept>
 #include <string_view>
+#include <unordered_set>
 #include "theseus_aligner_impl.h"
+#include "gfa_graph.h"
 
 namespace theseus {
 
 TheseusAlignerImpl::TheseusAlignerImpl(const Penalties &penalties,
                                        Graph &&graph,
                                        bool msa) : _penalties(penalties),
-                                                          _graph(std::move(graph)),
-                                                          _is_msa(msa),
-                                                          _internal_penalties(penalties) {
-    // TODO: Gap-linear and dual affine-gap.
+                                                          _internal_penalties(penalties),
+                                                          _is_msa(msa) {
+    // Only the MSA modifies the graph. Otherwise, the CSR graph is enough.
+    if (_is_msa) {
+      _msa_graph = std::move(graph);
+      _msa_csr_graph = std::make_shared<CSRGraph>(_msa_graph);
+      _graph = _msa_csr_graph;
+    }
+    else {
+      _graph = std::make_shared<const CSRGraph>(graph);
+    }
+    init();
+}
+
+TheseusAlignerImpl::TheseusAlignerImpl(const Penalties &penalties,
+                                       std::shared_ptr<const CSRGraph> graph) : _penalties(penalties),
+                                                                                _internal_penalties(penalties),
+                                                                                _graph(std::move(graph)),
+                                                                                _is_msa(false) {
+    init();
+}
+
+void TheseusAlignerImpl::init() {
     const auto n_scores = std::max({_internal_penalties.gapo() +_internal_penalties.gape(),
-                                  _internal_penalties.gapo() +_internal_penalties.gape(),
+                                  _internal_penalties.gapo2() +_internal_penalties.gape2(),
                                   _internal_penalties.mism()}) + 1;
 
     if (_is_msa) {
       _poa_graph = std::make_unique<POAGraph>();
-      _poa_graph->create_initial_graph(_graph);
+      _poa_graph->create_initial_graph(_msa_graph);
     }
 
-    _internal_penalties = InternalPenalties(penalties);
     _scope = std::make_unique<Scope>(n_scores);
     _beyond_scope = std::make_unique<BeyondScope>();
     constexpr int expected_nvertices = std::max(1024, 0); // TODO: Set the expected number of vertices
-    _vertices_data = std::make_unique<VerticesData>(penalties, n_scores, expected_nvertices);
+    _vertices_data = std::make_unique<VerticesData>(_penalties, n_scores, expected_nvertices);
+    _vertices_data->reserve_vertices(_graph->num_vertices());
     _scratchpad = std::make_unique<ScratchPad>(-1024, 1024);
-}
+    _reduction_cutoffs.assign(n_scores, -1);
+  _xdrop_values.assign(n_scores, std::numeric_limits<int64_t>::min());
+    _lcp_kernel = lcp::get_kernel(lcp::best_kernel());
 
-void TheseusAlignerImpl::new_alignment() {
-    int max_diag = 0, v_n;
-    for (int l = 0; l < _graph._vertices.size(); ++l) {
-      v_n = _graph._vertices[l].value.size();
-      max_diag = std::max(max_diag, v_n);
+    // Linear gaps are computed with the M matrix only
+    if (_internal_penalties.type() == Penalties::Type::Linear) {
+      _compute_new_wave = &TheseusAlignerImpl::compute_new_wave<Penalties::Type::Linear>;
+    }
+    else if (_internal_penalties.type() == Penalties::Type::DualAffine) {
+      _compute_new_wave = &TheseusAlignerImpl::compute_new_wave<Penalties::Type::DualAffine>;
     }
+    else {
+      _compute_new_wave = &TheseusAlignerImpl::compute_new_wave<Penalties::Type::Affine>;
+    }
+}
+
+void TheseusAlignerImpl::fit_scratchpad() {
+    const int max_diag = _graph->max_length();   // Cached when the graph is built
     const int min_diag = -_seq.size();
 
     if (_scratchpad->max_diag() < max_diag ||
@@ -68,21 +101,40 @@ void TheseusAlignerImpl::new_alignment() {
         // TODO: Compute the max and min with a factor.
         _scratchpad = std::make_unique<ScratchPad>(min_diag, max_diag);
     }
+}
+
+void TheseusAlignerImpl::new_alignment() {
+    fit_scratchpad();
 
     // Set data for first score
     _scope->new_score(_score);
 
-    // TODO: Allow for different initial conditions. Now only global alignment.
-    Cell init_condition;
-    init_condition.offset = 0;
-    init_condition.vertex_id = _start_node;
-    init_condition.diag = _start_offset;
-    init_condition.prev_pos = -1;
-
-    // Initial vertex data
-    _beyond_scope->m_jumps_wf().push_back(init_condition);
-    _vertices_data->activate_vertex(_start_node);
-    _vertices_data->get_vertex_data(_start_node)._m_jumps_positions[0].push_back(0);
+    // Initial conditions: the starting positions and, in passes with a free
+    // end, the positions skipping the free leading query and graph bases.
+    // The initial cells keep the index of their starting position in
+    // prev_pos (-1 - index).
+    for (int l = 0; l < (int)_starts.size(); ++l) {
+        const GraphPos &start = _starts[l];
+        int query_begin = 0, graph_begin = 0;
+        if (_target_vertex < 0) {
+            query_begin = std::clamp(_ends_free.query_begin, 0, (int)_seq.size());
+            graph_begin = std::clamp(_ends_free.graph_begin, 0, _graph->length(start.vertex) - start.col);
+        }
+        Cell init_condition;
+        init_condition.vertex_id = start.vertex;
+        init_condition.prev_pos = -1 - l;
+
+        // Initial vertex data
+        _vertices_data->activate_vertex(start.vertex);
+        auto &start_positions = _vertices_data->get_vertex_data(start.vertex)._m_jumps_positions[0];
+        for (int k = -graph_begin; k <= query_begin; ++k) {
+            init_condition.offset = std::max(k, 0);
+            init_condition.diag = start.col - k;
+            start_positions.push_back(m_jumps_wf(0).size());
+            m_jumps_wf(0).push_back(init_condition);
+        }
+    }
+    _num_start_cells = m_jumps_wf(0).size();
 
     // Alignment data
     _alignment.path.clear();
@@ -91,27 +143,40 @@ void TheseusAlignerImpl::new_alignment() {
 
 
 // Process a given vertex with a given _score
-void TheseusAlignerImpl::process_vertex(Graph::vertex* curr_v,
-                                        int v) {
+template <Penalties::Type gap_type>
+void TheseusAlignerImpl::process_vertex(int v) {
 
   // Perform the next operation
-  int upper_bound = curr_v->value.size();
-  next_I(curr_v, upper_bound, v);
-  _scratchpad->reset();
-  next_D(upper_bound, v);
-  _scratchpad->reset();
-  next_M(upper_bound, v);
-  _scratchpad->reset();
+  int upper_bound = _graph->length(v);
+  if constexpr (gap_type == Penalties::Type::Linear) {
+    next_M_linear(upper_bound, v);
+    _scratchpad->reset();
+  }
+  else {
+    next_I(upper_bound, v);
+    _scratchpad->reset();
+    next_D(upper_bound, v);
+    _scratchpad->reset();
+    if constexpr (gap_type == Penalties::Type::DualAffine) {
+      next_I2(upper_bound, v);
+      _scratchpad->reset();
+      next_D2(upper_bound, v);
+      _scratchpad->reset();
+    }
+    next_M<gap_type>(upper_bound, v);
+    _scratchpad->reset();
+  }
 
   // Perform the extend operations
   int v_pos = _vertices_data->get_id(v);
   Scope::range cells_range = _scope->m_pos(_score)[v_pos];
   for (Cell::pos_t idx = cells_range.start; idx < cells_range.end; ++idx) {
-    extend_diagonal(curr_v, _beyond_scope->m_wf()[idx], v, _beyond_scope->m_wf()[idx], idx, Cell::Matrix::M);
+    extend_diagonal(m_wf(_score)[idx], v, m_wf(_score)[idx], idx, Cell::Matrix::M);
   }
 }
 
 
+template <Penalties::Type gap_type>
 void TheseusAlignerImpl::compute_new_wave() {
 
   // Update invalid segments
@@ -122,49 +187,744 @@ void TheseusAlignerImpl::compute_new_wave() {
   int num_active_vertices = _vertices_data->num_active_vertices(), v;
   for (int l = 0; l < num_active_vertices; ++l) {
     v = _vertices_data->get_vertex_id(l);
-    Graph::vertex* curr_v = &_graph._vertices[v];
-    process_vertex(curr_v, v);
+
+    // Vertices without live cells in the scope (wavefront reduction) produce
+    // no cells, so they only get empty ranges
+    if ((_reduction.enabled || _astar_bound >= 0) &&
+        _score - _vertices_data->get_vertex_data_by_idx(l)._last_live_score >= _scope->size()) {
+      Cell::pos_t m_size = m_wf(_score).size(), i_size = _scope->i_wf(_score).size(), d_size = _scope->d_wf(_score).size();
+      _scope->m_pos(_score).push_back({m_size, m_size});
+      _scope->i_pos(_score).push_back({i_size, i_size});
+      _scope->d_pos(_score).push_back({d_size, d_size});
+      if constexpr (gap_type == Penalties::Type::DualAffine) {
+        Cell::pos_t i2_size = _scope->i2_wf(_score).size(), d2_size = _scope->d2_wf(_score).size();
+        _scope->i2_pos(_score).push_back({i2_size, i2_size});
+        _scope->d2_pos(_score).push_back({d2_size, d2_size});
+      }
+      continue;
+    }
+    process_vertex<gap_type>(v);
   }
 }
 
 
 Alignment TheseusAlignerImpl::align(
     std::string_view seq,
-    std::string &start_node,
+    const std::string &start_node,
     int start_offset)
+{
+  GraphPos start{0, 0};
+  if (!_is_msa) {
+    start = {_graph->get_id(start_node), start_offset};
+  }
+  return align_from(seq, std::span<const GraphPos>(&start, 1));
+}
+
+
+Alignment TheseusAlignerImpl::align(
+    std::string_view seq,
+    std::span<const StartPosition> starts)
+{
+  if (starts.empty()) {
+    throw std::invalid_argument("At least one starting position is required");
+  }
+  std::vector<GraphPos> start_positions;
+  for (const auto &start : starts) {
+    start_positions.push_back({_graph->get_id(start.node), start.offset});
+  }
+  return align_from(seq, start_positions);
+}
+
+
+Alignment TheseusAlignerImpl::align_from(
+    std::string_view seq,
+    std::span<const GraphPos> starts)
+{
+  int target_vertex = -1, target_col = 0;
+  _pruned_cells = 0;
+  if (_is_msa) {
+    _msa_csr_graph->build(_msa_graph);   // The MSA graph changes after each alignment
+    _vertices_data->reserve_vertices(_graph->num_vertices());
+    _end_vertex = 2; // TODO: Set the end vertex
+    target_vertex = _end_vertex;
+    target_col = _graph->length(_end_vertex);
+  }
+
+  // Perfect match (most reads of a good sample)
+  if (!_is_msa && exact_match(seq, starts)) {
+    return _alignment;
+  }
+
+  // Sequence to sequence alignment (the alignment never leaves the vertex)
+  if (use_pairwise(starts)) {
+    bool score_only = (_alignment_scope == AlignmentScope::ScoreOnly);
+    start_pass(seq, starts, -1, 0, !score_only);
+    compute_pairwise_waves();
+    if (_backtrace_overflow) {
+      return overflow_result(seq, starts);
+    }
+    _score -= 1;
+    return (score_only) ? score_only_result(starts) : full_result();
+  }
+
+  // Only the optimal score and end position
+  if (_alignment_scope == AlignmentScope::ScoreOnly && !_is_msa) {
+    score_only_pass(seq, starts);
+    return score_only_result(starts);
+  }
+
+  // Low memory mode (falls back to the default mode if it can not be used)
+  if (_memory_mode == MemoryMode::Low && !_is_msa && starts.size() == 1 &&
+      align_bidirectional(seq, starts[0].vertex, starts[0].col)) {
+    return bidirectional_result(_memory_fallback);
+  }
+
+  // Find the optimal _score and an optimal alignment (or give up for the
+  // banded DP if the sequence is too divergent)
+  start_pass(seq, starts, target_vertex, target_col, true);
+  compute_waves(fallback_score(starts), !_is_msa);
+  if (_backtrace_overflow) {
+    return overflow_result(seq, starts);
+  }
+  if (!_end && _status == AlignmentStatus::Aligned) {
+    return fallback_result(starts);
+  }
+  _score -= 1;
+  return full_result();
+}
+
+
+bool TheseusAlignerImpl::exact_match(
+    std::string_view seq,
+    std::span<const GraphPos> starts)
+{
+  const int end_offset = (int)seq.size() - std::clamp(_ends_free.query_end, 0, (int)seq.size());
+  if (_graph->is_packed()) {
+    _packed_seq.assign(seq);
+  }
+
+  // The search visits the cells of score 0 in the same order as the
+  // extension of the wavefronts (depth-first, following the out-edges in
+  // order). A diagonal of a vertex that has already jumped to its
+  // neighbours is not visited again, and the ends are chosen as in
+  // check_end_condition, so that both find the same alignment.
+  std::vector<ExactMatchStep> &stack = _exact_match_stack;
+  stack.clear();
+  for (int l = (int)starts.size() - 1; l >= 0; --l) {
+    // Starting cells (with the free leading query and graph bases)
+    int query_begin = std::clamp(_ends_free.query_begin, 0, (int)seq.size());
+    int graph_begin = std::clamp(_ends_free.graph_begin, 0, _graph->length(starts[l].vertex) - starts[l].col);
+    for (int k = query_begin; k >= -graph_begin; --k) {
+      int col = starts[l].col - std::min(k, 0);
+      stack.push_back({starts[l].vertex, col, std::max(k, 0), 0, l, col, std::max(k, 0)});
+    }
+  }
+
+  std::vector<int> &path = _exact_match_path, &end_path = _exact_match_end_path;
+  auto &jumped = _exact_match_jumped;
+  path.clear();
+  end_path.clear();
+  jumped.clear();
+  ExactMatchStep end_step;
+  int end_col = -1, end_offset_reached = 0;
+  int failures = 0, furthest_offset = -1;
+  while (!stack.empty()) {
+    ExactMatchStep step = stack.back();
+    stack.pop_back();
+    int diag = step.col - step.offset;
+    if (step.depth > 0 && jumped.count(((int64_t)step.vertex << 32) | (uint32_t)diag)) {
+      continue;
+    }
+    path.resize(step.depth);
+    path.push_back(step.vertex);
+
+    int offset = step.offset, j = step.col;
+    LCP(seq, step.vertex, offset, j);
+    if (offset >= end_offset &&
+        (end_col < 0 || step.vertex != end_path.back() || offset > end_offset_reached ||
+         (offset == end_offset_reached && diag >= end_col - end_offset_reached))) {
+      end_path = path;
+      end_step = step;
+      end_col = j;
+      end_offset_reached = offset;
+    }
+
+    // Jump to the neighbours, or a mismatch (or a vertex without bases to
+    // match)
+    if (j == _graph->length(step.vertex)) {
+      jumped.insert(((int64_t)step.vertex << 32) | (uint32_t)diag);
+      auto edges = _graph->out_edges(step.vertex);
+      for (auto it = edges.rbegin(); it != edges.rend(); ++it) {
+        stack.push_back({it->vertex, it->overlap, offset, step.depth + 1,
+                         step.start, step.start_col, step.query_start});
+      }
+    }
+    // Dead ends (a mismatch, or no base matched) only count while the
+    // search does not get further in the query, so that a long read with a
+    // dead branch at every bubble is still searched. Once an end is found,
+    // the rest of the search only picks among perfect matches, and the
+    // branches left in the stack no longer count.
+    if (offset > furthest_offset) {
+      furthest_offset = offset;
+      failures = 0;
+    }
+    if (end_col < 0 && (j < _graph->length(step.vertex) || offset == step.offset)) {
+      failures += 1;
+      if (failures > exact_match_max_failures) {
+        return false;
+      }
+    }
+  }
+  if (end_col < 0) {
+    return false;
+  }
+
+  // Optimal alignment (score 0)
+  _seq = seq;
+  _alignment.start_offset = end_step.start_col;
+  _alignment.start_index = end_step.start;
+  _alignment.query_start = end_step.query_start;
+  if (_alignment_scope == AlignmentScope::ScoreOnly) {
+    _alignment.path.assign(1, end_path.back());
+    _alignment.edit_op.clear();
+    _alignment.start_offset = starts[0].col;
+    _alignment.start_index = (starts.size() == 1) ? 0 : -1;
+    _alignment.query_start = 0;
+  }
+  else {
+    _alignment.path = end_path;
+    _alignment.edit_op.assign(end_offset_reached - end_step.query_start, 'M');
+  }
+  _alignment.end_offset = end_col;
+  _alignment.query_end = end_offset_reached;
+  _alignment.score = (_alignment_scope == AlignmentScope::ScoreOnly) ?
+                     0 : _alignment.compute_affine_gap_score(_penalties);
+  _alignment.pruned_cells = 0;
+  _alignment.status = AlignmentStatus::Aligned;
+  _alignment.memory_fallback = false;
+  return true;
+}
+
+
+Alignment TheseusAlignerImpl::score_only_result(std::span<const GraphPos> starts)
+{
+  if (_status != AlignmentStatus::Aligned) {
+    _start_pos = _best_cell;
+    _score = _best_score;
+  }
+  _alignment.path.assign(1, _start_pos.vertex_id);
+  _alignment.start_offset = starts[0].col;   // The start is not known (ends-free, multiple starts)
+  _alignment.start_index = (starts.size() == 1) ? 0 : -1;
+  _alignment.query_start = 0;
+  _alignment.end_offset = _start_pos.diag + _start_pos.offset;
+  _alignment.score = _score;  // Internal and user penalties are the same (no match penalty)
+  _alignment.pruned_cells = _pruned_cells;
+  _alignment.status = _status;
+  _alignment.query_end = _start_pos.offset;
+  _alignment.memory_fallback = false;
+  return _alignment;
+}
+
+
+int TheseusAlignerImpl::fallback_score(std::span<const GraphPos> starts) const
+{
+  if (_dp_fallback.score_threshold < 0 || _is_msa || starts.size() != 1 ||
+      _alignment_scope != AlignmentScope::Full) {
+    return std::numeric_limits<int>::max();
+  }
+  return _dp_fallback.score_threshold;
+}
+
+
+Alignment TheseusAlignerImpl::fallback_result(std::span<const GraphPos> starts)
+{
+  if (!_banded_dp) {
+    _banded_dp = std::make_unique<BandedDP>(*_graph, _internal_penalties);
+  }
+  _banded_dp->align(_seq, starts[0].vertex, starts[0].col, _dp_fallback.band, _ends_free, _alignment);
+  _alignment.start_index = 0;
+  _alignment.score = _alignment.compute_affine_gap_score(_penalties);
+  _alignment.pruned_cells = _pruned_cells;
+  _alignment.status = AlignmentStatus::Aligned;
+  _alignment.memory_fallback = false;
+  return _alignment;
+}
+
+
+// The cells stored for the backtrace do not fit in the cell positions (see
+// backtrace_fits): the alignment is computed again in low memory mode, or
+// with the banded DP if that mode can not be used
+Alignment TheseusAlignerImpl::overflow_result(
+    std::string_view seq,
+    std::span<const GraphPos> starts)
+{
+  // Multiple starts: each one on its own, keeping the best alignment
+  if (starts.size() > 1) {
+    Alignment best;
+    for (int l = 0; l < (int)starts.size(); ++l) {
+      Alignment alignment = align_from(seq, starts.subspan(l, 1));
+      bool aligned = (alignment.status == AlignmentStatus::Aligned);
+      bool best_aligned = (best.status == AlignmentStatus::Aligned);
+      if (l == 0 || aligned > best_aligned || (aligned == best_aligned && alignment.score < best.score)) {
+        best = std::move(alignment);
+        best.start_index = l;
+      }
+    }
+    best.memory_fallback = true;
+    _seq = seq;
+    _alignment = best;
+    return best;
+  }
+
+  int target_vertex = (_is_msa) ? _end_vertex : -1;
+  int target_col = (_is_msa) ? _graph->length(_end_vertex) : 0;
+  if (align_bidirectional(seq, starts[0].vertex, starts[0].col, target_vertex, target_col)) {
+    return bidirectional_result(true);
+  }
+  if (_is_msa) {
+    throw std::length_error("The backtrace of the alignment does not fit in the "
+                            "cell positions.");
+  }
+  _seq = seq;
+  fallback_result(starts);
+  _alignment.memory_fallback = true;
+  return _alignment;
+}
+
+
+Alignment TheseusAlignerImpl::bidirectional_result(bool memory_fallback)
+{
+  _alignment.score = _alignment.compute_affine_gap_score(_penalties);
+  _alignment.pruned_cells = _pruned_cells;
+  _alignment.status = _status;
+  _alignment.query_end = _start_pos.offset;
+  _alignment.memory_fallback = memory_fallback;
+
+  // Update the graph in case of MSA
+  if (_is_msa) {
+    _seq_ID += 1;
+    _poa_graph->add_alignment_poa(_msa_graph, _alignment, _seq, _seq_ID);
+  }
+  return _alignment;
+}
+
+
+Alignment TheseusAlignerImpl::full_result()
+{
+  // Terminated early: best partial alignment
+  if (_status != AlignmentStatus::Aligned) {
+    _start_pos = _best_cell;
+    _score = _best_score;
+  }
+
+  // Backtrace
+  _seq_ID += 1;
+  backtrace(0);
+  _alignment.score = _alignment.compute_affine_gap_score(_penalties);
+  _alignment.pruned_cells = _pruned_cells;
+  _alignment.status = _status;
+  _alignment.query_end = _start_pos.offset;
+  _alignment.memory_fallback = (_memory_mode == MemoryMode::Low && !_is_msa);
+
+  // Update the graph in case of MSA
+  if (_is_msa) {
+      _poa_graph->add_alignment_poa(_msa_graph, _alignment, _seq, _seq_ID);
+  }
+
+  return _alignment;
+}
+
+
+std::optional<int> TheseusAlignerImpl::verify(
+    std::string_view seq,
+    const std::string &start_node,
+    int start_offset,
+    int max_score)
+{
+  _pruned_cells = 0;
+  start_pass(seq, _graph->get_id(start_node), start_offset, -1, 0, false);
+  compute_waves(max_score);
+  if (!_end) {
+    return std::nullopt;
+  }
+  return _score - 1;
+}
+
+
+Alignment TheseusAlignerImpl::extend(
+    std::string_view seq,
+    int query_pos,
+    const std::string &anchor_node,
+    int anchor_offset)
+{
+  if (query_pos < 0 || (size_t)query_pos > seq.size()) {
+    throw std::out_of_range("Anchor query position out of the sequence");
+  }
+  int anchor_vertex = _graph->get_id(anchor_node);
+  int reverse_anchor = _graph->reverse_vertex(anchor_vertex);
+
+  // The free ends of the query are the prefix end of the left half and the
+  // suffix end of the right half. The setting of the aligner is restored when
+  // done, even if an alignment throws.
+  const EndsFree ends_free = _ends_free;
+  struct EndsFreeGuard {
+    EndsFree &current;
+    EndsFree saved;
+    ~EndsFreeGuard() { current = saved; }
+  } ends_free_guard{_ends_free, ends_free};
+
+  // Left half: reverse complement of the prefix on the opposite strand
+  std::string left_seq = reverse_complement(std::string(seq.substr(0, query_pos)));
+  _ends_free = {0, ends_free.query_begin, 0};
+  Alignment left = align(left_seq, std::string(_graph->name(reverse_anchor)),
+                         _graph->length(anchor_vertex) - anchor_offset);
+
+  // Right half: suffix from the anchor
+  _ends_free = {0, ends_free.query_end, 0};
+  Alignment right = align(seq.substr(query_pos), anchor_node, anchor_offset);
+
+  // Join the halves. The left one is mirrored back to the forward strand and
+  // its last vertex (the anchor) is the first one of the right half.
+  Alignment alignment;
+  for (auto it = left.path.rbegin(); it != left.path.rend(); ++it) {
+    alignment.path.push_back(_graph->reverse_vertex(*it));
+  }
+  alignment.start_offset = _graph->length(left.path.back()) - left.end_offset;
+  alignment.edit_op.assign(left.edit_op.rbegin(), left.edit_op.rend());
+  int first = (right.path.front() == alignment.path.back()) ? 1 : 0;
+  alignment.path.insert(alignment.path.end(), right.path.begin() + first, right.path.end());
+  alignment.edit_op.insert(alignment.edit_op.end(), right.edit_op.begin(), right.edit_op.end());
+  alignment.end_offset = right.end_offset;
+  alignment.query_start = query_pos - left.query_end;
+  alignment.query_end = query_pos + right.query_end;
+  alignment.score = (_alignment_scope == AlignmentScope::ScoreOnly) ?
+                    left.score + right.score : alignment.compute_affine_gap_score(_penalties);
+  alignment.pruned_cells = left.pruned_cells + right.pruned_cells;
+  alignment.status = (left.status != AlignmentStatus::Aligned) ? left.status : right.status;
+  alignment.memory_fallback = left.memory_fallback || right.memory_fallback;
+
+  // Data of the whole alignment (used by the output functions)
+  _seq = seq;
+  _alignment = alignment;
+  return alignment;
+}
+
+
+void TheseusAlignerImpl::align_shared_prefixes(
+    std::span<const std::string_view> seqs,
+    const std::string &start_node,
+    int start_offset,
+    const std::function<void(size_t, Alignment &)> &callback)
+{
+  // The waves of a prefix depend on the whole sequence (A* lower bound, MSA)
+  // or are computed in several passes (low memory)
+  if (_is_msa || _astar_pruning || _memory_mode == MemoryMode::Low) {
+    for (size_t i = 0; i < seqs.size(); ++i) {
+      Alignment alignment = align(seqs[i], start_node, start_offset);
+      callback(i, alignment);
+    }
+    return;
+  }
+  GraphPos start{_graph->get_id(start_node), start_offset};
+  std::span<const GraphPos> starts(&start, 1);
+  const bool store_backtrace = (_alignment_scope == AlignmentScope::Full);
+
+  // Prefix shared by each pair of consecutive sequences. The waves of the
+  // prefix must not reach the (ends-free) end of any of them.
+  auto end_offset = [this](std::string_view seq) {
+    return (int)seq.size() - std::clamp(_ends_free.query_end, 0, (int)seq.size());
+  };
+  std::vector<int> shared(seqs.size(), 0);
+  for (size_t i = 0; i + 1 < seqs.size(); ++i) {
+    auto mismatch = std::mismatch(seqs[i].begin(), seqs[i].end(), seqs[i + 1].begin(), seqs[i + 1].end());
+    shared[i] = std::min({(int)(mismatch.first - seqs[i].begin()),
+                          end_offset(seqs[i]),
+                          end_offset(seqs[i + 1])});
+  }
+
+  _num_prefix_snapshots = 0;
+  for (size_t i = 0; i < seqs.size(); ++i) {
+    // Drop the snapshots that need a longer prefix than the one shared with
+    // the previous sequence (the next ones share even less, as they are
+    // sorted) and resume from the deepest remaining one
+    int prev_shared = (i > 0) ? shared[i - 1] : 0;
+    while (_num_prefix_snapshots > 0 &&
+           _prefix_snapshots[_num_prefix_snapshots - 1]->min_prefix > prev_shared) {
+      _num_prefix_snapshots -= 1;
+    }
+    _pruned_cells = 0;
+    if (exact_match(seqs[i], starts)) {
+      callback(i, _alignment);
+      continue;
+    }
+    int resumed_prefix = 0;
+    if (_num_prefix_snapshots > 0) {
+      const PrefixSnapshot &snapshot = *_prefix_snapshots[_num_prefix_snapshots - 1];
+      resume_pass(seqs[i], snapshot);
+      resumed_prefix = snapshot.min_prefix;
+    }
+    else {
+      start_pass(seqs[i], starts, -1, 0, store_backtrace);
+    }
+
+    // Prefixes shared with the next sequences that are longer than the
+    // resumed one
+    _prefix_levels.clear();
+    int level = std::numeric_limits<int>::max();
+    for (size_t k = i; k + 1 < seqs.size(); ++k) {
+      level = std::min(level, shared[k]);
+      if (level <= resumed_prefix) {
+        break;
+      }
+      if (_prefix_levels.empty() || level < _prefix_levels.back()) {
+        _prefix_levels.push_back(level);
+      }
+    }
+    std::reverse(_prefix_levels.begin(), _prefix_levels.end());
+    _next_prefix_level = 0;
+    _prefix_candidate = false;
+
+    compute_waves(fallback_score(starts), true);
+    _score -= 1;
+    _prefix_levels.clear();
+
+    // The snapshots refer to the cells stored for the backtrace, which the
+    // alignment in low memory mode discards
+    if (_backtrace_overflow) {
+      _num_prefix_snapshots = 0;
+      Alignment alignment = overflow_result(seqs[i], starts);
+      callback(i, alignment);
+      continue;
+    }
+    Alignment alignment = (!_end && _status == AlignmentStatus::Aligned) ? fallback_result(starts) :
+                          (store_backtrace) ? full_result() : score_only_result(starts);
+    callback(i, alignment);
+  }
+  _num_prefix_snapshots = 0;
+}
+
+
+void TheseusAlignerImpl::align_lockstep(
+    std::span<const std::string_view> seqs,
+    const std::string &start_node,
+    int start_offset,
+    const std::function<void(size_t, Alignment &)> &callback)
+{
+  GraphPos start{0, 0};
+  if (!_is_msa) {
+    start = {_graph->get_id(start_node), start_offset};
+  }
+  std::span<const GraphPos> starts(&start, 1);
+
+  // The lane DP aligns the whole sequences with the full alignment (the
+  // other cases are aligned with the wavefronts)
+  const bool use_lanes = !_is_msa && _alignment_scope == AlignmentScope::Full &&
+                         _termination.max_score < 0 && _termination.xdrop < 0 &&
+                         _ends_free.query_begin <= 0 && _ends_free.query_end <= 0 &&
+                         _ends_free.graph_begin <= 0;
+  if (use_lanes && !_lane_dp) {
+    _lane_dp = std::make_unique<LaneDP>(*_graph, _internal_penalties);
+  }
+
+  // Groups of short sequences (the rest is aligned as they are found)
+  std::vector<size_t> group;
+  std::vector<std::string_view> group_seqs;
+  _lane_alignments.resize(LaneDP::lanes);
+  auto align_group = [&]() {
+    size_t max_length = 0;
+    for (size_t i : group) {
+      max_length = std::max(max_length, seqs[i].size());
+    }
+
+    // The lanes whose alignment is not proven optimal are aligned again with
+    // twice the band, and with the wavefronts once it covers the queries
+    for (int band = _lockstep.band; !group.empty(); band *= 2) {
+      const bool last = ((size_t)band >= max_length);
+      group_seqs.clear();
+      for (size_t i : group) {
+        group_seqs.push_back(seqs[i]);
+      }
+      uint32_t aligned = _lane_dp->align(group_seqs, start.vertex, start.col,
+                                         band, _lane_alignments);
+      size_t pending = 0;
+      for (size_t l = 0; l < group.size(); ++l) {
+        if (!(aligned & (1u << l))) {
+          if (!last) {
+            group[pending++] = group[l];
+            continue;
+          }
+          Alignment alignment = align_from(seqs[group[l]], starts);
+          callback(group[l], alignment);
+          continue;
+        }
+        Alignment &alignment = _lane_alignments[l];
+        alignment.start_index = 0;
+        alignment.score = alignment.compute_affine_gap_score(_penalties);
+        alignment.pruned_cells = 0;
+        alignment.status = AlignmentStatus::Aligned;
+        alignment.memory_fallback = false;
+        _seq = seqs[group[l]];
+        _alignment = alignment;
+        callback(group[l], alignment);
+      }
+      group.resize(pending);
+    }
+    group_seqs.clear();
+  };
+
+  for (size_t i = 0; i < seqs.size(); ++i) {
+    if (!use_lanes || (int)seqs[i].size() > _lockstep.max_length) {
+      Alignment alignment = align_from(seqs[i], starts);
+      callback(i, alignment);
+      continue;
+    }
+    _pruned_cells = 0;
+    if (exact_match(seqs[i], starts)) {
+      callback(i, _alignment);
+      continue;
+    }
+    group.push_back(i);
+    if (group.size() == LaneDP::lanes) {
+      align_group();
+    }
+  }
+  if (!group.empty()) {
+    align_group();
+  }
+}
+
+
+void TheseusAlignerImpl::set_memory_mode(MemoryMode mode) {
+  _memory_mode = mode;
+}
+
+
+void TheseusAlignerImpl::set_alignment_scope(AlignmentScope scope) {
+  _alignment_scope = scope;
+}
+
+
+void TheseusAlignerImpl::set_wavefront_reduction(const WavefrontReduction &reduction) {
+  _reduction = reduction;
+}
+
+
+void TheseusAlignerImpl::set_early_termination(const EarlyTermination &termination) {
+  _termination = termination;
+}
+
+
+void TheseusAlignerImpl::set_ends_free(const EndsFree &ends_free) {
+  _ends_free = ends_free;
+}
+
+
+void TheseusAlignerImpl::set_dp_fallback(const DPFallback &fallback) {
+  _dp_fallback = fallback;
+}
+
+
+void TheseusAlignerImpl::set_lockstep_batching(const LockstepBatching &lockstep) {
+  _lockstep = lockstep;
+}
+
+
+void TheseusAlignerImpl::set_astar_pruning(bool enabled) {
+  _astar_pruning = enabled && !_is_msa;
+  if (_astar_pruning && !_max_remaining) {
+    _max_remaining = &_graph->max_remaining_lengths();
+  }
+}
+
+
+// Initialize the data structures for a new pass of the wavefront algorithm
+void TheseusAlignerImpl::start_pass(std::string_view seq,
+                                    int start_vertex,
+                                    int start_offset,
+                                    int target_vertex,
+                                    int target_col,
+                                    bool store_backtrace)
+{
+  GraphPos start{start_vertex, start_offset};
+  start_pass(seq, std::span<const GraphPos>(&start, 1), target_vertex, target_col, store_backtrace);
+}
+
+
+void TheseusAlignerImpl::start_pass(std::string_view seq,
+                                    std::span<const GraphPos> starts,
+                                    int target_vertex,
+                                    int target_col,
+                                    bool store_backtrace)
 {
   _scope->new_alignment();
   _beyond_scope->new_alignment();
   _vertices_data->new_alignment();
   _seq = seq;
-
-  if (_is_msa) {
-    _start_node = 0;
-    _start_offset = 0;
+  if (_graph->is_packed()) {
+    _packed_seq.assign(seq);
   }
-  else {
-    _start_node = _graph.get_id(start_node);
-    _start_offset = start_offset;
+
+  _starts.assign(starts.begin(), starts.end());
+  _target_vertex = target_vertex;
+  _target_col = target_col;
+  _end_offset = seq.size();
+  if (target_vertex < 0) {
+    _end_offset -= std::clamp(_ends_free.query_end, 0, (int)seq.size());
   }
+  _store_backtrace = store_backtrace;
+  _backtrace_overflow = false;
+  std::fill(_reduction_cutoffs.begin(), _reduction_cutoffs.end(), -1);
+  _score = 0;
+  _end = false;
+  _status = AlignmentStatus::Aligned;
+  _best_value = std::numeric_limits<int64_t>::min();
+  _last_live_wave = 0;
+  _max_extended_offset = 0;
+  std::fill(_xdrop_values.begin(), _xdrop_values.end(), std::numeric_limits<int64_t>::min());
 
   // Initialize data for the new alignment
   new_alignment();
+}
 
-  // TODO: Set initial conditions
-  _score = 0;
-  _end_vertex = 2; // TODO: Set the end vertex
-  _end = false;
-  // _graph.print_code_graphviz();
 
-  // Find the optimal _score and an optimal alignment
-  while (!_end)
+// Compute waves until the end condition is met or max_score is exceeded
+void TheseusAlignerImpl::compute_waves(int max_score, bool early_termination) {
+  // Score bound of the A* pruning (passes with a free end)
+  _astar_bound = -1;
+  if (_astar_pruning && _target_vertex < 0) {
+    if (max_score < std::numeric_limits<int>::max()) {
+      _astar_bound = max_score;
+    }
+    if (early_termination && _termination.max_score >= 0 &&
+        (_astar_bound < 0 || _termination.max_score < _astar_bound)) {
+      _astar_bound = _termination.max_score;
+    }
+  }
+  early_termination = early_termination && (_termination.max_score >= 0 || _termination.xdrop >= 0);
+  while (!_end && _score <= max_score && _status == AlignmentStatus::Aligned)
   {
+    if (_next_prefix_level < _prefix_levels.size()) {
+      track_prefix_snapshots();
+    }
+
     // Compute the values of the new wave
     // Initial extend
     if (_score == 0) {
-      extend_diagonal(&_graph._vertices[_start_node], _beyond_scope->m_jumps_wf()[0], _start_node, _beyond_scope->m_jumps_wf()[0], 0, Cell::Matrix::MJumps);
+      for (int l = 0; l < _num_start_cells; ++l) {
+        extend_diagonal(m_jumps_wf(0)[l], m_jumps_wf(0)[l].vertex_id, m_jumps_wf(0)[l], l, Cell::Matrix::MJumps);
+      }
+    }
+    (this->*_compute_new_wave)();
+    if (_store_backtrace && !backtrace_fits()) {
+      _backtrace_overflow = true;
+      break;
+    }
+    if (_reduction.enabled || _astar_bound >= 0) {
+      prune_wavefront();
+    }
+    if (early_termination && !_end) {
+      check_early_termination();
     }
-    compute_new_wave();
 
     // Update _score
     _score = _score + 1;
@@ -172,19 +932,538 @@ Alignment TheseusAlignerImpl::align(
     // Clear the corresponding waves and metadata from the scope
     _scope->new_score(_score);
     _vertices_data->new_score(_score);
+    _reduction_cutoffs[_vertices_data->get_pos(_score)] = -1;
+
+    // No live cells left in the scope: the end can not be reached within the
+    // score bound
+    if (_astar_bound >= 0 && !_end && _score - _last_live_wave >= _scope->size()) {
+      _status = AlignmentStatus::MaxScoreReached;
+    }
+  }
+
+  // The last wave may have read the query beyond some shared prefixes
+  if (_next_prefix_level < _prefix_levels.size()) {
+    track_prefix_snapshots();
+  }
+}
+
+
+void TheseusAlignerImpl::track_prefix_snapshots() {
+  // The waves have read the query beyond the next shared prefixes: the
+  // candidate snapshot (taken before) is the one to resume from
+  if (_max_extended_offset >= _prefix_levels[_next_prefix_level]) {
+    if (_prefix_candidate) {
+      _num_prefix_snapshots += 1;
+      _prefix_candidate = false;
+    }
+    while (_next_prefix_level < _prefix_levels.size() &&
+           _prefix_levels[_next_prefix_level] <= _max_extended_offset) {
+      _next_prefix_level += 1;
+    }
+    if (_next_prefix_level == _prefix_levels.size()) {
+      return;
+    }
+  }
+
+  // New candidate (only if it needs a longer prefix than the top snapshot)
+  if (_score > 0 && _score % prefix_snapshot_interval == 0 &&
+      !_end && _status == AlignmentStatus::Aligned &&
+      (_num_prefix_snapshots == 0 ||
+       _max_extended_offset + 1 > _prefix_snapshots[_num_prefix_snapshots - 1]->min_prefix)) {
+    if (_prefix_snapshots.size() == _num_prefix_snapshots) {
+      _prefix_snapshots.push_back(std::make_unique<PrefixSnapshot>(_scope->size()));
+    }
+    save_prefix_snapshot(*_prefix_snapshots[_num_prefix_snapshots]);
+    _prefix_candidate = true;
+  }
+}
+
+
+void TheseusAlignerImpl::save_prefix_snapshot(PrefixSnapshot &snapshot) {
+  snapshot.min_prefix = _max_extended_offset + 1;
+  snapshot.score = _score;
+  snapshot.scope.assign(*_scope);
+  snapshot.beyond_scope = _beyond_scope->mark();
+  _vertices_data->save(snapshot.vertices_data);
+  snapshot.reduction_cutoffs = _reduction_cutoffs;
+  snapshot.xdrop_values = _xdrop_values;
+  snapshot.pruned_cells = _pruned_cells;
+  snapshot.last_live_wave = _last_live_wave;
+  snapshot.best_cell = _best_cell;
+  snapshot.best_score = _best_score;
+  snapshot.best_value = _best_value;
+}
+
+
+void TheseusAlignerImpl::resume_pass(std::string_view seq, const PrefixSnapshot &snapshot) {
+  _scope->assign(snapshot.scope);
+  _beyond_scope->rewind(snapshot.beyond_scope);
+  _vertices_data->restore(snapshot.vertices_data);
+  _seq = seq;
+  if (_graph->is_packed()) {
+    _packed_seq.assign(seq);
+  }
+
+  // The starting positions, the target and the backtrace mode are the ones
+  // of the previous pass
+  _end_offset = seq.size() - std::clamp(_ends_free.query_end, 0, (int)seq.size());
+  _reduction_cutoffs = snapshot.reduction_cutoffs;
+  _xdrop_values = snapshot.xdrop_values;
+  _pruned_cells = snapshot.pruned_cells;
+  _last_live_wave = snapshot.last_live_wave;
+  _best_cell = snapshot.best_cell;
+  _best_score = snapshot.best_score;
+  _best_value = snapshot.best_value;
+  _max_extended_offset = snapshot.min_prefix - 1;
+  _score = snapshot.score;
+  _end = false;
+  _status = AlignmentStatus::Aligned;
+  _backtrace_overflow = false;
+
+  fit_scratchpad();
+  _alignment.path.clear();
+  _alignment.edit_op.clear();
+}
+
+
+// Adaptive wavefront reduction and A* pruning of the current wave
+void TheseusAlignerImpl::prune_wavefront() {
+  const int pos = _vertices_data->get_pos(_score);
+  const int num_active_vertices = _vertices_data->num_active_vertices();
+
+  // Visit all the cells of the current wave (M, M jumps, I, I jumps, D and
+  // the I2, I2 jumps and D2 of dual affine gaps)
+  auto for_each_cell = [&](auto fn) {
+    for (int l = 0; l < num_active_vertices; ++l) {
+      VerticesData::VertexData &vdata = _vertices_data->get_vertex_data_by_idx(l);
+      auto visit_range = [&](Cell::CellVector &wf, Scope::RangeVector &ranges) {
+        if (ranges.size() > l) {
+          for (Cell::pos_t k = ranges[l].start; k < ranges[l].end; ++k) fn(vdata, wf[k]);
+        }
+      };
+      visit_range(m_wf(_score), _scope->m_pos(_score));
+      visit_range(_scope->i_wf(_score), _scope->i_pos(_score));
+      visit_range(_scope->d_wf(_score), _scope->d_pos(_score));
+      visit_range(_scope->i2_wf(_score), _scope->i2_pos(_score));
+      visit_range(_scope->d2_wf(_score), _scope->d2_pos(_score));
+      for (auto k : vdata._m_jumps_positions[pos]) fn(vdata, m_jumps_wf(_score)[k]);
+      for (auto k : vdata._i_jumps_positions[pos]) fn(vdata, i_jumps_wf(_score)[k]);
+      for (auto k : vdata._i2_jumps_positions[pos]) fn(vdata, i2_jumps_wf(_score)[k]);
+    }
+  };
+
+  // Adaptive wavefront reduction: drop the cells that lag behind the
+  // furthest reaching one (only in waves with enough cells)
+  int cutoff = -1;
+  if (_reduction.enabled) {
+    int max_offset = -1;
+    int64_t num_cells = 0;
+    for_each_cell([&](VerticesData::VertexData &, const Cell &cell) {
+      max_offset = std::max(max_offset, (int)cell.offset);
+      num_cells += 1;
+    });
+    if (num_cells >= _reduction.min_wavefront_length) {
+      cutoff = max_offset - _reduction.max_distance_threshold;
+      _reduction_cutoffs[pos] = cutoff;
+    }
+  }
+
+  // Live cells: not dropped and (A* pruning) able to reach the end within
+  // the score bound
+  for_each_cell([&](VerticesData::VertexData &vdata, const Cell &cell) {
+    if (cell.offset < cutoff) {
+      _pruned_cells += 1;
+    }
+    else if (_astar_bound < 0 || _score + lower_bound(cell) <= _astar_bound) {
+      vdata._last_live_score = _score;
+      _last_live_wave = _score;
+    }
+  });
+}
+
+
+// Best partial alignment and early termination criteria
+void TheseusAlignerImpl::check_early_termination() {
+  const int pos = _vertices_data->get_pos(_score);
+  const int num_active_vertices = _vertices_data->num_active_vertices();
+
+  // Furthest reaching M cell (including M jumps) of the current wave
+  const Cell *best_cell = nullptr;
+  Scope::RangeVector &m_ranges = _scope->m_pos(_score);
+  for (int l = 0; l < num_active_vertices; ++l) {
+    if (m_ranges.size() > l) {
+      for (Cell::pos_t k = m_ranges[l].start; k < m_ranges[l].end; ++k) {
+        const Cell &cell = m_wf(_score)[k];
+        if (best_cell == nullptr || cell.offset > best_cell->offset) best_cell = &cell;
+      }
+    }
+    for (auto k : _vertices_data->get_vertex_data_by_idx(l)._m_jumps_positions[pos]) {
+      const Cell &cell = m_jumps_wf(_score)[k];
+      if (best_cell == nullptr || cell.offset > best_cell->offset) best_cell = &cell;
+    }
+  }
+
+  // X-drop value: each aligned base is rewarded with a quarter of the
+  // mismatch penalty (the value is multiplied by 4 to keep it integer)
+  int64_t &value = _xdrop_values[pos];
+  value = std::numeric_limits<int64_t>::min();
+  if (best_cell != nullptr) {
+    value = (int64_t)_internal_penalties.mism() * best_cell->offset - 4 * (int64_t)_score;
+    if (value > _best_value) {
+      _best_value = value;
+      _best_cell = *best_cell;
+      _best_score = _score;
+    }
+  }
+
+  // The next waves only come from the waves in the scope, so the alignment
+  // is dropped when all of them fall behind the best one
+  if (_termination.xdrop >= 0) {
+    int64_t scope_value = *std::max_element(_xdrop_values.begin(), _xdrop_values.end());
+    if (_best_value - scope_value > 4 * (int64_t)_termination.xdrop) {
+      _status = AlignmentStatus::XDropped;
+      return;
+    }
   }
+
+  if (_termination.max_score >= 0 && _score >= _termination.max_score) {
+    _status = AlignmentStatus::MaxScoreReached;
+  }
+}
+
+
+bool TheseusAlignerImpl::use_pairwise(std::span<const GraphPos> starts) const {
+  return !_is_msa && starts.size() == 1 && _graph->out_degree(starts[0].vertex) == 0 &&
+         _memory_mode != MemoryMode::Low && !_reduction.enabled &&
+         _termination.max_score < 0 && _termination.xdrop < 0 &&
+         _internal_penalties.type() != Penalties::Type::DualAffine &&
+         _dp_fallback.score_threshold < 0;
+}
+
+
+void TheseusAlignerImpl::compute_pairwise_waves() {
+  const int v = _starts[0].vertex;
+  const int len = _graph->length(v);
+  const int m = _seq.size();
+  const int mism = _internal_penalties.mism();
+  const int gapo_e = _internal_penalties.gapo() + _internal_penalties.gape();
+  const int gape = _internal_penalties.gape();
+  const bool linear_gaps = (_internal_penalties.type() == Penalties::Type::Linear); // Gaps from M only
+  const int nscores = _scope->size();
+  if ((int)_dense_m.size() != nscores) {
+    _dense_m.resize(nscores);
+    _dense_i.resize(nscores);
+    _dense_d.resize(nscores);
+  }
+  for (int l = 0; l < nscores; ++l) {
+    _dense_m[l].clear();
+    _dense_i[l].clear();
+    _dense_d[l].clear();
+  }
+  DenseWave none; // Waves of negative scores
+  auto wave = [nscores, &none](std::vector<DenseWave> &waves, int score) -> DenseWave * {
+    return (score >= 0) ? &waves[score % nscores] : &none;
+  };
+
+  // Score 0: the initial cells
+  int lo = std::numeric_limits<int>::max(), hi = std::numeric_limits<int>::min();
+  for (int l = 0; l < _num_start_cells; ++l) {
+    extend_diagonal(m_jumps_wf(0)[l], v, m_jumps_wf(0)[l], l, Cell::Matrix::MJumps);
+    lo = std::min(lo, (int)m_jumps_wf(0)[l].diag);
+    hi = std::max(hi, (int)m_jumps_wf(0)[l].diag);
+  }
+  DenseWave &m_0 = _dense_m[0];
+  m_0.reset(lo, hi);
+  for (int l = 0; l < _num_start_cells; ++l) {
+    Cell cell = m_jumps_wf(0)[l];
+    cell.prev_pos = l;
+    cell.from_matrix = Cell::Matrix::MJumps;
+    DenseWave::Entry &entry = m_0[cell.diag];
+    if (entry.offset >= cell.offset) continue;
+    entry.offset = cell.offset;
+    entry.prev_pos = l;
+    entry.from_matrix = Cell::Matrix::MJumps;
+    if (_store_backtrace) {
+      entry.prev_pos = m_wf(0).size();
+      entry.from_matrix = Cell::Matrix::M;
+      m_wf(0).push_back(cell);
+    }
+    check_end_condition(cell, cell.diag + cell.offset, v);
+  }
+
+  // Union of the ranges of some waves (empty if all of them are empty)
+  auto set_range = [](DenseWave &dst, std::initializer_list<const DenseWave *> sources, int shift) {
+    int new_lo = std::numeric_limits<int>::max(), new_hi = std::numeric_limits<int>::min();
+    for (const DenseWave *source : sources) {
+      if (!source->empty()) {
+        new_lo = std::min(new_lo, source->lo() + shift);
+        new_hi = std::max(new_hi, source->hi() + shift);
+      }
+    }
+    if (new_lo > new_hi) dst.clear();
+    else dst.reset(new_lo, new_hi);
+  };
+
+  // Candidate cell (same bounds and tie-breaking as the sparsify functions:
+  // the first source wins ties)
+  auto relax = [&](DenseWave::Entry &cell, DenseWave::Entry source, int diag, int offset_increase) {
+    if (source.offset < 0) return;
+    int offset = source.offset + offset_increase;
+    if (offset <= m && offset + diag <= len && cell.offset < offset) {
+      source.offset = offset;
+      cell = source;
+    }
+  };
+
+  while (!_end) {
+    _score += 1;
+    DenseWave &prev_m_open = *wave(_dense_m, _score - gapo_e);
+    DenseWave &prev_i = *wave(_dense_i, _score - gape);
+    DenseWave &prev_d = *wave(_dense_d, _score - gape);
+    DenseWave &prev_m_mism = *wave(_dense_m, _score - mism);
+
+    // I (graph bases): extension first, then opening
+    DenseWave &curr_i = _dense_i[_score % nscores];
+    set_range(curr_i, {(linear_gaps) ? &none : &prev_i, &prev_m_open}, 1);
+    for (int d = curr_i.lo(); d <= curr_i.hi(); ++d) {
+      if (!linear_gaps) relax(curr_i[d], prev_i.get(d - 1), d, 0);
+      relax(curr_i[d], prev_m_open.get(d - 1), d, 0);
+    }
+    curr_i.trim();
+
+    // D (query bases): extension first, then opening
+    DenseWave &curr_d = _dense_d[_score % nscores];
+    set_range(curr_d, {(linear_gaps) ? &none : &prev_d, &prev_m_open}, -1);
+    for (int d = curr_d.lo(); d <= curr_d.hi(); ++d) {
+      if (!linear_gaps) relax(curr_d[d], prev_d.get(d + 1), d, 1);
+      relax(curr_d[d], prev_m_open.get(d + 1), d, 1);
+    }
+    curr_d.trim();
+
+    // M: D, I and mismatch, then extension
+    DenseWave &curr_m = _dense_m[_score % nscores];
+    set_range(curr_m, {&curr_d, &curr_i, &prev_m_mism}, 0);
+    for (int d = curr_m.lo(); d <= curr_m.hi(); ++d) {
+      DenseWave::Entry &entry = curr_m[d];
+      relax(entry, curr_d.get(d), d, 0);
+      relax(entry, curr_i.get(d), d, 0);
+      relax(entry, prev_m_mism.get(d), d, 1);
+      if (entry.offset < 0) continue;
+
+      Cell cell{entry.prev_pos, entry.from_matrix, v, entry.offset, d};
+      int j = d + cell.offset;
+      LCP(_seq, v, cell.offset, j);
+      entry.offset = cell.offset;
+      if (_store_backtrace) {
+        entry.from_matrix = Cell::Matrix::M;
+        entry.prev_pos = m_wf(_score).size();
+        m_wf(_score).push_back(cell);
+      }
+      check_end_condition(cell, j, v);
+    }
+    curr_m.trim();
+    if (_store_backtrace && !backtrace_fits()) {
+      _backtrace_overflow = true;
+      break;
+    }
+  }
+  _score += 1;
+}
+
+
+bool TheseusAlignerImpl::backtrace_fits() const {
+  BeyondScope::Mark sizes = _beyond_scope->mark();
+  return sizes.m_wf <= backtrace_pos_limit && sizes.m_jumps_wf <= backtrace_pos_limit &&
+         sizes.i_jumps_wf <= backtrace_pos_limit && sizes.i2_jumps_wf <= backtrace_pos_limit;
+}
+
+
+// Optimal score and end position (free end) without backtrace
+void TheseusAlignerImpl::score_only_pass(std::string_view seq,
+                                         std::span<const GraphPos> starts)
+{
+  start_pass(seq, starts, -1, 0, false);
+  compute_waves(std::numeric_limits<int>::max(), true);
   _score -= 1;
+}
 
-  // Backtrace
-  _seq_ID += 1;
-  backtrace(0);
 
-  // Update the graph in case of MSA
-  if (_is_msa) {
-      _poa_graph->add_alignment_poa(_graph, _alignment, _seq, _seq_ID);
+// Gather the M cells (including M jumps) of the scores still in the scope
+void TheseusAlignerImpl::collect_m_cells(std::vector<WaveCell> &cells) {
+  cells.clear();
+  int last_score = _score - 1;
+  int first_score = std::max(0, last_score - _scope->size() + 2);
+  for (int s = first_score; s <= last_score; ++s) {
+    for (Cell::CellVector *wf : {&m_wf(s), &m_jumps_wf(s)}) {
+      for (int l = 0; l < wf->size(); ++l) {
+        const Cell &cell = (*wf)[l];
+        cells.push_back({s, cell.vertex_id, cell.diag, cell.offset});
+      }
+    }
   }
+}
 
-  return _alignment;
+
+// Low memory alignment: score-only pass and bidirectional divide and conquer
+bool TheseusAlignerImpl::align_bidirectional(std::string_view seq,
+                                             int start_vertex,
+                                             int start_offset,
+                                             int target_vertex,
+                                             int target_col)
+{
+  _memory_fallback = false;
+
+  // Free leading bases are not supported (the start would not be known)
+  if (_ends_free.query_begin > 0 || _ends_free.graph_begin > 0) {
+    return false;
+  }
+
+  // The reverse graph mirrors the forward one only if there are no overlaps
+  // (the MSA graph changes after each alignment)
+  if (!_reverse_graph || _is_msa) {
+    if (_graph->has_overlaps()) {
+      return false;
+    }
+    _reverse_graph = _graph->reverse_graph();
+  }
+
+  // Optimal score and end position (or best partial alignment if terminated
+  // early or with free trailing bases, which is then aligned as a prefix of
+  // the sequence)
+  GraphPos start{start_vertex, start_offset};
+  start_pass(seq, start_vertex, start_offset, target_vertex, target_col, false);
+  compute_waves(std::numeric_limits<int>::max(), target_vertex < 0);
+  _score -= 1;
+  AlignmentStatus status = _status;
+  if (status != AlignmentStatus::Aligned) {
+    _start_pos = _best_cell;
+    _score = _best_score;
+  }
+  Cell end_cell = _start_pos;
+  int score = _score;
+  GraphPos end{end_cell.vertex_id, end_cell.diag + end_cell.offset};
+
+  Alignment alignment;
+  bool found = bidirectional_step(seq.substr(0, end_cell.offset), start, end, score, alignment);
+
+  // Restore the data of the whole alignment (used by the output functions)
+  _seq = seq;
+  _starts.assign(1, start);
+  _score = score;
+  _start_pos = end_cell;
+  _status = status;
+  if (!found) {
+    return false;
+  }
+
+  alignment.start_offset = start_offset;
+  alignment.end_offset = end.col;
+  _alignment = std::move(alignment);
+  return true;
+}
+
+
+// Align seq from start to end (with known optimal score) in bounded memory
+bool TheseusAlignerImpl::bidirectional_step(std::string_view seq,
+                                            GraphPos start,
+                                            GraphPos end,
+                                            int score,
+                                            Alignment &alignment)
+{
+  // Align storing the backtrace (small problems, or no breakpoint found)
+  auto align_stored = [&]() {
+    start_pass(seq, start.vertex, start.col, end.vertex, end.col, true);
+    compute_waves(score);
+    if (!_end || _backtrace_overflow) {
+      return false;
+    }
+    _score -= 1;
+    backtrace(0);
+
+    // The first vertex of the path is the last vertex of the previous part
+    int first = (alignment.path.empty()) ? 0 : 1;
+    alignment.path.insert(alignment.path.end(), _alignment.path.begin() + first, _alignment.path.end());
+    alignment.edit_op.insert(alignment.edit_op.end(), _alignment.edit_op.begin(), _alignment.edit_op.end());
+    return true;
+  };
+  if (score <= bidirectional_min_score) {
+    return align_stored();
+  }
+
+  // Find a breakpoint: an M cell reached by the forward wavefront with score
+  // s_f and by the reverse wavefront with score s_r, such that s_f + s_r is
+  // the optimal score. As the scope only keeps the last scores, a breakpoint
+  // inside a long gap may be missed, so the cells of a few consecutive
+  // windows of forward scores (h - window, h] are gathered, each one with
+  // the reverse window [score - h, score - h + window). Each wavefront is
+  // computed once, from the window that it reaches last.
+  const int window = _scope->size() - 1;
+  const int n = seq.size();
+  const int nwindows = std::clamp((score - score / 2 + window - 1) / window, 1, bidirectional_max_attempts);
+  auto forward_score = [&](int k) { return score / 2 + k * window; };
+  std::vector<std::vector<WaveCell>> forward_cells(nwindows), reverse_cells(nwindows);
+
+  // Reverse wavefronts (the reverse windows decrease with h)
+  _reverse_seq.assign(seq.rbegin(), seq.rend());
+  std::swap(_graph, _reverse_graph);
+  start_pass(_reverse_seq,
+             end.vertex, _graph->length(end.vertex) - end.col,
+             start.vertex, _graph->length(start.vertex) - start.col,
+             false);
+  for (int k = nwindows - 1; k >= 0; --k) {
+    compute_waves(score - forward_score(k) + window - 1);
+    collect_m_cells(reverse_cells[k]);
+  }
+  std::swap(_graph, _reverse_graph);
+
+  // Forward wavefronts
+  start_pass(seq, start.vertex, start.col, end.vertex, end.col, false);
+  for (int k = 0; k < nwindows; ++k) {
+    compute_waves(forward_score(k));
+    collect_m_cells(forward_cells[k]);
+    std::sort(forward_cells[k].begin(), forward_cells[k].end(), WaveCell::less_position);
+  }
+
+  // Look for overlapping cells (same vertex and diagonal)
+  int tries = 0;
+  for (int k = 0; k < nwindows && tries < bidirectional_max_attempts; ++k) {
+    for (const auto &rc : reverse_cells[k]) {
+      int len = _graph->length(rc.vertex);
+      WaveCell key{0, rc.vertex, len - n - rc.diag, 0};  // Forward diagonal
+      auto range = std::equal_range(forward_cells[k].begin(), forward_cells[k].end(), key, WaveCell::less_position);
+      for (auto fc = range.first; fc != range.second; ++fc) {
+        if (fc->score + rc.score != score || fc->offset + rc.offset < n ||
+            fc->score == 0 || rc.score == 0) {
+          continue;
+        }
+
+        // Split the alignment at the breakpoint
+        for (int offset : {fc->offset, n - rc.offset}) {
+          GraphPos middle{rc.vertex, key.diag + offset};
+          if (middle.col < 0 || middle.col > len) {
+            continue;
+          }
+          size_t nops = alignment.edit_op.size(), nvertices = alignment.path.size();
+          if (bidirectional_step(seq.substr(0, offset), start, middle, fc->score, alignment) &&
+              bidirectional_step(seq.substr(offset), middle, end, rc.score, alignment)) {
+            return true;
+          }
+          alignment.edit_op.resize(nops);
+          alignment.path.resize(nvertices);
+        }
+        if (++tries == bidirectional_max_attempts) {
+          break;
+        }
+      }
+      if (tries == bidirectional_max_attempts) {
+        break;
+      }
+    }
+  }
+
+  // No breakpoint: only this part of the alignment stores its backtrace
+  _memory_fallback = true;
+  return align_stored();
 }
 
   // Sparsify M data
@@ -193,11 +1472,13 @@ Alignment TheseusAlignerImpl::align(
                                            int shift_factor,
                                            Scope::range cells_range,
                                            int m,
-                                           int upper_bound)
+                                           int upper_bound,
+                                           int min_offset)
   {
 
     Cell::pos_t len = cells_range.end - cells_range.start, new_col;
     Cell new_cell;
+    const int min_new_offset = min_offset + offset_increase;  // Wavefront reduction
 
     // Sparsify the active diagonals
     for (int l = 0; l < len; ++l)
@@ -210,7 +1491,7 @@ Alignment TheseusAlignerImpl::align(
       new_col = new_cell.offset + new_cell.diag; // d = j - i -> j = d + i
 
       // Check validity
-      if (new_cell.offset <= m && new_col <= upper_bound)
+      if (new_cell.offset <= m && new_col <= upper_bound && new_cell.offset >= min_new_offset)
       { // If in bounds
         // Branchless push_back
         auto &cell = _scratchpad->access_alloc(new_cell.diag);
@@ -229,10 +1510,12 @@ Alignment TheseusAlignerImpl::align(
                                                int shift_factor,
                                                int m,
                                                int upper_bound,
+                                               int min_offset,
                                                Cell::Matrix from_matrix)
   {
     int len = jumps_positions.size(), new_col, pos;
     Cell new_cell;
+    const int min_new_offset = min_offset + offset_increase;  // Wavefront reduction
 
     // Sparsify the active diagonals
     for (int l = 0; l < len; ++l)
@@ -246,7 +1529,7 @@ Alignment TheseusAlignerImpl::align(
       new_col = new_cell.offset + new_cell.diag; // d = j - i -> j = d + i
 
       // Check validity
-      if (new_cell.offset <= m && new_col <= upper_bound)
+      if (new_cell.offset <= m && new_col <= upper_bound && new_cell.offset >= min_new_offset)
       { // If in bounds
         // Branchless push_back
         auto &cell = _scratchpad->access_alloc(new_cell.diag);
@@ -264,11 +1547,13 @@ Alignment TheseusAlignerImpl::align(
                                                int shift_factor,
                                                Scope::range cells_range,
                                                int m,
-                                               int upper_bound)
+                                               int upper_bound,
+                                               int min_offset)
   {
 
     Cell::pos_t len = cells_range.end - cells_range.start, new_col;
     Cell new_cell;
+    const int min_new_offset = min_offset + offset_increase;  // Wavefront reduction
 
     // Sparsify the active diagonals
     for (int l = 0; l < len; ++l)
@@ -280,7 +1565,7 @@ Alignment TheseusAlignerImpl::align(
       new_col = new_cell.offset + new_cell.diag; // d = j - i -> j = d + i
 
       // Check validity
-      if (new_cell.offset <= m && new_col <= upper_bound)
+      if (new_cell.offset <= m && new_col <= upper_bound && new_cell.offset >= min_new_offset)
       { // If in bounds
         // Branchless push_back
         auto &cell = _scratchpad->access_alloc(new_cell.diag);
@@ -293,8 +1578,7 @@ Alignment TheseusAlignerImpl::align(
   }
 
   // Compute next I matrix
-  void TheseusAlignerImpl::next_I(Graph::vertex * curr_v,
-                                  int upper_bound,
+  void TheseusAlignerImpl::next_I(int upper_bound,
                                   int v)
   {
 
@@ -307,18 +1591,18 @@ Alignment TheseusAlignerImpl::align(
       if (_scope->i_pos(pos_prev_I).size() > _vertices_data->get_id(v))
       {
         Scope::range cells_range = _scope->i_pos(pos_prev_I)[_vertices_data->get_id(v)];
-        sparsify_indel_data(_scope->i_wf(pos_prev_I), 0, 1, cells_range, _seq.size(), upper_bound); // Sparsify I data
+        sparsify_indel_data(_scope->i_wf(pos_prev_I), 0, 1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_I)); // Sparsify I data
       };
-      sparsify_jumps_data(_beyond_scope->i_jumps_wf(), _vertices_data->get_vertex_data(v)._i_jumps_positions[pos_prev_I_scope], 0, 1, _seq.size(), upper_bound, Cell::Matrix::IJumps);
+      sparsify_jumps_data(i_jumps_wf(pos_prev_I), _vertices_data->get_vertex_data(v)._i_jumps_positions[pos_prev_I_scope], 0, 1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_I), Cell::Matrix::IJumps);
     }
 
     // Come from M
     if (pos_prev_M >= 0) {
       if (_scope->m_pos(pos_prev_M).size() > _vertices_data->get_id(v)) {
         Scope::range cells_range = _scope->m_pos(pos_prev_M)[_vertices_data->get_id(v)];
-        sparsify_M_data(_beyond_scope->m_wf(), 0, 1, cells_range, _seq.size(), upper_bound); // Sparsify M data
+        sparsify_M_data(m_wf(pos_prev_M), 0, 1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M)); // Sparsify M data
       }
-      sparsify_jumps_data(_beyond_scope->m_jumps_wf(), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 0, 1, _seq.size(), upper_bound, Cell::Matrix::MJumps);
+      sparsify_jumps_data(m_jumps_wf(pos_prev_M), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 0, 1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M), Cell::Matrix::MJumps);
     }
 
     // Densify data (store it in the big wavefront)
@@ -333,8 +1617,8 @@ Alignment TheseusAlignerImpl::align(
     _scope->i_pos(_score).push_back(new_range);
 
     // Check, store and invalidate new I jumps
-    if (curr_v->out_edges.size() > 0) {
-      check_and_store_jumps(curr_v, _scope->i_wf(_score), new_range);
+    if (_graph->out_degree(v) > 0) {
+      check_and_store_jumps(v, _scope->i_wf(_score), new_range);
     }
 }
 
@@ -351,7 +1635,7 @@ void TheseusAlignerImpl::next_D(int upper_bound,
   if (pos_prev_D >= 0 && _scope->d_pos(pos_prev_D).size() > _vertices_data->get_id(v))
   {
     Scope::range cells_range = _scope->d_pos(pos_prev_D)[_vertices_data->get_id(v)];
-    sparsify_indel_data(_scope->d_wf(pos_prev_D), 1, -1, cells_range, _seq.size(), upper_bound); // Sparsify D data
+    sparsify_indel_data(_scope->d_wf(pos_prev_D), 1, -1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_D)); // Sparsify D data
   }
 
   // Come from M
@@ -359,9 +1643,9 @@ void TheseusAlignerImpl::next_D(int upper_bound,
     if (_scope->m_pos(pos_prev_M).size() > _vertices_data->get_id(v))
     {
       Scope::range cells_range = _scope->m_pos(pos_prev_M)[_vertices_data->get_id(v)];
-      sparsify_M_data(_beyond_scope->m_wf(), 1, -1, cells_range, _seq.size(), upper_bound); // Sparsify M data
+      sparsify_M_data(m_wf(pos_prev_M), 1, -1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M)); // Sparsify M data
     }
-    sparsify_jumps_data(_beyond_scope->m_jumps_wf(), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 1, -1, _seq.size(), upper_bound, Cell::Matrix::MJumps);
+    sparsify_jumps_data(m_jumps_wf(pos_prev_M), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 1, -1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M), Cell::Matrix::MJumps);
   }
 
   // Densify data (store it in the big wavefront)
@@ -377,7 +1661,92 @@ void TheseusAlignerImpl::next_D(int upper_bound,
 }
 
 
+// Compute next I2 matrix
+void TheseusAlignerImpl::next_I2(int upper_bound,
+                                 int v)
+{
+
+  // Sparsify data (put it in the scratch pad)
+  int pos_prev_M = _score - (_internal_penalties.gapo2() + _internal_penalties.gape2()), pos_prev_I = _score - _internal_penalties.gape2(), pos_prev_M_scope = _vertices_data->get_pos(pos_prev_M);
+  int pos_prev_I_scope = _vertices_data->get_pos(pos_prev_I);
+
+  // Come from an Insertion
+  if (pos_prev_I >= 0) {
+    if (_scope->i2_pos(pos_prev_I).size() > _vertices_data->get_id(v))
+    {
+      Scope::range cells_range = _scope->i2_pos(pos_prev_I)[_vertices_data->get_id(v)];
+      sparsify_indel_data(_scope->i2_wf(pos_prev_I), 0, 1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_I)); // Sparsify I2 data
+    }
+    sparsify_jumps_data(i2_jumps_wf(pos_prev_I), _vertices_data->get_vertex_data(v)._i2_jumps_positions[pos_prev_I_scope], 0, 1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_I), Cell::Matrix::I2Jumps);
+  }
+
+  // Come from M
+  if (pos_prev_M >= 0) {
+    if (_scope->m_pos(pos_prev_M).size() > _vertices_data->get_id(v)) {
+      Scope::range cells_range = _scope->m_pos(pos_prev_M)[_vertices_data->get_id(v)];
+      sparsify_M_data(m_wf(pos_prev_M), 0, 1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M)); // Sparsify M data
+    }
+    sparsify_jumps_data(m_jumps_wf(pos_prev_M), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 0, 1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M), Cell::Matrix::MJumps);
+  }
+
+  // Densify data (store it in the big wavefront)
+  Scope::range new_range;
+  new_range.start = _scope->i2_wf(_score).size();
+  for (auto diag : _scratchpad->active_diags()) {
+    if (_vertices_data->valid_diagonal<Cell::Matrix::I2>(v, diag)) {
+      _scope->i2_wf(_score).push_back((*_scratchpad)[diag]);     // Store Cell
+    }
+  }
+  new_range.end = _scope->i2_wf(_score).size();
+  _scope->i2_pos(_score).push_back(new_range);
+
+  // Check, store and invalidate new I2 jumps
+  if (_graph->out_degree(v) > 0) {
+    check_and_store_jumps<Cell::Matrix::I2>(v, _scope->i2_wf(_score), new_range);
+  }
+}
+
+
+// Compute next D2 matrix
+void TheseusAlignerImpl::next_D2(int upper_bound,
+                                 int v)
+{
+
+  // Sparsify data (put it in the scratch pad)
+  int pos_prev_M = _score - (_internal_penalties.gapo2() + _internal_penalties.gape2()), pos_prev_D = _score - _internal_penalties.gape2(), pos_prev_M_scope = _vertices_data->get_pos(pos_prev_M);
+
+  // Come from a Deletion
+  if (pos_prev_D >= 0 && _scope->d2_pos(pos_prev_D).size() > _vertices_data->get_id(v))
+  {
+    Scope::range cells_range = _scope->d2_pos(pos_prev_D)[_vertices_data->get_id(v)];
+    sparsify_indel_data(_scope->d2_wf(pos_prev_D), 1, -1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_D)); // Sparsify D2 data
+  }
+
+  // Come from M
+  if (pos_prev_M >= 0) {
+    if (_scope->m_pos(pos_prev_M).size() > _vertices_data->get_id(v))
+    {
+      Scope::range cells_range = _scope->m_pos(pos_prev_M)[_vertices_data->get_id(v)];
+      sparsify_M_data(m_wf(pos_prev_M), 1, -1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M)); // Sparsify M data
+    }
+    sparsify_jumps_data(m_jumps_wf(pos_prev_M), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 1, -1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M), Cell::Matrix::MJumps);
+  }
+
+  // Densify data (store it in the big wavefront)
+  Scope::range new_range;
+  new_range.start = _scope->d2_wf(_score).size();
+  for (auto diag : _scratchpad->active_diags()) {
+    if (_vertices_data->valid_diagonal<Cell::Matrix::D2>(v, diag)) {
+      _scope->d2_wf(_score).push_back((*_scratchpad)[diag]); // Store Cell
+    }
+  }
+  new_range.end = _scope->d2_wf(_score).size();
+  _scope->d2_pos(_score).push_back(new_range);
+}
+
+
 // Compute next M matrix
+template <Penalties::Type gap_type>
 void TheseusAlignerImpl::next_M(int upper_bound,
                                 int v) {
 
@@ -387,40 +1756,96 @@ void TheseusAlignerImpl::next_M(int upper_bound,
   // Come from a Deletion
   if (_scope->d_pos(pos_prev_D).size() > _vertices_data->get_id(v))  {
     Scope::range cells_range = _scope->d_pos(pos_prev_D)[_vertices_data->get_id(v)];
-    sparsify_indel_data(_scope->d_wf(pos_prev_D), 0, 0, cells_range, _seq.size(), upper_bound);  // Sparsify D data
+    sparsify_indel_data(_scope->d_wf(pos_prev_D), 0, 0, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_D));  // Sparsify D data
   }
 
   // Come from an Insertion
   if (_scope->i_pos(pos_prev_I).size() > _vertices_data->get_id(v))  {
     Scope::range cells_range = _scope->i_pos(pos_prev_I)[_vertices_data->get_id(v)];
-    sparsify_indel_data(_scope->i_wf(pos_prev_I), 0, 0, cells_range, _seq.size(), upper_bound);  // Sparsify I data
+    sparsify_indel_data(_scope->i_wf(pos_prev_I), 0, 0, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_I));  // Sparsify I data
+  }
+
+  // Come from a Deletion or an Insertion with the second gap penalties
+  if constexpr (gap_type == Penalties::Type::DualAffine) {
+    if (_scope->d2_pos(pos_prev_D).size() > _vertices_data->get_id(v))  {
+      Scope::range cells_range = _scope->d2_pos(pos_prev_D)[_vertices_data->get_id(v)];
+      sparsify_indel_data(_scope->d2_wf(pos_prev_D), 0, 0, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_D));  // Sparsify D2 data
+    }
+    if (_scope->i2_pos(pos_prev_I).size() > _vertices_data->get_id(v))  {
+      Scope::range cells_range = _scope->i2_pos(pos_prev_I)[_vertices_data->get_id(v)];
+      sparsify_indel_data(_scope->i2_wf(pos_prev_I), 0, 0, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_I));  // Sparsify I2 data
+    }
   }
 
   // Come from M
   if (pos_prev_M >= 0) {
     if (_scope->m_pos(pos_prev_M).size() > _vertices_data->get_id(v))  {
       Scope::range cells_range = _scope->m_pos(pos_prev_M)[_vertices_data->get_id(v)];
-      sparsify_M_data(_beyond_scope->m_wf(), 1, 0, cells_range,  _seq.size(), upper_bound);  // Sparsify M data
+      sparsify_M_data(m_wf(pos_prev_M), 1, 0, cells_range,  _seq.size(), upper_bound, reduction_cutoff(pos_prev_M));  // Sparsify M data
     }
-    sparsify_jumps_data(_beyond_scope->m_jumps_wf(), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 1, 0, _seq.size(), upper_bound, Cell::Matrix::MJumps);
+    sparsify_jumps_data(m_jumps_wf(pos_prev_M), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 1, 0, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M), Cell::Matrix::MJumps);
   }
 
   // Densify data (store it in the big wavefront)
   Scope::range new_range;
-  new_range.start = _beyond_scope->m_wf().size();
+  Cell::CellVector &curr_m_wf = m_wf(_score);
+  new_range.start = curr_m_wf.size();
   for (auto diag : _scratchpad->active_diags()) {
     if (_vertices_data->valid_diagonal<Cell::Matrix::M>(v, diag)) {
-      _beyond_scope->m_wf().push_back((*_scratchpad)[diag]);     // Store Cell
+      curr_m_wf.push_back((*_scratchpad)[diag]);     // Store Cell
     }
   }
-  new_range.end = _beyond_scope->m_wf().size();
+  new_range.end = curr_m_wf.size();
   _scope->m_pos(_score).push_back(new_range);
 }
 
 
 
+// Compute next M matrix (linear gaps)
+void TheseusAlignerImpl::next_M_linear(int upper_bound,
+                                       int v) {
+
+  // Sparsify data (put it in the scratch pad), in the order of next_M: gaps
+  // first (deletion, then insertion), then mismatches
+  int pos_prev_G = _score - _internal_penalties.gape(), pos_prev_M = _score - _internal_penalties.mism();
+  int pos_prev_G_scope = _vertices_data->get_pos(pos_prev_G), pos_prev_M_scope = _vertices_data->get_pos(pos_prev_M);
+
+  // Come from a Deletion or an Insertion
+  if (pos_prev_G >= 0) {
+    bool has_cells = _scope->m_pos(pos_prev_G).size() > _vertices_data->get_id(v);
+    Scope::range cells_range = (has_cells) ? _scope->m_pos(pos_prev_G)[_vertices_data->get_id(v)] : Scope::range{0, 0};
+    auto &jumps_positions = _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_G_scope];
+    sparsify_M_data(m_wf(pos_prev_G), 1, -1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_G));  // Sparsify M data (D)
+    sparsify_jumps_data(m_jumps_wf(pos_prev_G), jumps_positions, 1, -1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_G), Cell::Matrix::MJumps);
+    sparsify_M_data(m_wf(pos_prev_G), 0, 1, cells_range, _seq.size(), upper_bound, reduction_cutoff(pos_prev_G));   // Sparsify M data (I)
+    sparsify_jumps_data(m_jumps_wf(pos_prev_G), jumps_positions, 0, 1, _seq.size(), upper_bound, reduction_cutoff(pos_prev_G), Cell::Matrix::MJumps);
+  }
+
+  // Come from M
+  if (pos_prev_M >= 0) {
+    if (_scope->m_pos(pos_prev_M).size() > _vertices_data->get_id(v))  {
+      Scope::range cells_range = _scope->m_pos(pos_prev_M)[_vertices_data->get_id(v)];
+      sparsify_M_data(m_wf(pos_prev_M), 1, 0, cells_range,  _seq.size(), upper_bound, reduction_cutoff(pos_prev_M));  // Sparsify M data
+    }
+    sparsify_jumps_data(m_jumps_wf(pos_prev_M), _vertices_data->get_vertex_data(v)._m_jumps_positions[pos_prev_M_scope], 1, 0, _seq.size(), upper_bound, reduction_cutoff(pos_prev_M), Cell::Matrix::MJumps);
+  }
+
+  // Densify data (store it in the big wavefront)
+  Scope::range new_range;
+  Cell::CellVector &curr_m_wf = m_wf(_score);
+  new_range.start = curr_m_wf.size();
+  for (auto diag : _scratchpad->active_diags()) {
+    if (_vertices_data->valid_diagonal<Cell::Matrix::M>(v, diag)) {
+      curr_m_wf.push_back((*_scratchpad)[diag]);     // Store Cell
+    }
+  }
+  new_range.end = curr_m_wf.size();
+  _scope->m_pos(_score).push_back(new_range);
+}
+
+
 // Store the jump in neighbours
-void TheseusAlignerImpl::store_M_jump(Graph::vertex* curr_v,
+void TheseusAlignerImpl::store_M_jump(int v,
                                       Cell &prev_cell,
                                       Cell::pos_t prev_pos,
                                       Cell::Matrix from_matrix) {
@@ -429,31 +1854,29 @@ void TheseusAlignerImpl::store_M_jump(Graph::vertex* curr_v,
   _vertices_data->invalidate_m_jump(_vertices_data->get_id(prev_cell.vertex_id), prev_cell.diag);
   int pos_score = _vertices_data->get_pos(_score);
   int new_diag = -prev_cell.offset;
-  int num_out_v = curr_v->out_edges.size();
   Cell new_cell = prev_cell;
   new_cell.from_matrix = from_matrix;
   new_cell.prev_pos = prev_pos;
 
-  for (int l = 0; l < num_out_v; ++l) {
-    new_cell.vertex_id = curr_v->out_edges[l].to_vertex;
-    new_cell.diag = new_diag + curr_v->out_edges[l].overlap;
-    Graph::vertex* new_v = &_graph._vertices[new_cell.vertex_id];
+  for (const auto &edge : _graph->out_edges(v)) {
+    new_cell.vertex_id = edge.vertex;
+    new_cell.diag = new_diag + edge.overlap;
     _vertices_data->activate_vertex(new_cell.vertex_id);
 
     // Store jump and metadata
     bool valid_diag = _vertices_data->valid_diagonal<Cell::Matrix::M>(new_cell.vertex_id, new_cell.diag); // Extend only if it has not yet been visited
     if (valid_diag) { // Extend only if it has not yet been visited
-      int pos_new_cell = _beyond_scope->m_jumps_wf().size();
-      _beyond_scope->m_jumps_wf().push_back(new_cell);
+      int pos_new_cell = m_jumps_wf(_score).size();
+      m_jumps_wf(_score).push_back(new_cell);
       _vertices_data->get_vertex_data(new_cell.vertex_id)._m_jumps_positions[pos_score].push_back(pos_new_cell);
-      extend_diagonal(new_v, _beyond_scope->m_jumps_wf()[pos_new_cell], new_cell.vertex_id, _beyond_scope->m_jumps_wf()[pos_new_cell], pos_new_cell, Cell::Matrix::MJumps);
+      extend_diagonal(m_jumps_wf(_score)[pos_new_cell], new_cell.vertex_id, m_jumps_wf(_score)[pos_new_cell], pos_new_cell, Cell::Matrix::MJumps);
     }
   }
 }
 
 
 // Store the jump in neighbours
-void TheseusAlignerImpl::store_I_jump(Graph::vertex* curr_v,
+void TheseusAlignerImpl::store_I_jump(int v,
                                       Cell& prev_cell,
                                       Cell::pos_t prev_pos,
                                       Cell::Matrix from_matrix) {
@@ -463,38 +1886,73 @@ void TheseusAlignerImpl::store_I_jump(Graph::vertex* curr_v,
 
   int pos_score = _vertices_data->get_pos(_score);
   int new_diag = -prev_cell.offset;
-  int len = curr_v->out_edges.size();
   Cell new_cell = prev_cell;
   new_cell.from_matrix = from_matrix;
   new_cell.prev_pos = prev_pos;
-  for (int l = 0; l < len; ++l) {
-    new_cell.vertex_id = curr_v->out_edges[l].to_vertex;
-    new_cell.diag = new_diag + curr_v->out_edges[l].overlap;
+  for (const auto &edge : _graph->out_edges(v)) {
+    new_cell.vertex_id = edge.vertex;
+    new_cell.diag = new_diag + edge.overlap;
     _vertices_data->activate_vertex(new_cell.vertex_id);
 
     // Store jump and metadata
     bool valid_diag = _vertices_data->valid_diagonal<Cell::Matrix::I>(new_cell.vertex_id, new_cell.diag);
     if (valid_diag) { // Extend only if it has not yet been visited
-      int pos_new_cell = _beyond_scope->i_jumps_wf().size();
-      _beyond_scope->i_jumps_wf().push_back(new_cell);
+      int pos_new_cell = i_jumps_wf(_score).size();
+      i_jumps_wf(_score).push_back(new_cell);
       _vertices_data->get_vertex_data(new_cell.vertex_id)._i_jumps_positions[pos_score].push_back(pos_new_cell);
 
       // If the destination vertex is empty, jump again
-      if (curr_v->value.size() == 0) {
-        store_I_jump(curr_v, _beyond_scope->i_jumps_wf()[pos_new_cell], prev_pos, Cell::Matrix::IJumps);
+      if (_graph->length(v) == 0) {
+        store_I_jump(v, i_jumps_wf(_score)[pos_new_cell], prev_pos, Cell::Matrix::IJumps);
+      }
+    }
+  }
+}
+
+
+// Store the I2 jump in neighbours
+void TheseusAlignerImpl::store_I2_jump(int v,
+                                       Cell& prev_cell,
+                                       Cell::pos_t prev_pos,
+                                       Cell::Matrix from_matrix) {
+
+  // Invalidate the jumping diagonal
+  _vertices_data->invalidate_i2_jump(_vertices_data->get_id(prev_cell.vertex_id), prev_cell.diag);
+
+  int pos_score = _vertices_data->get_pos(_score);
+  int new_diag = -prev_cell.offset;
+  Cell new_cell = prev_cell;
+  new_cell.from_matrix = from_matrix;
+  new_cell.prev_pos = prev_pos;
+  for (const auto &edge : _graph->out_edges(v)) {
+    new_cell.vertex_id = edge.vertex;
+    new_cell.diag = new_diag + edge.overlap;
+    _vertices_data->activate_vertex(new_cell.vertex_id);
+
+    // Store jump and metadata
+    bool valid_diag = _vertices_data->valid_diagonal<Cell::Matrix::I2>(new_cell.vertex_id, new_cell.diag);
+    if (valid_diag) { // Extend only if it has not yet been visited
+      int pos_new_cell = i2_jumps_wf(_score).size();
+      i2_jumps_wf(_score).push_back(new_cell);
+      _vertices_data->get_vertex_data(new_cell.vertex_id)._i2_jumps_positions[pos_score].push_back(pos_new_cell);
+
+      // If the destination vertex is empty, jump again
+      if (_graph->length(v) == 0) {
+        store_I2_jump(v, i2_jumps_wf(_score)[pos_new_cell], prev_pos, Cell::Matrix::I2Jumps);
       }
     }
   }
 }
 
 
-// Check and store I jumps (that is, those diagonals that have reached the last column of a vertex)
-void TheseusAlignerImpl::check_and_store_jumps(Graph::vertex *curr_v,
+// Check and store I (or I2) jumps (that is, those diagonals that have reached the last column of a vertex)
+template <Cell::Matrix matrix>
+void TheseusAlignerImpl::check_and_store_jumps(int v,
                                                Cell::CellVector &curr_wavefront,
                                                Scope::range cell_range)
 {
 
-  Cell::pos_t len = cell_range.end - cell_range.start, diag, offset, curr_j, n = curr_v->value.size(), prev_pos;
+  Cell::pos_t len = cell_range.end - cell_range.start, diag, offset, curr_j, n = _graph->length(v), prev_pos;
   Cell::Matrix from_matrix;
 
   for (int l = 0; l < len; ++l) {
@@ -504,8 +1962,13 @@ void TheseusAlignerImpl::check_and_store_jumps(Graph::vertex *curr_v,
     if (curr_j == n && offset <= _seq.size()) {
       from_matrix = curr_wavefront[cell_range.start + l].from_matrix;
       prev_pos = curr_wavefront[cell_range.start + l].prev_pos;
-      store_M_jump(curr_v, curr_wavefront[cell_range.start + l], prev_pos, from_matrix);
-      store_I_jump(curr_v, curr_wavefront[cell_range.start + l], prev_pos, from_matrix);
+      store_M_jump(v, curr_wavefront[cell_range.start + l], prev_pos, from_matrix);
+      if constexpr (matrix == Cell::Matrix::I2) {
+        store_I2_jump(v, curr_wavefront[cell_range.start + l], prev_pos, from_matrix);
+      }
+      else {
+        store_I_jump(v, curr_wavefront[cell_range.start + l], prev_pos, from_matrix);
+      }
     }
   }
 }
@@ -513,40 +1976,46 @@ void TheseusAlignerImpl::check_and_store_jumps(Graph::vertex *curr_v,
 
 // Compute the Longest Common Prefix between two given sequences
 void TheseusAlignerImpl::LCP(std::string_view query,
-                             std::string &vertex_text,
+                             int v,
                              int &offset,
                              int &j) {
 
-    // Find LCP
-    int len_seq_1 = query.size();
-    int len_seq_2 = vertex_text.size();
-    while (offset < len_seq_1 && j < len_seq_2 && query[offset] == vertex_text[j]) {
-        offset = offset + 1;   // Update the f.r. of this diagonal
-        j = j + 1;
+    // Find LCP (vectorized kernel selected at construction, or 32 bases per
+    // word if the sequences are packed)
+    int max_len = std::min((int)query.size() - offset, _graph->length(v) - j);
+    if (max_len <= 0) {
+        return;
     }
+    int len = (_graph->is_packed()) ?
+              packed_lcp(_packed_seq, offset, _graph->packed_arena(), _graph->seq_offset(v) + j, max_len) :
+              _lcp_kernel(query.data() + offset, _graph->seq_data(v) + j, max_len);
+    offset = offset + len;   // Update the f.r. of this diagonal
+    j = j + len;
 }
 
 
-// TODO: Implement different end conditions as Global, Semi-Global...
 void TheseusAlignerImpl::check_end_condition(Cell curr_data, // Offset and prev_index
                         int j,
                         int v) {
 
-  int j_end = _graph._vertices[v].value.size(); // The last node is empty
-  if (!_is_msa && curr_data.offset == _seq.size()) {
-    _end = true;
-    _start_pos = curr_data;
-  }
-  else if (_is_msa && curr_data.offset == _seq.size() && v == _end_vertex && j == j_end) { // End condition global alignment
+  // Free end (any position of the graph, possibly with free trailing query
+  // bases) or fixed end (e.g., global alignment). Within a vertex, the end is
+  // the furthest reaching cell on the highest diagonal, so that it does not
+  // depend on the order of the cells (see compute_pairwise_waves).
+  if (curr_data.offset >= _end_offset &&
+      (_target_vertex < 0 || (v == _target_vertex && j == _target_col))) {
+    if (!_end || curr_data.vertex_id != _start_pos.vertex_id ||
+        curr_data.offset > _start_pos.offset ||
+        (curr_data.offset == _start_pos.offset && curr_data.diag >= _start_pos.diag)) {
+      _start_pos = curr_data;
+    }
     _end = true;
-    _start_pos = curr_data;
   }
 }
 
 
 // Extend a particular diagonal
 void TheseusAlignerImpl::extend_diagonal(
-    Graph::vertex *curr_v,
     Cell &curr_cell,
     int v,
     Cell &prev_cell,
@@ -555,14 +2024,15 @@ void TheseusAlignerImpl::extend_diagonal(
 
   // Longest Common prefix
   int j = curr_cell.diag + curr_cell.offset;
-  LCP(_seq, curr_v->value, curr_cell.offset, j); // Find Longest Common Prefix
+  LCP(_seq, v, curr_cell.offset, j); // Find Longest Common Prefix
+  _max_extended_offset = std::max(_max_extended_offset, (int)curr_cell.offset);
 
   // End condition
   check_end_condition(curr_cell, j, v); // Check end condition
 
   // Check jump
-  if (j == curr_v->value.size() && curr_cell.offset <= _seq.size() && curr_v->out_edges.size() > 0) {
-    store_M_jump(curr_v, prev_cell, prev_pos, from_matrix); // Store the jump in neighbours
+  if (j == _graph->length(v) && curr_cell.offset <= _seq.size() && _graph->out_degree(v) > 0) {
+    store_M_jump(v, prev_cell, prev_pos, from_matrix); // Store the jump in neighbours
   }
 }
 
@@ -608,7 +2078,8 @@ void TheseusAlignerImpl::one_backtrace_step(
   Cell prev_cell;
   if (curr_cell.from_matrix == Cell::Matrix::M) prev_cell = _beyond_scope->m_wf()[curr_cell.prev_pos];
   else if (curr_cell.from_matrix == Cell::Matrix::MJumps) prev_cell = _beyond_scope->m_jumps_wf()[curr_cell.prev_pos];
-  else prev_cell = _beyond_scope->i_jumps_wf()[curr_cell.prev_pos];
+  else if (curr_cell.from_matrix == Cell::Matrix::IJumps) prev_cell = _beyond_scope->i_jumps_wf()[curr_cell.prev_pos];
+  else prev_cell = _beyond_scope->i2_jumps_wf()[curr_cell.prev_pos];
 
   // Inside the same vertex or jump
   int num_indels;
@@ -636,7 +2107,7 @@ void TheseusAlignerImpl::one_backtrace_step(
     add_matches(prev_cell.offset, curr_cell.offset);                    // Add the necessary matches
     _alignment.path.push_back(prev_cell.vertex_id); // Add the new vertex to the path
     int col_in_prev_v = prev_cell.diag + prev_cell.offset;
-    int num_insertions = _graph._vertices[prev_cell.vertex_id].value.size() - col_in_prev_v;
+    int num_insertions = _graph->length(prev_cell.vertex_id) - col_in_prev_v;
     for (int l = 0; l < num_insertions; ++l) add_insertion();                   // Add the necessary insertions
   }
 
@@ -649,15 +2120,19 @@ void TheseusAlignerImpl::backtrace(int initial_vertex)
 {
 
   Cell curr_pos = _start_pos;
-  _alignment.start_offset = _start_offset;
   _alignment.end_offset = curr_pos.diag + curr_pos.offset; // Vertex offset = j
   _alignment.path.push_back(curr_pos.vertex_id);
-  while (curr_pos.prev_pos != -1)
+  while (curr_pos.prev_pos >= 0)
   {
     one_backtrace_step(curr_pos);
   }
 
-  add_matches(0, curr_pos.offset); // Add the matches until the beginning of the sequence
+  // Starting position and skipped leading query or graph bases (ends-free)
+  _alignment.start_index = -1 - curr_pos.prev_pos;
+  int start_col = std::max((int)curr_pos.diag, _starts[_alignment.start_index].col);
+  _alignment.start_offset = start_col;
+  _alignment.query_start = start_col - curr_pos.diag;
+  add_matches(_alignment.query_start, curr_pos.offset); // Add the matches until the beginning of the alignment
 
   std::reverse(_alignment.edit_op.begin(), _alignment.edit_op.end());
   std::reverse(_alignment.path.begin(), _alignment.path.end());
@@ -667,13 +2142,13 @@ void TheseusAlignerImpl::backtrace(int initial_vertex)
 // Output functions
 // Print as GFA
 void TheseusAlignerImpl::print_as_gfa(std::ofstream &out_stream) {
-  _graph.print_as_gfa(out_stream);
+  _msa_graph.print_as_gfa(out_stream);
 }
 
 
 // Print in dot format
 void TheseusAlignerImpl::print_as_dot(std::ofstream &out_stream) {
-  _graph.print_code_graphviz(out_stream);
+  _msa_graph.print_code_graphviz(out_stream);
 }
 
 
@@ -713,10 +2188,10 @@ void TheseusAlignerImpl::print_as_gaf(
   out_stream << "\t" << _seq.size();
 
   // Field 3: Query start
-  out_stream << "\t" << 0;
+  out_stream << "\t" << alignment.query_start;
 
   // Field 4: Query end
-  out_stream << "\t" << _seq.size();
+  out_stream << "\t" << alignment.query_end;
 
   // Field 5: Strand
   out_stream << "\t" << "+"; // TODO: Support reverse strand
@@ -724,18 +2199,18 @@ void TheseusAlignerImpl::print_as_gaf(
   // Field 6: Alignment path
   out_stream << "\t";
   for (int l = 0; l < alignment.path.size(); ++l) {
-    out_stream << ">" << _graph._vertices[alignment.path[l]].name; // TODO: Support orientation
+    out_stream << ">" << _graph->name(alignment.path[l]); // TODO: Support orientation
   }
 
   // Field 7: Target length
   int target_length = 0;
   for (int l = 0; l < alignment.path.size(); ++l) {
-    target_length += _graph._vertices[alignment.path[l]].value.size();
+    target_length += _graph->length(alignment.path[l]);
   }
   out_stream << "\t" << target_length;
 
   // Field 8: Target start
-  out_stream << "\t" << _start_offset;
+  out_stream << "\t" << alignment.start_offset;
 
   // Field 9: Target end
   out_stream << "\t" << alignment.end_offset;
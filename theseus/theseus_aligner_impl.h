@@ -28,33 +28,65 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <limits>
+#include <optional>
 #include <queue>
+#include <span>
 #include <set>
+#include <unordered_set>
 #include <algorithm>
 
 #include "theseus/alignment.h"
 #include "theseus/penalties.h"
+#include "theseus/theseus_aligner.h"
 
 #include "graph.h"
+#include "csr_graph.h"
+#include "banded_dp.h"
 #include "beyond_scope.h"
 #include "cell.h"
+#include "dense_wave.h"
 #include "scope.h"
 #include "scratchpad.h"
 #include "vertices_data.h"
 #include "wavefront.h"
 #include "internal_penalties.h"
+#include "lane_dp.h"
+#include "lcp.h"
 #include "msa.h"
 
 namespace theseus {
 
 class TheseusAlignerImpl {
 public:
+    /**
+     * @brief Construct a new aligner from a mutable graph. The graph is only
+     * kept (and modified) in MSA mode.
+     *
+     * @param penalties
+     * @param graph
+     * @param msa
+     */
     TheseusAlignerImpl(const Penalties &penalties,
                        Graph &&graph,
                        bool msa);
 
+    /**
+     * @brief Construct a new (non-MSA) aligner on a shared read-only graph.
+     * The aligner only owns its workspace (the mutable alignment data), so
+     * several aligners (e.g., one per thread) can share the same graph
+     * without any synchronization.
+     *
+     * @param penalties
+     * @param graph
+     */
+    TheseusAlignerImpl(const Penalties &penalties,
+                       std::shared_ptr<const CSRGraph> graph);
+
     /**
      * @brief Main alignment function. Aligns the given sequence to the graph
      * starting at the specified node and offset.
@@ -65,9 +97,165 @@ public:
      * @return                  Alignment object
      */
     Alignment align(std::string_view seq,
-                    std::string &start_node,
+                    const std::string &start_node,
                     int start_offset = 0);
 
+    /**
+     * @brief Multi-source alignment. Aligns the given sequence from the best
+     * of several starting positions in a single run (all of them are initial
+     * cells of the same wavefronts). The index of the winning starting
+     * position is returned in Alignment::start_index.
+     *
+     * @param seq               Sequence to be aligned
+     * @param starts            Candidate starting positions
+     * @return                  Alignment object
+     */
+    Alignment align(std::string_view seq,
+                    std::span<const StartPosition> starts);
+
+    /**
+     * @brief Check whether the sequence aligns from the starting position
+     * with a score of at most "max_score". The waves are computed without
+     * backtrace data and stop as soon as the score exceeds max_score.
+     *
+     * @param seq               Sequence to be verified
+     * @param start_node        Starting node in the graph
+     * @param start_offset      Starting offset within the starting node
+     * @param max_score         Maximum score
+     * @return                  Optimal score (std::nullopt if above max_score)
+     */
+    std::optional<int> verify(std::string_view seq,
+                              const std::string &start_node,
+                              int start_offset,
+                              int max_score);
+
+    /**
+     * @brief Extend an anchor (query position aligned to a graph position)
+     * in both directions. The suffix of the query is aligned forward from the
+     * anchor and the reverse complement of the prefix is aligned forward from
+     * the anchor on the opposite strand (the reverse complement vertices of
+     * the GFA graph). Both halves are joined into one alignment.
+     *
+     * @param seq               Sequence to be aligned
+     * @param query_pos         Query position of the anchor
+     * @param anchor_node       Anchor node in the graph
+     * @param anchor_offset     Anchor offset within the anchor node
+     * @return                  Alignment object
+     */
+    Alignment extend(std::string_view seq,
+                     int query_pos,
+                     const std::string &anchor_node,
+                     int anchor_offset);
+
+    /**
+     * @brief Align a set of sequences from the same starting position. The
+     * wavefronts are shared between sequences with a common prefix: the
+     * state of the alignment is saved before the waves read the query beyond
+     * the prefix, and the next sequences resume from there. The sequences
+     * should be sorted (lexicographically) so that consecutive sequences
+     * share the longest prefixes. The results are the same as aligning each
+     * sequence on its own. Falls back to independent alignments with A*
+     * pruning and in the low memory mode.
+     *
+     * @param seqs              Sequences to be aligned
+     * @param start_node        Starting node in the graph
+     * @param start_offset      Starting offset within the starting node
+     * @param callback          Called once per sequence (callback(idx, alignment))
+     */
+    void align_shared_prefixes(std::span<const std::string_view> seqs,
+                               const std::string &start_node,
+                               int start_offset,
+                               const std::function<void(size_t, Alignment &)> &callback);
+
+    /**
+     * @brief Align a set of sequences from the same starting position in
+     * lockstep (see LockstepBatching): the sequences of at most max_length
+     * bases are aligned in groups of LaneDP::lanes with the lane DP. The
+     * sequences whose alignment is not proven optimal are aligned again with
+     * twice the band, until it covers them. The perfect matches, the longer
+     * sequences and those not aligned by the lane DP are aligned on their
+     * own, as are all of them when the lane DP can not be used (MSA,
+     * score-only scope, ends-free and early termination).
+     *
+     * @param seqs              Sequences to be aligned
+     * @param start_node        Starting node in the graph
+     * @param start_offset      Starting offset within the starting node
+     * @param callback          Called once per sequence (callback(idx, alignment))
+     */
+    void align_lockstep(std::span<const std::string_view> seqs,
+                        const std::string &start_node,
+                        int start_offset,
+                        const std::function<void(size_t, Alignment &)> &callback);
+
+    /**
+     * @brief Set the memory mode (see MemoryMode). The low memory mode is
+     * not available for MSA and for graphs with overlaps (the default mode is
+     * used instead).
+     *
+     * @param mode
+     */
+    void set_memory_mode(MemoryMode mode);
+
+    /**
+     * @brief Set the alignment scope (see AlignmentScope). The score-only
+     * scope is not available for MSA (the full alignment is computed).
+     *
+     * @param scope
+     */
+    void set_alignment_scope(AlignmentScope scope);
+
+    /**
+     * @brief Set the adaptive wavefront reduction heuristic (see
+     * WavefrontReduction).
+     *
+     * @param reduction
+     */
+    void set_wavefront_reduction(const WavefrontReduction &reduction);
+
+    /**
+     * @brief Set the early termination criteria (see EarlyTermination). Not
+     * applied to MSA.
+     *
+     * @param termination
+     */
+    void set_early_termination(const EarlyTermination &termination);
+
+    /**
+     * @brief Set the ends-free alignment (see EndsFree). Only applied to the
+     * passes with a free end (not to MSA nor to the fixed-end passes of the
+     * low memory mode).
+     *
+     * @param ends_free
+     */
+    void set_ends_free(const EndsFree &ends_free);
+
+    /**
+     * @brief Set the banded DP fallback for divergent sequences (see
+     * DPFallback).
+     *
+     * @param fallback
+     */
+    void set_dp_fallback(const DPFallback &fallback);
+
+    /**
+     * @brief Set the lockstep alignment of short sequences (see
+     * LockstepBatching and align_lockstep).
+     *
+     * @param lockstep
+     */
+    void set_lockstep_batching(const LockstepBatching &lockstep);
+
+    /**
+     * @brief Enable A* pruning with graph distance lower bounds (see
+     * lower_bound). The index with the longest remaining path of each vertex
+     * is built on the first use. Only applied to the passes with a free end
+     * and a known score bound (verify and the maximum score of the early
+     * termination), where it is exact.
+     *
+     * @param enabled
+     */
+    void set_astar_pruning(bool enabled);
+
     /**
      * @brief Output the current graph in GFA format.
      *
@@ -106,26 +294,466 @@ public:
             std::ostream &out_stream,
             std::string seq_name);
 
+    /**
+     * @brief Cells per matrix that the backtrace can reference (see
+     * backtrace_fits). Cell::max_pos, only lowered by the tests to reach
+     * the paths of overflow_result. Shared by all the aligners: it must not
+     * change while any of them is aligning.
+     *
+     */
+    static inline int backtrace_pos_limit = Cell::max_pos;
+
 private:
+    /**
+     * @brief A position in the graph (vertex and column).
+     *
+     */
+    struct GraphPos {
+        int vertex;
+        int col;
+    };
+
+    /**
+     * @brief A cell of a wavefront together with its score (used to find the
+     * breakpoints of the bidirectional alignment).
+     *
+     */
+    struct WaveCell {
+        int score;
+        int vertex;
+        int diag;
+        int offset;
+
+        static bool less_position(const WaveCell &c1, const WaveCell &c2) {
+            return (c1.vertex != c2.vertex) ? c1.vertex < c2.vertex : c1.diag < c2.diag;
+        }
+    };
+
+    /**
+     * @brief Pending vertex of the exact match search.
+     *
+     */
+    struct ExactMatchStep {
+        int vertex;
+        int col;
+        int offset;
+        int depth;          // Position of the vertex in the path
+        int start;          // Index of the starting position
+        int start_col;      // Starting offset (after the free graph bases)
+        int query_start;    // Free leading query bases
+    };
+
+    /**
+     * @brief State of an alignment at the beginning of a score, saved to
+     * resume the alignment of other sequences sharing its prefix.
+     *
+     */
+    struct PrefixSnapshot {
+        int min_prefix;             // Shared prefix required to resume from it
+        int score;
+        Scope scope;
+        BeyondScope::Mark beyond_scope;
+        VerticesData::Snapshot vertices_data;
+        std::vector<int> reduction_cutoffs;
+        std::vector<int64_t> xdrop_values;
+        int64_t pruned_cells;
+        int last_live_wave;
+        Cell best_cell;
+        int best_score;
+        int64_t best_value;
+
+        PrefixSnapshot(int nscores) : scope(nscores, 16) {}
+    };
+
+    // Dead ends (or steps without progress) allowed in the exact match search
+    // since the furthest query offset was last reached
+    static constexpr int exact_match_max_failures = 32;
+
+    // Scores between two snapshots of the shared prefixes
+    static constexpr int prefix_snapshot_interval = 4;
+
+    // Problems with a lower score are aligned storing the whole backtrace
+    static constexpr int bidirectional_min_score = 64;
+
+    // Maximum number of score windows searched (and breakpoints tried) per split
+    static constexpr int bidirectional_max_attempts = 4;
+
+    /**
+     * @brief Align the sequence from the best of the given starting positions
+     * (the starting position is fixed in MSA).
+     *
+     * @param seq
+     * @param starts
+     * @return Alignment
+     */
+    Alignment align_from(std::string_view seq,
+                         std::span<const GraphPos> starts);
+
+    /**
+     * @brief Look for a perfect match of the sequence from one of the starting
+     * positions before launching the wavefront algorithm. The graph is walked
+     * with a depth-first search that follows the out-edges while the query
+     * keeps matching (the search gives up after exact_match_max_failures
+     * dead ends in a row that do not get further in the query). If found, the alignment (the same one that the wavefronts
+     * would find at score 0) is stored in _alignment.
+     *
+     * This is only a yes/no check: if it fails, the wavefronts start from
+     * scratch and their score 0 repeats the extension of the matching
+     * prefix. A failed check costs at most that extension again (plus the
+     * dead ends), and its scratch data is kept in the workspace, so it does
+     * not allocate once warmed up.
+     *
+     * @param seq
+     * @param starts
+     * @return bool    True if a perfect match was found
+     */
+    bool exact_match(std::string_view seq,
+                     std::span<const GraphPos> starts);
+
+    /**
+     * @brief Check whether the dense pairwise engine can be used: a single
+     * starting position in a vertex without out-edges (the alignment never
+     * leaves it), no options that depend on the order of the cells (MSA,
+     * low memory mode, wavefront reduction and early termination), no dual
+     * affine gaps and no banded DP fallback.
+     *
+     * @param starts
+     * @return bool
+     */
+    bool use_pairwise(std::span<const GraphPos> starts) const;
+
+    /**
+     * @brief Compute the waves of a pass started with start_pass in a single
+     * vertex with dense per-score waves instead of the graph data structures
+     * (no jumps, invalid segments or scratchpad). The cells, the end and the
+     * backtrace data (M cells in the beyond scope) are the same as with
+     * compute_waves.
+     *
+     */
+    void compute_pairwise_waves();
+
+    /**
+     * @brief Score above which the waves of a full pass give up and the
+     * banded DP fallback is used (see DPFallback), or the maximum int if the
+     * fallback is disabled or can not be used.
+     *
+     * @param starts
+     * @return int
+     */
+    int fallback_score(std::span<const GraphPos> starts) const;
+
+    /**
+     * @brief Align the sequence of the current pass with the banded DP (see
+     * BandedDP) and build the result. The DP starts from the starting
+     * position: the waves of the pass are not reused.
+     *
+     * @param starts
+     * @return Alignment
+     */
+    Alignment fallback_result(std::span<const GraphPos> starts);
+
+    /**
+     * @brief Build the result of a score-only pass (see score_only_pass).
+     *
+     * @param starts
+     * @return Alignment
+     */
+    Alignment score_only_result(std::span<const GraphPos> starts);
+
+    /**
+     * @brief Align the sequence again when the cells stored for the
+     * backtrace do not fit in the cell positions (see backtrace_fits): in low
+     * memory mode, each start on its own, or with the banded DP if that mode
+     * can not be used. Throws std::length_error if neither can be used (MSA).
+     *
+     * @param seq
+     * @param starts
+     * @return Alignment
+     */
+    Alignment overflow_result(std::string_view seq,
+                              std::span<const GraphPos> starts);
+
+    /**
+     * @brief Build the result of an alignment in low memory mode (see
+     * align_bidirectional).
+     *
+     * @param memory_fallback Value of Alignment::memory_fallback
+     * @return Alignment
+     */
+    Alignment bidirectional_result(bool memory_fallback);
+
+    /**
+     * @brief Backtrace the optimal (or best partial) alignment of a pass
+     * storing the backtrace data.
+     *
+     * @return Alignment
+     */
+    Alignment full_result();
+
+    /**
+     * @brief Allocate the alignment data structures.
+     *
+     */
+    void init();
+
     /**
      * @brief Initialize the data for a new alignment.
      *
      */
     void new_alignment();
 
+    /**
+     * @brief Make the scratchpad large enough for the diagonals of the
+     * current sequence.
+     *
+     */
+    void fit_scratchpad();
+
+    /**
+     * @brief Save the state of the current pass (at the beginning of _score).
+     *
+     * @param snapshot
+     */
+    void save_prefix_snapshot(PrefixSnapshot &snapshot);
+
+    /**
+     * @brief Resume a pass with free end from a snapshot of a sequence that
+     * shares at least snapshot.min_prefix bases with "seq".
+     *
+     * @param seq
+     * @param snapshot
+     */
+    void resume_pass(std::string_view seq, const PrefixSnapshot &snapshot);
+
+    /**
+     * @brief Take the snapshots of the shared prefixes (_prefix_levels) of
+     * the current sequence. Called at the beginning of each score: a
+     * candidate snapshot is saved every prefix_snapshot_interval scores and
+     * pushed when the waves read the query beyond a prefix level.
+     *
+     */
+    void track_prefix_snapshots();
+
+    /**
+     * @brief Reset the alignment data structures and set the initial (and
+     * final) conditions of a new pass of the wavefront algorithm.
+     *
+     * @param seq               Sequence to be aligned
+     * @param start_vertex      Starting vertex
+     * @param start_offset      Starting offset within the starting vertex
+     * @param target_vertex     Ending vertex (-1 for a free end)
+     * @param target_col        Ending offset within the ending vertex
+     * @param store_backtrace   Keep the cells needed for the backtrace (if
+     *                          false, only the cells in the scope are kept)
+     */
+    void start_pass(std::string_view seq,
+                    int start_vertex,
+                    int start_offset,
+                    int target_vertex,
+                    int target_col,
+                    bool store_backtrace);
+
+    /**
+     * @brief Same as above, with several starting positions (multi-source).
+     *
+     * @param seq
+     * @param starts
+     * @param target_vertex
+     * @param target_col
+     * @param store_backtrace
+     */
+    void start_pass(std::string_view seq,
+                    std::span<const GraphPos> starts,
+                    int target_vertex,
+                    int target_col,
+                    bool store_backtrace);
+
+    /**
+     * @brief Compute the waves of increasing score until the end condition is
+     * met or "max_score" is exceeded.
+     *
+     * @param max_score
+     * @param early_termination Apply the early termination criteria (the
+     *                          computation also stops if _status is set)
+     */
+    void compute_waves(int max_score, bool early_termination = false);
+
+    /**
+     * @brief Check that the cells stored for the backtrace can still be
+     * referenced by Cell::prev_pos (at most backtrace_pos_limit cells per
+     * matrix). Otherwise, the pass stops and sets _backtrace_overflow.
+     *
+     * @return bool
+     */
+    bool backtrace_fits() const;
+
+    /**
+     * @brief Keep track of the best partial alignment (furthest reaching M
+     * cell) and check the early termination criteria on the current wave.
+     * Sets _status if the alignment has to be terminated.
+     *
+     */
+    void check_early_termination();
+
+    /**
+     * @brief Compute the optimal score and end position (stored in _score
+     * and _start_pos) without storing the backtrace data.
+     *
+     * @param seq
+     * @param starts
+     */
+    void score_only_pass(std::string_view seq,
+                         std::span<const GraphPos> starts);
+
+    /**
+     * @brief Prune the current wave. With the adaptive wavefront reduction,
+     * compute the minimum offset that a cell needs to be used by the next
+     * scores (see reduction_cutoff) and count the dropped cells. Then update
+     * the last score with live cells of each vertex: cells that are not
+     * dropped and, with A* pruning, whose lower bound keeps them within the
+     * score bound.
+     *
+     */
+    void prune_wavefront();
+
+    /**
+     * @brief A* lower bound of the cost to reach the end from a cell: if the
+     * longest path ahead in the graph is shorter than the remaining query,
+     * the rest of the query needs a gap.
+     *
+     * @param cell
+     * @return int
+     */
+    int lower_bound(const Cell &cell) const {
+        int64_t graph_ahead = (int64_t)(*_max_remaining)[cell.vertex_id] - (cell.diag + cell.offset);
+        int64_t gap = (int64_t)(_end_offset - cell.offset) - graph_ahead;
+        if (gap <= 0) return 0;
+        int64_t gap_score = _internal_penalties.gapo() + _internal_penalties.gape() * gap;
+        if (_internal_penalties.type() == Penalties::Type::DualAffine) {
+            gap_score = std::min<int64_t>(gap_score, _internal_penalties.gapo2() + _internal_penalties.gape2() * gap);
+        }
+        return (int)std::min<int64_t>(gap_score, std::numeric_limits<int>::max() / 2);
+    }
+
+    /**
+     * @brief Minimum offset of the cells of a given score to be used as the
+     * source of new cells (-1 if the wave of that score was not reduced).
+     *
+     * @param score
+     * @return int
+     */
+    int reduction_cutoff(int score) {
+        return (score >= 0) ? _reduction_cutoffs[_vertices_data->get_pos(score)] : -1;
+    }
+
+    /**
+     * @brief Gather the M cells (including M jumps) of all the scores that are
+     * still in the scope.
+     *
+     * @param cells
+     */
+    void collect_m_cells(std::vector<WaveCell> &cells);
+
+    /**
+     * @brief Align the sequence in low memory mode. A score-only pass finds
+     * the optimal score and end position, then the alignment is split
+     * recursively (see bidirectional_step).
+     *
+     * @param seq
+     * @param start_vertex
+     * @param start_offset
+     * @param target_vertex Ending vertex (-1 for a free end)
+     * @param target_col Ending offset within the ending vertex
+     * @return bool False if the low memory mode can not be used (the caller
+     * falls back to the default mode)
+     */
+    bool align_bidirectional(std::string_view seq,
+                             int start_vertex,
+                             int start_offset,
+                             int target_vertex = -1,
+                             int target_col = 0);
+
+    /**
+     * @brief Align seq from "start" to "end" given its optimal score. The
+     * forward wavefronts (on the graph) and the reverse wavefronts (on the
+     * reverse graph) are computed without backtrace until they overlap in a
+     * breakpoint, and both halves are aligned recursively. Small problems, and
+     * the problems without a breakpoint in the windows that are searched
+     * (flagged in _memory_fallback), are aligned storing the backtrace.
+     * Appends the result to "alignment".
+     *
+     * @param seq
+     * @param start
+     * @param end
+     * @param score
+     * @param alignment
+     * @return bool False if no alignment with the given score was found
+     */
+    bool bidirectional_step(std::string_view seq,
+                            GraphPos start,
+                            GraphPos end,
+                            int score,
+                            Alignment &alignment);
+
+    /**
+     * @brief Wavefront with the M cells of a given score (all the M cells if
+     * the backtrace is stored).
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &m_wf(int score) {
+        return (_store_backtrace) ? _beyond_scope->m_wf() : _scope->m_wf(score);
+    }
+
+    /**
+     * @brief Wavefront with the M jumps of a given score (all the M jumps if
+     * the backtrace is stored).
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &m_jumps_wf(int score) {
+        return (_store_backtrace) ? _beyond_scope->m_jumps_wf() : _scope->m_jumps_wf(score);
+    }
+
+    /**
+     * @brief Wavefront with the I jumps of a given score (all the I jumps if
+     * the backtrace is stored).
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &i_jumps_wf(int score) {
+        return (_store_backtrace) ? _beyond_scope->i_jumps_wf() : _scope->i_jumps_wf(score);
+    }
+
+    /**
+     * @brief I2 jumps of a given score (see m_wf).
+     *
+     * @param score
+     * @return Cell::CellVector&
+     */
+    Cell::CellVector &i2_jumps_wf(int score) {
+        return (_store_backtrace) ? _beyond_scope->i2_jumps_wf() : _scope->i2_jumps_wf(score);
+    }
+
     /**
      * @brief Process a given vertex at a given _score. This means performing
      * the next and extend operations.
      *
-     * @param curr_v
+     * @tparam gap_type  Linear gaps only need the M matrix
      * @param v
      */
-    void process_vertex(Graph::vertex *curr_v, int v);
+    template <Penalties::Type gap_type>
+    void process_vertex(int v);
 
     /**
      * @brief Compute the wave for a given score for all active vertices.
      *
+     * @tparam gap_type  Gap model of the penalties (see _compute_new_wave)
      */
+    template <Penalties::Type gap_type>
     void compute_new_wave();
 
     /**
@@ -143,13 +771,15 @@ private:
      * @param vertex_id
      * @param new_score_diff
      * @param prev_matrix
+     * @param min_offset  Cells with a lower offset are dropped (wavefront reduction)
      */
     void sparsify_M_data(Cell::CellVector &dense_wf,
                          int offset_increase,
                          int shift_factor,
                          Scope::range cells_range,
                          int m,
-                         int upper_bound);
+                         int upper_bound,
+                         int min_offset);
 
     /**
      * @brief Sparsify the jumps data. This means storing the data in the scratchpad
@@ -166,6 +796,7 @@ private:
      * @param vertex_id
      * @param new_score_diff
      * @param prev_matrix
+     * @param min_offset  Cells with a lower offset are dropped (wavefront reduction)
      */
     void sparsify_jumps_data(Cell::CellVector &dense_wf,
                              std::vector<Cell::pos_t> &jumps_positions,
@@ -173,6 +804,7 @@ private:
                              int shift_factor,
                              int m,
                              int upper_bound,
+                             int min_offset,
                              Cell::Matrix from_matrix);
 
     /**
@@ -190,24 +822,25 @@ private:
      * @param vertex_id
      * @param new_score_diff
      * @param prev_matrix
+     * @param min_offset  Cells with a lower offset are dropped (wavefront reduction)
      */
     void sparsify_indel_data(Cell::CellVector &dense_wf,
                              int offset_increase,
                              int shift_factor,
                              Scope::range cells_range,
                              int m,
-                             int upper_bound);
+                             int upper_bound,
+                             int min_offset);
 
     /**
      * @brief Compute the next I matrix for a vertex v. This implies both sparsifying
      * the data in the scratchpad and storing it back on the new wavefront, once the
      * corresponding maximums and checks have been done.
      *
-     * @param curr_v
      * @param upper_bound // Maximum value of the diagonal
      * @param v
      */
-    void next_I(Graph::vertex *curr_v, int upper_bound, int v);
+    void next_I(int upper_bound, int v);
 
 
     /**
@@ -215,35 +848,68 @@ private:
      * the data in the scratchpad and storing it back on the new wavefront, once the
      * corresponding maximums and checks have been done.
      *
-     * @param curr_v
      * @param upper_bound // Maximum value of the diagonal
      * @param v
      */
     void next_D(int upper_bound, int v);
 
 
+    /**
+     * @brief Compute the next I2 matrix for a vertex v (dual affine gaps: the
+     * insertions with the second gap penalties). Same as next_I.
+     *
+     * @param upper_bound // Maximum value of the diagonal
+     * @param v
+     */
+    void next_I2(int upper_bound, int v);
+
+
+    /**
+     * @brief Compute the next D2 matrix for a vertex v (dual affine gaps: the
+     * deletions with the second gap penalties). Same as next_D.
+     *
+     * @param upper_bound // Maximum value of the diagonal
+     * @param v
+     */
+    void next_D2(int upper_bound, int v);
+
+
     /**
      * @brief Compute the next M matrix for a vertex v. This implies both sparsifying
      * the data in the scratchpad and storing it back on the new wavefront, once the
      * corresponding maximums and checks have been done.
      *
-     * @param curr_v
+     * @tparam gap_type  The I2 and D2 matrices are also sources with dual
+     * affine gaps
      * @param upper_bound // Maximum value of the diagonal
      * @param v
      */
+    template <Penalties::Type gap_type>
     void next_M(int upper_bound, int v);
 
+
+    /**
+     * @brief Compute the next M matrix for a vertex v with linear gaps. The
+     * gaps are opened and extended from M itself (no I and D matrices): the
+     * sources are M at score - gape (deletions and insertions) and M at score
+     * - mism (mismatches), with their jumps.
+     *
+     * @param upper_bound // Maximum value of the diagonal
+     * @param v
+     */
+    void next_M_linear(int upper_bound, int v);
+
     /**
      * @brief Invalidate the diagonal associated to a jump in M, activate the newly
      * discovered vertices and store the jump in the neighbours.
      *
-     * @param curr_v
+     * @param v
      * @param prev_cell
      * @param prev_pos
      * @param prev_matrix
      * @param _score_diff
      */
-    void store_M_jump(Graph::vertex *curr_v,
+    void store_M_jump(int v,
                       Cell &prev_cell,
                       Cell::pos_t prev_pos,
                       Cell::Matrix from_matrix);
@@ -252,40 +918,55 @@ private:
      * @brief Invalidate the diagonal associated to a jump in I, activate the newly
      * discovered vertices and store the jump in the neighbours.
      *
-     * @param curr_v
+     * @param v
      * @param prev_cell
      * @param prev_pos
      * @param prev_matrix
      */
-    void store_I_jump(Graph::vertex *curr_v,
+    void store_I_jump(int v,
                       Cell &prev_cell,
                       Cell::pos_t prev_pos,
                       Cell::Matrix from_matrix);
 
+    /**
+     * @brief Same as store_I_jump for the I2 matrix (dual affine gaps).
+     *
+     * @param v
+     * @param prev_cell
+     * @param prev_pos
+     * @param prev_matrix
+     */
+    void store_I2_jump(int v,
+                       Cell &prev_cell,
+                       Cell::pos_t prev_pos,
+                       Cell::Matrix from_matrix);
+
     /**
      * @brief Check and store I jumps (that is, those diagonals that have reached
      * the last column of a vertex for matrix I).
      *
-     * @param curr_v
-     * @param curr_wavefront
-     * @param start_idx
-     * @param end_idx
+     * @tparam matrix  I or I2
      * @param v
+     * @param curr_wavefront
+     * @param cell_range
      */
-    void check_and_store_jumps(Graph::vertex *curr_v,
+    template <Cell::Matrix matrix = Cell::Matrix::I>
+    void check_and_store_jumps(int v,
                                Cell::CellVector &curr_wavefront,
                                Scope::range cell_range);
 
     /**
-     * @brief Longest Common Prefix of two sequences.
+     * @brief Longest Common Prefix of the query and the sequence of a vertex.
+     * Uses the fastest LCP kernel supported by the CPU (see lcp.h) or the
+     * packed LCP if the graph is packed.
      *
-     * @param seq_1
-     * @param seq_2
+     * @param query
+     * @param v
      * @param offset
      * @param j
      */
     void LCP(std::string_view query,
-            std::string &vertex_text,
+            int v,
             int &offset,
             int &j);
 
@@ -302,15 +983,13 @@ private:
      * @brief Exyend a given diagonal for a given vertex and perform the necessary
      * jumps.
      *
-     * @param curr_v
      * @param curr_cell
      * @param v
      * @param prev_cell
      * @param prev_pos
      * @param prev_matrix
      */
-    void extend_diagonal(Graph::vertex *curr_v,
-                         Cell &curr_cell,
+    void extend_diagonal(Cell &curr_cell,
                          int v,
                          Cell &prev_cell,
                          Cell::pos_t prev_pos,
@@ -371,17 +1050,25 @@ private:
 
     Penalties _penalties;
     InternalPenalties _internal_penalties;
+    void (TheseusAlignerImpl::*_compute_new_wave)() = nullptr;  // Specialization for the gap model
 
-    Graph _graph;   // The graph to align to
+    std::shared_ptr<const CSRGraph> _graph;     // The graph to align to (read-only)
+    std::shared_ptr<CSRGraph> _msa_csr_graph;   // Own CSR graph (only used for MSA)
+    Graph _msa_graph;                           // Mutable graph (only used for MSA)
 
     std::unique_ptr<POAGraph> _poa_graph; // Partial order alignment graph for MSA
 
     bool _is_msa;
     bool _end = false;
     int _end_vertex;
+    int _target_vertex = -1;    // Ending vertex (-1 for a free end)
+    int _target_col = 0;        // Ending offset within the ending vertex
+    int _end_offset = 0;        // Minimum query offset of the end (ends-free)
+    int _num_start_cells = 1;   // Initial cells (several if ends-free or multi-source)
+    bool _store_backtrace = true;
+    bool _backtrace_overflow = false;  // The stored cells exceed backtrace_pos_limit (see backtrace_fits)
     int _seq_ID = 0;
-    int _start_node;
-    int _start_offset;
+    std::vector<GraphPos> _starts;  // Starting positions of the current pass
     Cell _start_pos;
 
     std::unique_ptr<ScratchPad> _scratchpad;
@@ -392,6 +1079,48 @@ private:
     std::unique_ptr<VerticesData> _vertices_data;
 
     std::string_view _seq;
+    PackedSequence _packed_seq; // 2-bit query (only used if the graph is packed)
+
+    lcp::kernel_t _lcp_kernel;  // LCP implementation used in the extend
+
+    MemoryMode _memory_mode = MemoryMode::High;
+    AlignmentScope _alignment_scope = AlignmentScope::Full;
+    WavefrontReduction _reduction;
+    std::vector<int> _reduction_cutoffs;   // Minimum offset per score of the scope
+    int64_t _pruned_cells = 0;             // Cells dropped in the current alignment
+    EarlyTermination _termination;
+    EndsFree _ends_free;
+    DPFallback _dp_fallback;
+    std::unique_ptr<BandedDP> _banded_dp;   // Created on the first fallback
+    LockstepBatching _lockstep;
+    std::unique_ptr<LaneDP> _lane_dp;       // Created on the first lockstep alignment
+    std::vector<Alignment> _lane_alignments;
+    bool _astar_pruning = false;
+    const std::vector<int32_t> *_max_remaining = nullptr;  // A* index (see CSRGraph::max_remaining_lengths)
+    int _astar_bound = -1;                 // Score bound of the current pass (-1 if none)
+    int _last_live_wave = 0;               // Last score with live cells (A* pruning)
+    AlignmentStatus _status = AlignmentStatus::Aligned;
+    Cell _best_cell;            // End of the best partial alignment
+    int _best_score = 0;        // Score of the best partial alignment
+    int64_t _best_value = 0;    // X-drop value of the best partial alignment (x4)
+    std::vector<int64_t> _xdrop_values;    // X-drop value per score of the scope (x4)
+    std::shared_ptr<const CSRGraph> _reverse_graph;  // Shared by the graph (see CSRGraph::reverse_graph)
+    std::string _reverse_seq;   // Reversed (sub)sequence of the reverse passes
+    std::vector<ExactMatchStep> _exact_match_stack;    // Scratch data of exact_match
+    std::vector<int> _exact_match_path;
+    std::vector<int> _exact_match_end_path;
+    std::pmr::unsynchronized_pool_resource _exact_match_pool;  // Nodes of the set (reused)
+    std::pmr::unordered_set<int64_t> _exact_match_jumped{&_exact_match_pool};  // Vertex and diagonal
+    bool _memory_fallback = false;  // Part of the low memory alignment stored its whole backtrace
+    std::vector<DenseWave> _dense_m;       // Scope of the pairwise engine (one wave per score)
+    std::vector<DenseWave> _dense_i;
+    std::vector<DenseWave> _dense_d;
+    int _max_extended_offset = 0;          // Furthest query offset read by the current pass
+    std::vector<std::unique_ptr<PrefixSnapshot>> _prefix_snapshots; // Stack (and candidate on top)
+    size_t _num_prefix_snapshots = 0;      // Snapshots in the stack
+    bool _prefix_candidate = false;        // The candidate snapshot holds a valid state
+    std::vector<int> _prefix_levels;       // Shared prefixes of the current sequence (ascending)
+    size_t _next_prefix_level = 0;         // First level still not read beyond
 
     Alignment _alignment;
 };
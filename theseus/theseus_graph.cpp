@@ -0,0 +1,60 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdexcept>
+
+#include "theseus/theseus_graph.h"
+
+#include "csr_graph.h"
+
+namespace theseus {
+
+TheseusGraph::TheseusGraph(std::istream &gfa_stream, bool packed_sequences)
+    : graph_(std::make_shared<const CSRGraph>(gfa_stream, packed_sequences)) {}
+
+
+TheseusGraph::~TheseusGraph() {}
+
+
+int TheseusGraph::num_vertices() const {
+    return graph_->num_vertices();
+}
+
+
+bool TheseusGraph::has_vertex(const std::string &name) const {
+    try {
+        graph_->get_id(name);
+        return true;
+    }
+    catch (const std::out_of_range &) {
+        return false;
+    }
+}
+
+} // namespace theseus
@@ -73,10 +73,10 @@ public:
         std::vector<InvalidData> _m_invalid;
 
         std::vector<InvalidData> _i_invalid;
-        // std::vector<InvalidData> _i2_invalid;
+        std::vector<InvalidData> _i2_invalid;
 
         std::vector<InvalidData> _d_invalid;
-        // std::vector<InvalidData> _d2_invalid;
+        std::vector<InvalidData> _d2_invalid;
 
         // Scope with the positions of M jumps in the scope previous waves
         std::vector<std::vector<pos_t>> _m_jumps_positions;
@@ -85,7 +85,11 @@ public:
         std::vector<std::vector<pos_t>> _i_jumps_positions;
 
         // Scope with the positions of I2s jumps in the scope previous waves
-        // std::vector<std::vector<pos_t>> _i2_jumps_positions;
+        std::vector<std::vector<pos_t>> _i2_jumps_positions;
+
+        // Last score with cells that survived the wavefront reduction (only
+        // used if the reduction is enabled)
+        int32_t _last_live_score;
     };
 
     int _nscores;
@@ -98,7 +102,9 @@ public:
      * @param nexpected_vertices    Number of expected vertices.
      */
     VerticesData(const Penalties &penalties, int nscores, int nexpected_vertices) :
-        _penalties(penalties), _nscores(nscores) {
+        _penalties(penalties), _nscores(nscores),
+        _linear_gaps(penalties.type() == Penalties::Type::Linear),
+        _dual_gaps(penalties.type() == Penalties::Type::DualAffine) {
         _active_vertices.reserve(nexpected_vertices);
         _vertex_to_idx.reserve(nexpected_vertices);
     }
@@ -110,7 +116,7 @@ public:
      * @param score  Current score
      */
     void new_score(int score) {
-        int len = _active_vertices.size();
+        int len = _nactive;
         int pos_curr_score = get_pos(score);
 
         for (int l = 0; l < len; ++l) {
@@ -119,27 +125,50 @@ public:
             // Clear the jumps (they work as a scope)
             vdata._m_jumps_positions[pos_curr_score].clear();
             vdata._i_jumps_positions[pos_curr_score].clear();
+            vdata._i2_jumps_positions[pos_curr_score].clear();
         }
     }
 
     /**
      * @brief Reinitialize the vertices data object each time that a new
-     * alignment is called.
+     * alignment is called. The cost does not depend on the size of the graph:
+     * the vertex to index map is invalidated by starting a new epoch and the
+     * data of the previously active vertices is reused.
      *
      */
     void new_alignment() {
-        _active_vertices.clear();
-        _vertex_to_idx.clear();
+        _nactive = 0;
+        _epoch += 1;
+
+        // Epoch overflow, reset all the stamps
+        if (_epoch == 0) {
+            std::fill(_vertex_to_idx.begin(), _vertex_to_idx.end(), VertexStamp{0, -1});
+            _epoch = 1;
+        }
+    }
+
+    /**
+     * @brief Make room in the vertex to index map for "nvertices" vertices, so
+     * that activating a vertex never needs to grow the map.
+     *
+     * @param nvertices Number of vertices of the graph
+     */
+    void reserve_vertices(int nvertices) {
+        if ((int)_vertex_to_idx.size() < nvertices) {
+            _vertex_to_idx.resize(nvertices, VertexStamp{0, -1});
+        }
     }
 
     /**
      * @brief Get the id of a given vertex.
      *
      * @param vtx   Vertex id
-     * @return Cell::vertex_t  Index of the vertex in the active vertices
+     * @return Cell::vertex_t  Index of the vertex in the active vertices (-1 if
+     * the vertex is not active)
      */
     Cell::vertex_t get_id(int vtx) {
-        return _vertex_to_idx[vtx];
+        const VertexStamp &stamp = _vertex_to_idx[vtx];
+        return (stamp.epoch == _epoch) ? stamp.idx : -1;
     }
 
     /**
@@ -159,7 +188,7 @@ public:
      * @return VertexData&  Data of the vertex
      */
     VertexData &get_vertex_data(int vtx) {
-        return _active_vertices[_vertex_to_idx[vtx]];
+        return _active_vertices[_vertex_to_idx[vtx].idx];
     }
 
     /**
@@ -271,14 +300,15 @@ public:
      *
      */
     void expand() {
-        for (int l = 0; l < _active_vertices.size(); ++l) {
+        for (int l = 0; l < _nactive; ++l) {
             auto &vdata = _active_vertices[l];
             expand_invalid_vector(vdata._m_invalid, _penalties.gape(), _penalties.gape());
+            if (_linear_gaps) continue;     // No I and D matrices
             expand_invalid_vector(vdata._i_invalid, _penalties.gape(), _penalties.gape());
             expand_invalid_vector(vdata._d_invalid, _penalties.gape(), _penalties.gape());
-
-            // expand_invalid_vector(vdata._i2_invalid, TODO, TODO);
-            // expand_invalid_vector(vdata._d2_invalid, TODO, TODO);
+            if (!_dual_gaps) continue;
+            expand_invalid_vector(vdata._i2_invalid, _penalties.gape2(), _penalties.gape2());
+            expand_invalid_vector(vdata._d2_invalid, _penalties.gape2(), _penalties.gape2());
         }
     }
 
@@ -287,21 +317,24 @@ public:
      *
      */
     void compact() {
-        for (int l = 0; l < _active_vertices.size(); ++l) {
+        for (int l = 0; l < _nactive; ++l) {
             compact_invalid_vector(_active_vertices[l]._m_invalid,
                                    _penalties.gape(),
                                    _penalties.gape());
+            if (_linear_gaps) continue;     // No I and D matrices
             compact_invalid_vector(_active_vertices[l]._i_invalid,
                                    _penalties.gape(),
                                    _penalties.gape());
             compact_invalid_vector(_active_vertices[l]._d_invalid,
                                    _penalties.gape(),
                                    _penalties.gape());
-
-            // compact_invalid_vector(_active_vertices[l]._i2_invalid, TODO,
-            // TODO);
-            // compact_invalid_vector(_active_vertices[l]._d2_invalid, TODO,
-            // TODO);
+            if (!_dual_gaps) continue;
+            compact_invalid_vector(_active_vertices[l]._i2_invalid,
+                                   _penalties.gape2(),
+                                   _penalties.gape2());
+            compact_invalid_vector(_active_vertices[l]._d2_invalid,
+                                   _penalties.gape2(),
+                                   _penalties.gape2());
         }
     }
 
@@ -355,6 +388,9 @@ public:
         new_invalid.seg.start_d = diag;
         new_invalid.seg.end_d = diag;
         vdata._m_invalid.push_back(new_invalid);
+        if (_linear_gaps) {
+            return;     // No I and D matrices
+        }
 
         // New invalid in I (initially empty)
         new_invalid.rem_down = 2 * (_penalties.gapo() + _penalties.gape());
@@ -369,6 +405,41 @@ public:
         new_invalid.seg.start_d = diag;
         new_invalid.seg.end_d = diag - 1;
         vdata._d_invalid.push_back(new_invalid);
+        if (!_dual_gaps) {
+            return;
+        }
+
+        // New invalid in I2 and D2 (as in I and D, with the second gap
+        // penalties)
+        new_invalid.rem_down = 2 * (_penalties.gapo2() + _penalties.gape2());
+        new_invalid.rem_up = _penalties.gapo2() + _penalties.gape2();
+        new_invalid.seg.start_d = diag + 1;
+        new_invalid.seg.end_d = diag;
+        vdata._i2_invalid.push_back(new_invalid);
+
+        new_invalid.rem_down = _penalties.gapo2() + _penalties.gape2();
+        new_invalid.rem_up = 2 * (_penalties.gapo2() + _penalties.gape2());
+        new_invalid.seg.start_d = diag;
+        new_invalid.seg.end_d = diag - 1;
+        vdata._d2_invalid.push_back(new_invalid);
+    }
+
+    /**
+     * @brief Invalidate a diagonal "diag" in vertex located at index "idx" and
+     * for matrix I2. This happens when a jump is performed in the I2 matrix
+     * (the M matrix is invalidated by the M jump of the same cell).
+     *
+     * @param idx
+     * @param diag
+     */
+    void invalidate_i2_jump(int idx, int diag) {
+        VertexData &vdata = _active_vertices[idx];
+        InvalidData new_invalid;
+        new_invalid.rem_down = 2 * _penalties.gapo2() + 3 * _penalties.gape2();
+        new_invalid.rem_up = _penalties.gape2();
+        new_invalid.seg.start_d = diag;
+        new_invalid.seg.end_d = diag;
+        vdata._i2_invalid.push_back(new_invalid);
     }
 
     /**
@@ -394,12 +465,12 @@ public:
             else if constexpr (matrix == Cell::Matrix::D) {
                 return vdata._d_invalid;
             }
-            // else if constexpr (matrix == Cell::Matrix::I2) {
-            //     return vdata._i2_invalid;
-            // }
-            // else if constexpr (matrix == Cell::Matrix::D2) {
-            //     return vdata._d2_invalid;
-            // }
+            else if constexpr (matrix == Cell::Matrix::I2) {
+                return vdata._i2_invalid;
+            }
+            else if constexpr (matrix == Cell::Matrix::D2) {
+                return vdata._d2_invalid;
+            }
             else {
                 static_assert([]{ return false; }(), "Unsupported matrix type");
             }
@@ -414,13 +485,23 @@ public:
         return true;
     }
 
+    /**
+     * @brief Get the vertex data of the vertex located at index "idx".
+     *
+     * @param idx   Index of the vertex in the active vertices
+     * @return VertexData&  Data of the vertex
+     */
+    VertexData &get_vertex_data_by_idx(int idx) {
+        return _active_vertices[idx];
+    }
+
     /**
      * @brief Return the number of active vertices.
      *
      * @return int
      */
     int num_active_vertices() {
-        return _active_vertices.size();
+        return _nactive;
     }
 
     /**
@@ -430,27 +511,113 @@ public:
      * @param vtx
      */
     void activate_vertex(int vtx) {
-        if (_vertex_to_idx.size() <= vtx) {
-            _vertex_to_idx.resize(2*vtx + 1, -1);
+        if ((int)_vertex_to_idx.size() <= vtx) {
+            _vertex_to_idx.resize(2*vtx + 1, VertexStamp{0, -1});
         }
-        if (_vertex_to_idx[vtx] == -1) {
-            // Add the vertex to the active vertices
-            _active_vertices.push_back(VertexData());
-            _active_vertices[_active_vertices.size() - 1].vertex_id = vtx;
-            _active_vertices[_active_vertices.size() - 1]._i_jumps_positions.resize(_nscores);
-            _active_vertices[_active_vertices.size() - 1]._m_jumps_positions.resize(_nscores);
+        if (_vertex_to_idx[vtx].epoch != _epoch) {
+            // Add the vertex to the active vertices (reusing the data of a
+            // vertex from a previous alignment if possible)
+            if (_nactive == (int)_active_vertices.size()) {
+                _active_vertices.push_back(VertexData());
+                _active_vertices[_nactive]._i_jumps_positions.resize(_nscores);
+                _active_vertices[_nactive]._i2_jumps_positions.resize(_nscores);
+                _active_vertices[_nactive]._m_jumps_positions.resize(_nscores);
+                _active_vertices[_nactive]._last_live_score = -1;
+            }
+            else {
+                reset_vertex_data(_active_vertices[_nactive]);
+            }
+            _active_vertices[_nactive].vertex_id = vtx;
 
             // Determine the vertex id
-            _vertex_to_idx[vtx] = _active_vertices.size() - 1;
+            _vertex_to_idx[vtx] = VertexStamp{_epoch, _nactive};
+            _nactive += 1;
+        }
+    }
+
+    /**
+     * @brief Copy of the data of the active vertices, used to resume an
+     * alignment from a previous state.
+     *
+     */
+    struct Snapshot {
+        std::vector<VertexData> vertices;
+        int nactive = 0;
+    };
+
+    /**
+     * @brief Save the data of the active vertices. The memory of the snapshot
+     * is reused.
+     *
+     * @param snapshot
+     */
+    void save(Snapshot &snapshot) const {
+        if ((int)snapshot.vertices.size() < _nactive) {
+            snapshot.vertices.resize(_nactive);
+        }
+        for (int l = 0; l < _nactive; ++l) {
+            snapshot.vertices[l] = _active_vertices[l];
         }
+        snapshot.nactive = _nactive;
+    }
+
+    /**
+     * @brief Restore the data of the active vertices from a snapshot. Only the
+     * vertices of the snapshot are active afterwards.
+     *
+     * @param snapshot
+     */
+    void restore(const Snapshot &snapshot) {
+        new_alignment();
+        if ((int)_active_vertices.size() < snapshot.nactive) {
+            _active_vertices.resize(snapshot.nactive);
+        }
+        for (int l = 0; l < snapshot.nactive; ++l) {
+            _active_vertices[l] = snapshot.vertices[l];
+            _vertex_to_idx[snapshot.vertices[l].vertex_id] = VertexStamp{_epoch, l};
+        }
+        _nactive = snapshot.nactive;
     }
 
 private:
+    /**
+     * @brief Entry of the vertex to index map. The index is only valid if the
+     * epoch matches the epoch of the current alignment.
+     *
+     */
+    struct VertexStamp {
+        uint32_t epoch;
+        Cell::vertex_t idx;
+    };
+
+    /**
+     * @brief Clear the data of a vertex keeping the allocated memory.
+     *
+     * @param vdata
+     */
+    void reset_vertex_data(VertexData &vdata) {
+        vdata._last_live_score = -1;
+        vdata._m_invalid.clear();
+        vdata._i_invalid.clear();
+        vdata._d_invalid.clear();
+        vdata._i2_invalid.clear();
+        vdata._d2_invalid.clear();
+        for (int l = 0; l < _nscores; ++l) {
+            vdata._m_jumps_positions[l].clear();
+            vdata._i_jumps_positions[l].clear();
+            vdata._i2_jumps_positions[l].clear();
+        }
+    }
+
     const Penalties &_penalties;
+    const bool _linear_gaps;    // Only the M matrix (and its invalid segments)
+    const bool _dual_gaps;      // Also the I2 and D2 matrices
 
-    std::vector<VertexData> _active_vertices;
+    std::vector<VertexData> _active_vertices;   // Only the first _nactive are in use
+    int _nactive = 0;
 
-    std::vector<Cell::vertex_t> _vertex_to_idx;
+    std::vector<VertexStamp> _vertex_to_idx;
+    uint32_t _epoch = 1;
 };
 
 }   // namespace theseus
\ No newline at end of file
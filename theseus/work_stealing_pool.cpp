@@ -0,0 +1,179 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <algorithm>
+
+#include "work_stealing_pool.h"
+
+namespace theseus {
+
+WorkStealingPool::WorkStealingPool(int num_threads) {
+    num_threads = std::max(num_threads, 1);
+    for (int w = 0; w < num_threads; ++w) {
+        _queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    // Worker 0 is the thread calling run()
+    for (int w = 1; w < num_threads; ++w) {
+        _threads.emplace_back(&WorkStealingPool::worker_loop, this, w);
+    }
+}
+
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _job_cv.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+
+void WorkStealingPool::run(size_t num_items, const task_t &task) {
+    const int num_workers = num_threads();
+
+    // Distribute contiguous blocks of items among the workers
+    for (int w = 0; w < num_workers; ++w) {
+        size_t start = num_items * w / num_workers;
+        size_t end = num_items * (w + 1) / num_workers;
+        std::lock_guard<std::mutex> lock(_queues[w]->mutex);
+        for (size_t item = start; item < end; ++item) {
+            _queues[w]->items.push_back(item);
+        }
+    }
+
+    // Wake up the workers and work as worker 0
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _nbusy = num_workers - 1;
+        _job_id += 1;
+    }
+    _job_cv.notify_all();
+
+    process(0);
+
+    // Wait for the rest of workers
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done_cv.wait(lock, [this]() { return _nbusy == 0; });
+        _task = nullptr;
+    }
+
+    if (_error) {
+        std::exception_ptr error = _error;
+        _error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+
+void WorkStealingPool::worker_loop(int worker_id) {
+    uint64_t last_job = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _job_cv.wait(lock, [&]() { return _stop || _job_id != last_job; });
+            if (_stop) {
+                return;
+            }
+            last_job = _job_id;
+        }
+
+        process(worker_id);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _nbusy -= 1;
+        }
+        _done_cv.notify_one();
+    }
+}
+
+
+void WorkStealingPool::process(int worker_id) {
+    size_t item;
+    while (pop(worker_id, item) || steal(worker_id, item)) {
+        try {
+            (*_task)(worker_id, item);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(_error_mutex);
+            if (!_error) {
+                _error = std::current_exception();
+            }
+        }
+    }
+}
+
+
+bool WorkStealingPool::pop(int worker_id, size_t &item) {
+    WorkerQueue &queue = *_queues[worker_id];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.items.empty()) {
+        return false;
+    }
+    item = queue.items.front();
+    queue.items.pop_front();
+    return true;
+}
+
+
+bool WorkStealingPool::steal(int thief_id, size_t &item) {
+    const int num_workers = num_threads();
+    for (int l = 1; l < num_workers; ++l) {
+        WorkerQueue &victim = *_queues[(thief_id + l) % num_workers];
+        std::vector<size_t> stolen;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.items.empty()) {
+                continue;
+            }
+
+            // Steal the last half of the victim's items
+            size_t nsteal = (victim.items.size() + 1) / 2;
+            stolen.assign(victim.items.end() - nsteal, victim.items.end());
+            victim.items.erase(victim.items.end() - nsteal, victim.items.end());
+        }
+
+        item = stolen.front();
+        if (stolen.size() > 1) {
+            WorkerQueue &own = *_queues[thief_id];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.items.insert(own.items.end(), stolen.begin() + 1, stolen.end());
+        }
+        return true;
+    }
+    return false;
+}
+
+} // namespace theseus
@@ -0,0 +1,144 @@
+/*
+ *                             The MIT License
+ *
+ * Copyright (c) 2024 by Albert Jimenez-Blanco
+ *
+ * This file is part of #################### Theseus Library ####################.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Pool of persistent threads that processes batches of independent items with
+ * work stealing. Each worker owns a queue with a contiguous block of the items
+ * of the batch. When a worker runs out of items, it steals half of the
+ * remaining items of another worker, so that items with very different costs
+ * do not leave idle threads.
+ *
+ * The thread calling run() acts as worker 0, so a pool of N threads only
+ * spawns N-1 threads.
+ *
+ */
+
+namespace theseus {
+
+class WorkStealingPool {
+public:
+    /**
+     * @brief Task to be run for each item: task(worker_id, item).
+     *
+     */
+    using task_t = std::function<void(int, size_t)>;
+
+    /**
+     * @brief Construct a new Work Stealing Pool object
+     *
+     * @param num_threads Number of workers (including the calling thread)
+     */
+    WorkStealingPool(int num_threads);
+
+    /**
+     * @brief Destroy the Work Stealing Pool object. Waits for the threads.
+     *
+     */
+    ~WorkStealingPool();
+
+    /**
+     * @brief Get the number of workers.
+     *
+     * @return int
+     */
+    int num_threads() const {
+        return _queues.size();
+    }
+
+    /**
+     * @brief Run task(worker_id, item) for all the items in [0, num_items) and
+     * wait until all of them are processed. If some task throws, the first
+     * exception is rethrown once the batch has finished.
+     *
+     * @param num_items
+     * @param task
+     */
+    void run(size_t num_items, const task_t &task);
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    /**
+     * @brief Main loop of the spawned threads.
+     *
+     * @param worker_id
+     */
+    void worker_loop(int worker_id);
+
+    /**
+     * @brief Process items (own or stolen) until there is nothing left.
+     *
+     * @param worker_id
+     */
+    void process(int worker_id);
+
+    /**
+     * @brief Take the next item from the own queue.
+     *
+     */
+    bool pop(int worker_id, size_t &item);
+
+    /**
+     * @brief Steal half of the items of another worker. The first stolen item
+     * is returned and the rest are moved to the thief's queue.
+     *
+     */
+    bool steal(int thief_id, size_t &item);
+
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _job_cv;
+    std::condition_variable _done_cv;
+    const task_t *_task = nullptr;
+    uint64_t _job_id = 0;
+    int _nbusy = 0;
+    bool _stop = false;
+
+    std::mutex _error_mutex;
+    std::exception_ptr _error;
+};
+
+} // namespace theseus
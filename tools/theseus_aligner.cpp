@@ -30,15 +30,23 @@
 
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <semaphore>
 #include <sstream>
 #include <string>
+#include <thread>
 
 
 #include "theseus/alignment.h"
 #include "theseus/penalties.h"
 #include "theseus/theseus_aligner.h"
+#include "theseus/theseus_graph.h"
 
 #include <vector>
 
@@ -47,77 +55,143 @@
 #define AVOID_THESEUS 0
 #define PRINT_ALIGNMENTS 0
 
+// Number of sequences per chunk of the pipeline
+constexpr int chunk_size = 256;
+
 struct CMDArgs {
     int match = 0;
     int mismatch = 2;
     int gapo = 3;
     int gape = 1;
+    int gapo2 = -1;
+    int gape2 = -1;
     std::string graph_file;
     std::string sequences_and_positions_file;
     std::string output_file;
+    bool packed = false;
+    bool low_memory = false;
+    int threads = 1;
+    int max_score = -1;
+    int xdrop = -1;
+    int fallback = -1;
 };
 
 
-// Read sequence data
-void read_seq_pos_data(
-    std::ifstream &sp_file,
-    std::vector<std::string> &sequences,
-    std::vector<std::string> &start_vertices,
-    std::vector<int> &start_offsets)
-{
-    if (!sp_file.is_open()) {
-        std::cerr << "Could not open dataset file\n";
-        return;
-    }
+// A sequence and its starting position
+struct Read {
+    std::string sequence;
+    std::string start_vertex;
+    int start_offset;
+};
 
-    std::string sequence, line; // Value and metadata of the sequence
-    std::istringstream iss(line);
-    std::string vertex, orientation;
-    int offset;
 
-    // Read sequences
-    int num = 0;
-    while (getline(sp_file, line))
-    {
-        if (line.empty())
-            continue;
-
-        if (line[0] == '>')
-        {
-            // Read positional data
-            iss.clear();
-            iss.str(line.substr(1)); // Skip the '>'
-            if (!(iss >> vertex >> offset >> orientation)) {
-                std::cerr << "Error reading position line: " << line << std::endl;
-                continue;
-            }
-            if (orientation != "+" && orientation != "-") {
-                std::cerr << "Invalid orientation in line: " << line << std::endl;
-                continue;
-            }
+// Unit of work of the pipeline: a set of consecutive reads and their GAF output
+struct Chunk {
+    size_t id;              // Position of the chunk in the input
+    size_t first_read;      // Index of the first read of the chunk
+    std::vector<Read> reads;
+    std::string gaf;
+};
 
-            vertex = vertex + orientation; // We store the orientation in the vertex name);
-            start_vertices.push_back(vertex);
-            start_offsets.push_back(offset);
 
-            // Store previous sequence if any
-            if (num > 0) sequences.push_back(sequence);
-            sequence.clear();
-            num += 1;
-        }
-        else
-        {
-            sequence += line;   // The sequnce may span several lines
+/**
+ * @brief Blocking queue with a maximum capacity. Push blocks while the queue
+ * is full and pop blocks while it is empty. Once closed, pop returns nothing
+ * after the remaining elements have been consumed.
+ *
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(size_t capacity) : _capacity(capacity) {}
+
+    void push(T value) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this]() { return _queue.size() < _capacity; });
+        _queue.push(std::move(value));
+        _not_empty.notify_one();
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_empty.wait(lock, [this]() { return !_queue.empty() || _closed; });
+        if (_queue.empty()) {
+            return std::nullopt;
         }
+        T value = std::move(_queue.front());
+        _queue.pop();
+        _not_full.notify_one();
+        return value;
     }
 
-    // Store the last sequence
-    if (num > 0) {
-      sequences.push_back(sequence);
+    void close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _not_empty.notify_all();
     }
 
-    // Close the file
-    sp_file.close();
+private:
+    size_t _capacity;
+    std::queue<T> _queue;
+    bool _closed = false;
+    std::mutex _mutex;
+    std::condition_variable _not_empty;
+    std::condition_variable _not_full;
+};
+
+
+/**
+ * @brief Read the next read (positional data and sequence) of the file.
+ *
+ * The metadata line ("> vertex offset orientation") is followed by the
+ * sequence, which may span several lines.
+ *
+ * @param sp_file
+ * @param read
+ * @return bool False if there are no more reads
+ */
+bool read_next_seq_pos(std::istream &sp_file, std::string &pending_header, Read &read)
+{
+    std::string line, vertex, orientation;
+    int offset;
+
+    while (true) {
+        // Find the next valid header
+        while (pending_header.empty()) {
+            if (!getline(sp_file, line)) return false;
+            if (!line.empty() && line[0] == '>') pending_header = line;
+        }
+
+        // Read positional data
+        std::istringstream iss(pending_header.substr(1)); // Skip the '>'
+        bool valid = true;
+        if (!(iss >> vertex >> offset >> orientation)) {
+            std::cerr << "Error reading position line: " << pending_header << std::endl;
+            valid = false;
+        }
+        else if (orientation != "+" && orientation != "-") {
+            std::cerr << "Invalid orientation in line: " << pending_header << std::endl;
+            valid = false;
+        }
+        pending_header.clear();
+
+        // Read the sequence (until the next header)
+        read.sequence.clear();
+        while (getline(sp_file, line)) {
+            if (line.empty()) continue;
+            if (line[0] == '>') {
+                pending_header = line;
+                break;
+            }
+            read.sequence += line;   // The sequnce may span several lines
+        }
+
+        if (valid) {
+            read.start_vertex = vertex + orientation; // We store the orientation in the vertex name
+            read.start_offset = offset;
+            return true;
+        }
+    }
 }
 
 
@@ -131,9 +205,17 @@ void help() {
                  "  -x, --mismatch <int>         The mismatch penalty                             [default=2]\n"
                  "  -o, --gapo <int>             The gap open penalty                             [default=3]\n"
                  "  -e, --gape <int>             The gap extension penalty                        [default=1]\n"
+                 "  -O, --gapo2 <int>            The second gap open penalty (dual affine-gap)    [default=off]\n"
+                 "  -E, --gape2 <int>            The second gap extension penalty                 [default=off]\n"
                  "  -g, --graph_file <file>      Graph file in .gfa format                        [Required]\n"
                  "  -s, --sequences_file <file>  Sequences and starting positons in .fasta format [Required]\n"
-                 "  -f, --output_file <file>     Output file                                      [Required]\n";
+                 "  -f, --output_file <file>     Output file                                      [Required]\n"
+                 "  -p, --packed                 Store sequences with 2 bits per base             [default=off]\n"
+                 "  -l, --low_memory             Bidirectional low memory alignment               [default=off]\n"
+                 "  -t, --threads <int>          Number of aligner threads                        [default=1]\n"
+                 "  -c, --max_score <int>        Terminate alignments above this score            [default=off]\n"
+                 "  -d, --xdrop <int>            Terminate alignments with this X-drop            [default=off]\n"
+                 "  -b, --dp_fallback <int>      Banded DP for alignments above this score        [default=off]\n";
 }
 
 CMDArgs parse_args(int argc, char *const *argv) {
@@ -141,16 +223,24 @@ CMDArgs parse_args(int argc, char *const *argv) {
                                           {"mismatch", required_argument, 0, 'x'},
                                           {"gapo", required_argument, 0, 'o'},
                                           {"gape", required_argument, 0, 'e'},
+                                          {"gapo2", required_argument, 0, 'O'},
+                                          {"gape2", required_argument, 0, 'E'},
                                           {"graph_file", required_argument, 0, 'g'},
                                           {"sequences_file", required_argument, 0, 's'},
                                           {"output_file", required_argument, 0, 'f'},
+                                          {"packed", no_argument, 0, 'p'},
+                                          {"low_memory", no_argument, 0, 'l'},
+                                          {"threads", required_argument, 0, 't'},
+                                          {"max_score", required_argument, 0, 'c'},
+                                          {"xdrop", required_argument, 0, 'd'},
+                                          {"dp_fallback", required_argument, 0, 'b'},
                                           {0, 0, 0, 0}};
 
     CMDArgs args;
 
     int opt;
     int option_index = 0;
-    while ((opt = getopt_long(argc, argv, "m:x:o:e:g:s:f:", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "m:x:o:e:O:E:g:s:f:plt:c:d:b:", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'm':
                 args.match = std::stoi(optarg);
@@ -164,6 +254,12 @@ CMDArgs parse_args(int argc, char *const *argv) {
             case 'e':
                 args.gape = std::stoi(optarg);
                 break;
+            case 'O':
+                args.gapo2 = std::stoi(optarg);
+                break;
+            case 'E':
+                args.gape2 = std::stoi(optarg);
+                break;
             case 'g':
                 args.graph_file = optarg;
                 break;
@@ -173,6 +269,24 @@ CMDArgs parse_args(int argc, char *const *argv) {
             case 'f':
                 args.output_file = optarg;
                 break;
+            case 'p':
+                args.packed = true;
+                break;
+            case 'l':
+                args.low_memory = true;
+                break;
+            case 't':
+                args.threads = std::max(1, std::stoi(optarg));
+                break;
+            case 'c':
+                args.max_score = std::stoi(optarg);
+                break;
+            case 'd':
+                args.xdrop = std::stoi(optarg);
+                break;
+            case 'b':
+                args.fallback = std::stoi(optarg);
+                break;
             default:
                 std::cerr << "Invalid option" << std::endl;
                 exit(1);
@@ -193,32 +307,110 @@ int main(int argc, char *const *argv) {
         return 1;
     }
 
-    theseus::Penalties penalties(args.match, args.mismatch, args.gapo, args.gape);
+    if ((args.gapo2 < 0) != (args.gape2 < 0)) {
+        std::cerr << "Dual affine-gap penalties require both --gapo2 and --gape2\n";
+        return 1;
+    }
+    theseus::Penalties penalties = (args.gapo2 < 0) ?
+        theseus::Penalties(args.match, args.mismatch, args.gapo, args.gape) :
+        theseus::Penalties(args.match, args.mismatch, args.gapo, args.gape, args.gapo2, args.gape2);
 
     // Manage input/output files
     std::ifstream graph_file(args.graph_file);
     std::ifstream sp_file(args.sequences_and_positions_file);
     std::ofstream output_file(args.output_file);
+    if (!sp_file.is_open()) {
+        std::cerr << "Could not open dataset file\n";
+        return 1;
+    }
 
-    // Prepare the aligner
-    theseus::TheseusAligner aligner(penalties, graph_file);
+    // Load the graph (shared by all the aligner threads)
+    theseus::TheseusGraph graph(graph_file, args.packed);
 
-    // Read queries data
-    std::vector<std::string> sequences, start_vertices;
-    std::vector<int> start_offsets;
-    read_seq_pos_data(sp_file, sequences, start_vertices, start_offsets);
+    // Pipeline: reader -> aligners -> writer. The number of chunks alive at
+    // any time is bounded, so memory does not depend on the input size.
+    const int max_chunks_in_flight = 4 * args.threads;
+    std::counting_semaphore<> free_chunks(max_chunks_in_flight);
+    BoundedQueue<Chunk> input_queue(max_chunks_in_flight);
+    BoundedQueue<Chunk> output_queue(max_chunks_in_flight);
 
-    // Align the sequences
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    int num_sequences = sequences.size();
-    theseus::Alignment alignment;
-    for (int i = 0; i < num_sequences; ++i) {
-        // Perform alignment
-        std::cout << "Seq " << i << std::endl;
-        alignment = aligner.align(sequences[i], start_vertices[i], start_offsets[i]);
-        aligner.print_alignment_as_gaf(alignment, output_file, "seq_" + std::to_string(i));
+
+    // Reader thread: parse the sequences in chunks
+    std::thread reader([&]() {
+        std::string pending_header;
+        size_t num_reads = 0, num_chunks = 0;
+        bool more = true;
+        while (more) {
+            free_chunks.acquire();
+            Chunk chunk;
+            chunk.id = num_chunks;
+            chunk.first_read = num_reads;
+            chunk.reads.resize(chunk_size);
+            int n = 0;
+            while (n < chunk_size && (more = read_next_seq_pos(sp_file, pending_header, chunk.reads[n]))) {
+                n += 1;
+            }
+            chunk.reads.resize(n);
+            num_reads += n;
+            num_chunks += 1;
+            input_queue.push(std::move(chunk));
+        }
+        input_queue.close();
+    });
+
+    // Aligner threads: each one with its own aligner on the shared graph
+    std::vector<std::thread> aligners;
+    for (int t = 0; t < args.threads; ++t) {
+        aligners.emplace_back([&]() {
+            theseus::TheseusAligner aligner(penalties, graph);
+            if (args.low_memory) {
+                aligner.set_memory_mode(theseus::MemoryMode::Low);
+            }
+            aligner.set_early_termination({args.max_score, args.xdrop});
+            aligner.set_dp_fallback({.score_threshold = args.fallback});
+            std::ostringstream gaf;
+            while (auto chunk = input_queue.pop()) {
+                gaf.str("");
+                for (size_t l = 0; l < chunk->reads.size(); ++l) {
+                    const Read &read = chunk->reads[l];
+                    std::string name = "seq_" + std::to_string(chunk->first_read + l);
+                    try {
+                        theseus::Alignment alignment = aligner.align(read.sequence, read.start_vertex, read.start_offset);
+                        aligner.print_alignment_as_gaf(alignment, gaf, name);
+                    }
+                    catch (const std::exception &e) {
+                        std::cerr << "Could not align " << name << ": " << e.what() << std::endl;
+                    }
+                }
+                chunk->gaf = gaf.str();
+                chunk->reads.clear();
+                output_queue.push(std::move(*chunk));
+            }
+        });
     }
 
+    // Writer thread: write the chunks in input order
+    std::thread writer([&]() {
+        std::map<size_t, std::string> pending;
+        size_t next_chunk = 0;
+        while (auto chunk = output_queue.pop()) {
+            pending[chunk->id] = std::move(chunk->gaf);
+            while (!pending.empty() && pending.begin()->first == next_chunk) {
+                output_file << pending.begin()->second;
+                pending.erase(pending.begin());
+                next_chunk += 1;
+                free_chunks.release();
+            }
+        }
+    });
+
+    reader.join();
+    for (auto &aligner : aligners) aligner.join();
+    output_queue.close();
+    writer.join();
+    output_file.flush();
+
     // End time measurement
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     std::cout << "Elapsed time: " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " microseconds" << std::endl;
@@ -228,4 +420,4 @@ int main(int argc, char *const *argv) {
     sp_file.close();
 
     return 0;
-}
\ No newline at end of file
+}